@@ -0,0 +1,169 @@
+#include <texcaller.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+static const char *latex =
+    "\\documentclass{article}"
+    "\\begin{document}"
+    "Hello world!"
+    "\\end{document}";
+
+static const char *tex = "\\shipout\\hbox{Hello world!}\\end";
+
+static texcaller_pool *pool;
+static int pool_iterations;
+
+static double now(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void *submit(void *arg)
+{
+    int i;
+    (void)arg;
+    for (i = 0; i < pool_iterations; i++) {
+        char *dvi;
+        size_t dvi_size;
+        char *info;
+
+        texcaller_pool_convert(&dvi, &dvi_size, &info, pool,
+                               tex, strlen(tex), "TeX", "DVI", 2, NULL);
+        free(dvi);
+        free(info);
+    }
+    return NULL;
+}
+
+static int benchmark_pool(int iterations, int workers, const char *placement)
+{
+    pthread_t threads[64];
+    texcaller_pool_options options;
+    texcaller_pool_stats stats;
+    texcaller_pool_node_stats node_stats;
+    char *info;
+    int submitters;
+    int i;
+
+    texcaller_pool_options_init(&options);
+    options.workers = workers;
+    options.placement = placement;
+    pool = texcaller_pool_create(&info, &options);
+    if (pool == NULL) {
+        printf("Error: %s\n", info == NULL ? "Out of memory." : info);
+        free(info);
+        return 1;
+    }
+    pool_iterations = iterations;
+    printf("%10s %10s %12s %10s %10s %10s %10s\n",
+           "submitters", "jobs/s", "CAS fail/job", "steals", "injected", "sleeps", "wakeups");
+    for (submitters = 1; submitters <= 64; submitters *= 2) {
+        const double start = now();
+        texcaller_pool_stats before;
+        double elapsed;
+        unsigned long jobs;
+
+        texcaller_pool_get_stats(pool, &before);
+        for (i = 0; i < submitters; i++) {
+            pthread_create(&threads[i], NULL, submit, NULL);
+        }
+        for (i = 0; i < submitters; i++) {
+            pthread_join(threads[i], NULL);
+        }
+        elapsed = now() - start;
+        texcaller_pool_get_stats(pool, &stats);
+        jobs = stats.jobs - before.jobs;
+        printf("%10i %10.1f %12.3f %10lu %10lu %10lu %10lu\n",
+               submitters, jobs / elapsed,
+               (double)(stats.cas_failures - before.cas_failures) / jobs,
+               stats.steals - before.steals, stats.injected - before.injected,
+               stats.sleeps - before.sleeps, stats.wakeups - before.wakeups);
+    }
+    printf("\n%10s %10s %10s %12s %12s\n",
+           "node", "workers", "jobs", "ms/job", "CPU ms/job");
+    for (i = 0; texcaller_pool_get_node_stats(pool, i, &node_stats) == 0; i++) {
+        printf("%10i %10i %10lu %12.2f %12.2f\n",
+               node_stats.node, node_stats.workers, node_stats.jobs,
+               node_stats.jobs > 0 ? 1000 * node_stats.run_time / node_stats.jobs : 0.0,
+               node_stats.jobs > 0 ? 1000 * node_stats.cpu_time / node_stats.jobs : 0.0);
+    }
+    texcaller_pool_free(pool);
+    return 0;
+}
+
+static int benchmark(const char *title, const char *languages, int iterations)
+{
+    texcaller_options options;
+    texcaller_stats stats;
+    double run_time = 0;
+    long max_rss = 0;
+    int runs = 0;
+    int i;
+
+    texcaller_options_init(&options);
+    options.languages = languages;
+    options.stats = &stats;
+
+    for (i = 0; i < iterations; i++) {
+        char *pdf;
+        size_t pdf_size;
+        char *info;
+
+        texcaller_convert_with_options(&pdf, &pdf_size, &info,
+                                       latex, strlen(latex), "LaTeX", "PDF", 5,
+                                       &options);
+        if (pdf == NULL) {
+            printf("Error: %s\n", info == NULL ? "Out of memory." : info);
+            free(info);
+            return 1;
+        }
+        free(pdf);
+        free(info);
+
+        runs += stats.runs;
+        run_time += stats.run_time;
+        if (stats.max_rss > max_rss) {
+            max_rss = stats.max_rss;
+        }
+    }
+
+    printf("%-32s %8.1f ms/run %8ld KB peak RSS\n",
+           title, 1000 * run_time / runs, max_rss);
+    return 0;
+}
+
+static int benchmark_formats(const char *languages, int iterations)
+{
+    char *info;
+
+    if (texcaller_build_format(&info, "LaTeX", "PDF", languages) != 0) {
+        printf("Error: %s\n", info == NULL ? "Out of memory." : info);
+        free(info);
+        return 1;
+    }
+    free(info);
+
+    if (benchmark("stock format", NULL, iterations) != 0) {
+        return 1;
+    }
+    if (benchmark("slim format", languages, iterations) != 0) {
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    const int iterations = argc > 2 ? atoi(argv[2]) : 20;
+
+    if (argc > 1 && strcmp(argv[1], "pool") == 0) {
+        return benchmark_pool(iterations, argc > 3 ? atoi(argv[3]) : 0,
+                              argc > 4 ? argv[4] : NULL);
+    }
+    return benchmark_formats(argc > 1 ? argv[1] : "ngerman", iterations);
+}
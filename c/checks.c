@@ -0,0 +1,418 @@
+/* the library source is included to check its internal functions as well */
+#include "texcaller.c"
+#include <float.h>
+#include <limits.h>
+
+static int failures = 0;
+
+static void check(int condition, const char *what)
+{
+    if (!condition) {
+        printf("FAILED: %s\n", what);
+        failures++;
+    }
+}
+
+/*! Calculate the SHA-256 digest of \c size bytes of \c data,
+ *  fed in pieces of \c piece_size bytes, and compare it with \c expected.
+ */
+static void check_digest_of(const char *data, size_t size, size_t piece_size, const char *expected, const char *what)
+{
+    struct digest digest;
+    char *key;
+    size_t pos;
+    digest_init(&digest);
+    for (pos = 0; pos < size; pos += piece_size) {
+        digest_update(&digest, data + pos, size - pos < piece_size ? size - pos : piece_size);
+    }
+    key = digest_key(&digest);
+    check(key != NULL && strcmp(key, expected) == 0, what);
+    free(key);
+}
+
+static void check_digest(void)
+{
+    const char *two_blocks = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+    char *million;
+
+    /* known answers of FIPS 180-2 */
+    check_digest_of("", 0, 1,
+                    "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855",
+                    "digest of empty message");
+    check_digest_of("abc", 3, 3,
+                    "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad",
+                    "digest of one block");
+    check_digest_of("abc", 3, 1,
+                    "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad",
+                    "digest of one block in pieces");
+    check_digest_of(two_blocks, strlen(two_blocks), strlen(two_blocks),
+                    "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1",
+                    "digest of two blocks");
+    check_digest_of(two_blocks, strlen(two_blocks), 7,
+                    "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1",
+                    "digest of two blocks in pieces");
+    million = (char *)malloc(1000000);
+    if (million == NULL) {
+        check(0, "digest of a million characters");
+        return;
+    }
+    memset(million, 'a', 1000000);
+    check_digest_of(million, 1000000, 1000000,
+                    "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0",
+                    "digest of a million characters");
+    check_digest_of(million, 1000000, 997,
+                    "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0",
+                    "digest of a million characters in pieces");
+    free(million);
+}
+
+static void check_table(void)
+{
+    const char strings[] = "a&b%";
+    const size_t offsets[4] = { 0, 3, 3, 4 };
+    const long integers[3] = { 42, LONG_MIN, 0 };
+    const double numbers[3] = { 1.5, -0.25, 0 };
+    const double extremes[2] = { -DBL_MAX, DBL_MIN };
+    const unsigned char nulls[3] = { 0, 0, 1 };
+    texcaller_column columns[3];
+    char *table;
+    size_t table_size;
+    char *info;
+    char expected[512];
+
+    columns[0].type = "text";
+    columns[0].strings = strings;
+    columns[0].offsets = offsets;
+    columns[0].nulls = NULL;
+    columns[1].type = "integer";
+    columns[1].integers = integers;
+    columns[1].nulls = nulls;
+    columns[2].type = "number";
+    columns[2].numbers = numbers;
+    columns[2].precision = 2;
+    columns[2].nulls = nulls;
+
+    /* text, integers, numbers and null cells */
+    texcaller_render_table(&table, &table_size, &info, columns, 3, 3);
+    sprintf(expected, "a\\&b & 42 & 1.50 \\\\\n & %ld & -0.25 \\\\\n\\%% &  &  \\\\\n", LONG_MIN);
+    check(table != NULL && strcmp(table, expected) == 0, "table with null cells");
+    check(table != NULL && table_size == strlen(expected), "table size");
+    free(table);
+    free(info);
+
+    /* no rows */
+    texcaller_render_table(&table, &table_size, &info, columns, 3, 0);
+    check(table != NULL && table_size == 0 && table[0] == '\0', "empty table");
+    free(table);
+    free(info);
+
+    /* precision bounds */
+    columns[2].precision = 18;
+    texcaller_render_table(&table, &table_size, &info, columns + 2, 1, 3);
+    check(table == NULL && info != NULL, "precision above 17 is rejected");
+    free(table);
+    free(info);
+    columns[2].precision = -2;
+    texcaller_render_table(&table, &table_size, &info, columns + 2, 1, 3);
+    check(table == NULL && info != NULL, "precision below -1 is rejected");
+    free(table);
+    free(info);
+
+    /* the longest possible number */
+    columns[2].numbers = extremes;
+    columns[2].precision = 17;
+    columns[2].nulls = NULL;
+    texcaller_render_table(&table, &table_size, &info, columns + 2, 1, 2);
+    sprintf(expected, "%.17f \\\\\n", -DBL_MAX);
+    check(table != NULL && strncmp(table, expected, strlen(expected)) == 0, "-DBL_MAX with precision 17");
+    free(table);
+    free(info);
+
+    /* precision -1 */
+    columns[2].numbers = numbers;
+    columns[2].precision = -1;
+    texcaller_render_table(&table, &table_size, &info, columns + 2, 1, 2);
+    check(table != NULL && strcmp(table, "1.5 \\\\\n-0.25 \\\\\n") == 0, "precision -1");
+    free(table);
+    free(info);
+}
+
+static void check_escape_latex_batch(void)
+{
+    const char *originals[4] = { "a&b", "", "x_y~", "plain" };
+    const char strings[] = "..a&bx_y~plain";
+    const size_t offsets[5] = { 2, 5, 5, 9, 14 };
+    const size_t empty_offsets[1] = { 0 };
+    char *result;
+    size_t *result_offsets;
+    size_t i;
+
+    /* every escaped string matches texcaller_escape_latex() */
+    if (texcaller_escape_latex_batch(&result, &result_offsets, strings, offsets, 4) != 0) {
+        check(0, "batch escape");
+        return;
+    }
+    check(result_offsets[0] == 0, "first offset of batch escape");
+    check(result_offsets[4] == strlen(result), "last offset of batch escape");
+    for (i = 0; i < 4; i++) {
+        char *escaped = texcaller_escape_latex(originals[i]);
+        check(   escaped != NULL
+              && result_offsets[i + 1] - result_offsets[i] == strlen(escaped)
+              && memcmp(result + result_offsets[i], escaped, strlen(escaped)) == 0,
+              "string of batch escape");
+        free(escaped);
+    }
+    free(result);
+    free(result_offsets);
+
+    /* empty batch */
+    if (texcaller_escape_latex_batch(&result, &result_offsets, "", empty_offsets, 0) != 0) {
+        check(0, "empty batch escape");
+        return;
+    }
+    check(result[0] == '\0' && result_offsets[0] == 0, "empty batch escape");
+    free(result);
+    free(result_offsets);
+}
+
+/*! Assemble a PDF file from the values of its objects 1 to \c count.
+ */
+static size_t make_pdf(char *pdf, const char *const *objects, size_t count)
+{
+    size_t offsets[16];
+    size_t size;
+    size_t xref;
+    size_t i;
+    size = sprintf(pdf, "%%PDF-1.4\n");
+    for (i = 0; i < count; i++) {
+        offsets[i] = size;
+        size += sprintf(pdf + size, "%lu 0 obj\n%s\nendobj\n", (unsigned long)i + 1, objects[i]);
+    }
+    xref = size;
+    size += sprintf(pdf + size, "xref\n0 %lu\n0000000000 65535 f \n", (unsigned long)count + 1);
+    for (i = 0; i < count; i++) {
+        size += sprintf(pdf + size, "%010lu 00000 n \n", (unsigned long)offsets[i]);
+    }
+    size += sprintf(pdf + size, "trailer\n<< /Size %lu /Root 1 0 R >>\nstartxref\n%lu\n%%%%EOF\n",
+                    (unsigned long)count + 1, (unsigned long)xref);
+    return size;
+}
+
+/*! Count the occurrences of a string in a PDF file.
+ */
+static size_t count_in_pdf(const char *pdf, size_t pdf_size, const char *s)
+{
+    const size_t length = strlen(s);
+    size_t count = 0;
+    size_t i;
+    for (i = 0; i + length <= pdf_size; i++) {
+        if (memcmp(pdf + i, s, length) == 0) {
+            count++;
+        }
+    }
+    return count;
+}
+
+/*! Count the pages of a PDF file, or return -1 if it is malformed.
+ */
+static int count_pages(const char *pdf, size_t pdf_size)
+{
+    struct pdf_document doc;
+    struct pdf_pages pages;
+    char *error;
+    int count = -1;
+    if (pdf_parse(&error, &doc, pdf, pdf_size) != 0) {
+        free(error);
+        return -1;
+    }
+    if (pdf_pages_init(&pages, &doc) == 0) {
+        count = (int)pages.count;
+    }
+    pdf_pages_free(&pages);
+    free(doc.offsets);
+    return count;
+}
+
+/*! Concatenate PDF files via a temporary file.
+ *
+ *  \return
+ *      the concatenated PDF file, or \c NULL on failure
+ */
+static char *concat_pdfs(size_t *result_size, const char *const *pdfs, const size_t *pdf_sizes, size_t count)
+{
+    FILE *file;
+    texcaller_concat *concat;
+    char *result = NULL;
+    char *info;
+    off_t size;
+    size_t i;
+    int failed = 0;
+    file = tmpfile();
+    if (file == NULL) {
+        return NULL;
+    }
+    concat = texcaller_concat_begin(&info, fileno(file));
+    if (concat == NULL) {
+        fclose(file);
+        return NULL;
+    }
+    for (i = 0; i < count && !failed; i++) {
+        if (texcaller_concat_add(&info, concat, pdfs[i], pdf_sizes[i]) != 0) {
+            check(info != NULL, "error message of failed concatenation");
+            free(info);
+            failed = 1;
+        }
+    }
+    if (texcaller_concat_finish(&info, concat) != 0) {
+        free(info);
+        failed = 1;
+    }
+    size = lseek(fileno(file), 0, SEEK_END);
+    if (!failed && size > 0) {
+        result = (char *)malloc(size);
+        if (   result != NULL
+            && pread(fileno(file), result, size, 0) != size) {
+            free(result);
+            result = NULL;
+        }
+        *result_size = size;
+    }
+    fclose(file);
+    return result;
+}
+
+static void check_pdf(void)
+{
+    const char *const a_objects[7] = {
+        "<< /Type /Catalog /Pages 2 0 R >>",
+        "<< /Type /Pages /Kids [4 0 R 6 0 R] /Count 2 /MediaBox [0 0 100 100] >>",
+        "<< /Type /Font /Subtype /Type1 /BaseFont /Helvetica >>",
+        "<< /Type /Page /Parent 2 0 R /Resources << /Font << /F1 3 0 R >> >> /Contents 5 0 R >>",
+        "<< /Length 23 >>\nstream\nBT /F1 12 Tf (A1) Tj ET\nendstream",
+        "<< /Type /Page /Parent 2 0 R /Resources << /Font << /F1 3 0 R >> >> /Contents 7 0 R >>",
+        "<< /Length 23 >>\nstream\nBT /F1 12 Tf (A2) Tj ET\nendstream"
+    };
+    /* same font under another object number, and an indirect /Length */
+    const char *const b_objects[6] = {
+        "<< /Type /Catalog /Pages 2 0 R >>",
+        "<< /Type /Pages /Kids [3 0 R] /Count 1 >>",
+        "<< /Type /Page /Parent 2 0 R /MediaBox [0 0 100 100] /Resources << /Font << /F1 5 0 R >> >> /Contents 4 0 R >>",
+        "<< /Length 6 0 R >>\nstream\nBT /F1 12 Tf (B1) Tj ET\nendstream",
+        "<< /Type /Font /Subtype /Type1 /BaseFont /Helvetica >>",
+        "23"
+    };
+    /* streams whose /Length refer to each other */
+    const char *const cycle_objects[5] = {
+        "<< /Type /Catalog /Pages 2 0 R >>",
+        "<< /Type /Pages /Kids [3 0 R] /Count 1 >>",
+        "<< /Type /Page /Parent 2 0 R /MediaBox [0 0 100 100] /Contents [4 0 R 5 0 R] >>",
+        "<< /Length 5 0 R >>\nstream\nBT ET\nendstream",
+        "<< /Length 4 0 R >>\nstream\nBT ET\nendstream"
+    };
+    char a[4096];
+    char b[4096];
+    char broken[4096];
+    const char *pdfs[2];
+    size_t pdf_sizes[2];
+    const char *objects[7];
+    const size_t first_pages[2] = { 0, 1 };
+    const size_t invalid_first_pages[2] = { 0, 3 };
+    struct pdf_range ranges[2];
+    char *results[2];
+    size_t result_sizes[2];
+    char *result;
+    size_t result_size;
+    char *info;
+    char *p;
+
+    pdfs[0] = a;
+    pdf_sizes[0] = make_pdf(a, a_objects, 7);
+    pdfs[1] = b;
+    pdf_sizes[1] = make_pdf(b, b_objects, 6);
+
+    /* concatenation writes the shared font only once */
+    result = concat_pdfs(&result_size, pdfs, pdf_sizes, 2);
+    check(result != NULL, "concatenation");
+    if (result != NULL) {
+        check(count_pages(result, result_size) == 3, "pages of concatenation");
+        check(count_in_pdf(result, result_size, "/BaseFont /Helvetica") == 1, "deduplicated font");
+        check(   count_in_pdf(result, result_size, "(A1)") == 1
+              && count_in_pdf(result, result_size, "(A2)") == 1
+              && count_in_pdf(result, result_size, "(B1)") == 1, "content of concatenation");
+        check(count_in_pdf(result, result_size, "/MediaBox [0 0 100 100]") == 3, "inherited media box");
+    }
+    free(result);
+
+    /* split */
+    if (pdf_split(&info, results, result_sizes, a, pdf_sizes[0], first_pages, 2) != 0) {
+        check(0, "split");
+        free(info);
+    } else {
+        check(   count_pages(results[0], result_sizes[0]) == 1
+              && count_in_pdf(results[0], result_sizes[0], "(A1)") == 1
+              && count_in_pdf(results[0], result_sizes[0], "(A2)") == 0, "first part of split");
+        check(   count_pages(results[1], result_sizes[1]) == 1
+              && count_in_pdf(results[1], result_sizes[1], "(A1)") == 0
+              && count_in_pdf(results[1], result_sizes[1], "(A2)") == 1, "second part of split");
+        free(results[0]);
+        free(results[1]);
+    }
+    check(   pdf_split(&info, results, result_sizes, a, pdf_sizes[0], invalid_first_pages, 2) != 0
+          && info != NULL && results[0] == NULL, "split beyond the last page");
+    free(info);
+
+    /* splice */
+    ranges[0].pdf = 1;
+    ranges[0].first = 0;
+    ranges[0].count = 1;
+    ranges[1].pdf = 0;
+    ranges[1].first = 1;
+    ranges[1].count = PDF_REMAINING_PAGES;
+    if (pdf_splice(&info, &result, &result_size, pdfs, pdf_sizes, 2, ranges, 2) != 0) {
+        check(0, "splice");
+        free(info);
+    } else {
+        check(count_pages(result, result_size) == 2, "pages of splice");
+        check(   count_in_pdf(result, result_size, "(A1)") == 0
+              && count_in_pdf(result, result_size, "(A2)") == 1
+              && count_in_pdf(result, result_size, "(B1)") == 1, "content of splice");
+        check(count_in_pdf(result, result_size, "/BaseFont /Helvetica") == 1, "deduplicated font of splice");
+        free(result);
+    }
+    ranges[1].first = 2;
+    ranges[1].count = 1;
+    check(   pdf_splice(&info, &result, &result_size, pdfs, pdf_sizes, 2, ranges, 2) != 0
+          && info != NULL && result == NULL, "splice beyond the last page");
+    free(info);
+
+    /* broken cross-reference table */
+    memcpy(broken, a, pdf_sizes[0]);
+    p = strstr(broken, "xref\n0 8\n");
+    p[7] = 'x';
+    pdfs[0] = broken;
+    check(concat_pdfs(&result_size, pdfs, pdf_sizes, 1) == NULL, "broken cross-reference table");
+
+    /* stream length beyond the end of the file */
+    memcpy(objects, a_objects, sizeof(objects));
+    objects[4] = "<< /Length 9999 >>\nstream\nBT /F1 12 Tf (A1) Tj ET\nendstream";
+    pdf_sizes[0] = make_pdf(broken, objects, 7);
+    check(concat_pdfs(&result_size, pdfs, pdf_sizes, 1) == NULL, "stream length out of range");
+
+    /* stream lengths referring to each other */
+    pdf_sizes[0] = make_pdf(broken, cycle_objects, 5);
+    check(concat_pdfs(&result_size, pdfs, pdf_sizes, 1) == NULL, "cycle of stream lengths");
+}
+
+int main()
+{
+    check_digest();
+    check_escape_latex_batch();
+    check_table();
+    check_pdf();
+    if (failures > 0) {
+        printf("%i checks failed.\n", failures);
+        return 1;
+    }
+    printf("All checks passed.\n");
+    return 0;
+}
@@ -1,6 +1,38 @@
 #include <texcaller.h>
 #include <iostream>
 
+#ifdef __cpp_impl_coroutine
+
+//
+//  A coroutine that runs until its first co_await right away
+//
+
+struct task
+{
+    struct promise_type
+    {
+        task get_return_object() { return task(); }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+task generate(texcaller_pool *pool, texcaller::reactor &reactor, const std::string &latex, int &done)
+{
+    try {
+        const texcaller::result pdf = co_await texcaller::convert(pool, reactor, latex, "LaTeX", "PDF", 5);
+
+        std::cout << "Generated PDF of " << pdf.size() << " bytes." << std::endl;
+    } catch (std::domain_error &e) {
+        std::cout << "Error: " << e.what() << std::endl;
+    }
+    done++;
+}
+
+#endif
+
 int main()
 {
     //
@@ -25,6 +57,50 @@ int main()
         std::cout << "Error: " << e.what() << std::endl;
     }
 
+#if __cplusplus >= 201703L
+
+    //
+    //  Generate a PDF document without copying it (C++17)
+    //
+
+    try {
+        const texcaller::result pdf = texcaller::convert(latex, "LaTeX", "PDF", 5);
+
+        std::cout << std::endl;
+        std::cout << "Generated PDF of " << pdf.size() << " bytes";
+        std::cout << " in " << pdf.stats().runs << " runs." << std::endl;
+    } catch (std::domain_error &e) {
+        std::cout << "Error: " << e.what() << std::endl;
+    }
+
+#endif
+
+#if defined(__cpp_impl_coroutine) && defined(__linux__)
+
+    //
+    //  Generate PDF documents concurrently from a single thread (C++20)
+    //
+
+    char *pool_info;
+    texcaller_pool *pool = texcaller_pool_create(&pool_info, NULL);
+    if (pool != NULL) {
+        texcaller::epoll_reactor reactor;
+        int done = 0;
+
+        std::cout << std::endl;
+        for (int i = 0; i < 3; i++) {
+            generate(pool, reactor, latex, done);
+        }
+        while (done < 3) {
+            reactor.run_once();
+        }
+        texcaller_pool_free(pool);
+    } else {
+        std::cout << "Error: " << (pool_info == NULL ? "Out of memory." : pool_info) << std::endl;
+    }
+    free(pool_info);
+
+#endif
 
     //
     //  Escape a string for LaTeX
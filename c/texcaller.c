@@ -7,21 +7,41 @@
  *  @{
  */
 
+#ifndef _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE
+#endif
 #ifndef _BSD_SOURCE
 #define _BSD_SOURCE
 #endif
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
 
 #include "texcaller.h"
 
 #include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <signal.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/time.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
+#ifdef __linux__
+#include <linux/fs.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#endif
 
 #ifdef __cplusplus
 extern "C" {
@@ -61,6 +81,63 @@ static const char *escape_latex_char(char c)
     }
 }
 
+/*! Calculate the size of a string escaped for LaTeX.
+ *
+ *  \param s
+ *      the string to escape
+ *
+ *  \param size
+ *      size of \c s
+ *
+ *  \return
+ *      size of the escaped string, without a terminating null character
+ */
+static size_t escaped_latex_size(const char *s, size_t size)
+{
+    size_t length = 0;
+    size_t i;
+    for (i = 0; i < size; i++) {
+        const char *escaped_char = escape_latex_char(s[i]);
+        if (escaped_char == NULL) {
+            length++;
+        } else {
+            length += strlen(escaped_char);
+        }
+    }
+    return length;
+}
+
+/*! Escape a string for LaTeX into a buffer.
+ *
+ *  \param escaped
+ *      the buffer, which must hold escaped_latex_size() characters
+ *
+ *  \param s
+ *      the string to escape
+ *
+ *  \param size
+ *      size of \c s
+ *
+ *  \return
+ *      size of the escaped string
+ */
+static size_t escape_latex_into(char *escaped, const char *s, size_t size)
+{
+    size_t pos = 0;
+    size_t i;
+    for (i = 0; i < size; i++) {
+        const char *escaped_char = escape_latex_char(s[i]);
+        if (escaped_char == NULL) {
+            escaped[pos++] = s[i];
+        } else {
+            const size_t length = strlen(escaped_char);
+            memcpy(escaped + pos, escaped_char, length);
+            pos += length;
+        }
+    }
+    return pos;
+}
+
 /*! Variant of \c sprintf() that allocates the needed memory automatically.
  *
  *  \param format
@@ -315,239 +392,8815 @@ error_cleanup:
     return -1;
 }
 
-/*!  @} */
-
-/*! Convert a TeX or LaTeX source to DVI or PDF.
+/*! Create a temporary file next to a path.
+ *
+ *  The file is created via \c mkostemp() with a unique name
+ *  of the form <tt>path.XXXXXX</tt>,
+ *  so concurrent writers, be it processes or threads,
+ *  never share a temporary file.
+ *  It is made readable by everyone, like other cache files.
+ *
+ *  \return
+ *      a file descriptor open for writing, or -1 on failure
+ *
+ *  \param error
+ *      On failure, \c error will be set to a newly allocated string
+ *      that contains the error message.
+ *      On success, or when out of memory,
+ *      \c error will be set to \c NULL.
+ *
+ *  \param tmp_path
+ *      On success, \c tmp_path will be set to the newly allocated
+ *      path of the temporary file.
+ *      On failure, it will be set to \c NULL.
+ *
+ *  \param path
+ *      path of the file the temporary file will be renamed to
  */
-void texcaller_convert(char **result, size_t *result_size, char **info, const char *source, size_t source_size, const char *source_format, const char *result_format, int max_runs)
+static int create_temporary_file(char **error, char **tmp_path, const char *path)
 {
-    char *error;
-    const char *cmd;
-    const char *tmpdir;
-    char *dir = NULL;
-    char *dir_template = NULL;
-    char *source_filename = NULL;
-    char *aux_filename = NULL;
-    char *log_filename = NULL;
-    char *result_filename = NULL;
-    char *aux = NULL;
-    size_t aux_size = 0;
-    char *aux_old = NULL;
-    size_t aux_old_size = 0;
-    int runs;
-    *result = NULL;
-    *result_size = 0;
-    *info = NULL;
-    /* check arguments */
-    if        (strcmp(source_format, "TeX") == 0 && strcmp(result_format, "DVI") == 0) {
-        cmd = "tex";
-    } else if (strcmp(source_format, "TeX") == 0 && strcmp(result_format, "PDF") == 0) {
-        cmd = "pdftex";
-    } else if (strcmp(source_format, "LaTeX") == 0 && strcmp(result_format, "DVI") == 0) {
-        cmd = "latex";
-    } else if (strcmp(source_format, "LaTeX") == 0 && strcmp(result_format, "PDF") == 0) {
-        cmd = "pdflatex";
-    } else {
-        *info = sprintf_alloc("Unable to convert from \"%s\" to \"%s\".",
-                              source_format, result_format);
-        goto cleanup;
-    }
-    if (max_runs < 2) {
-        *info = sprintf_alloc("Argument max_runs is %i, but must be >= 2.",
-                              max_runs);
-        goto cleanup;
-    }
-    /* create temporary directory */
-    tmpdir = getenv("TMPDIR");
-    if (tmpdir == NULL || strcmp(tmpdir, "") == 0) {
-        tmpdir = "/tmp";
-    }
-    dir_template = sprintf_alloc("%s/texcaller-temp-XXXXXX", tmpdir);
-    if (dir_template == NULL) {
-        goto cleanup;
-    }
-    dir = mkdtemp(dir_template);
-    if (dir == NULL) {
-        *info = sprintf_alloc("Unable to create temporary directory from template \"%s\": %s.",
-                              dir_template, strerror(errno));
-        goto cleanup;
+    int fd;
+    *error = NULL;
+    *tmp_path = sprintf_alloc("%s.XXXXXX", path);
+    if (*tmp_path == NULL) {
+        return -1;
     }
-    source_filename = sprintf_alloc("%s/texput.tex", dir);
-    if (source_filename == NULL) {
-        goto cleanup;
+    fd = mkostemp(*tmp_path, O_CLOEXEC);
+    if (fd == -1) {
+        *error = sprintf_alloc("Unable to create temporary file \"%s\": %s.", *tmp_path, strerror(errno));
+        free(*tmp_path);
+        *tmp_path = NULL;
+        return -1;
     }
-    aux_filename = sprintf_alloc("%s/texput.aux", dir);
-    if (aux_filename == NULL) {
-        goto cleanup;
+    if (fchmod(fd, 0644) != 0) {
+        *error = sprintf_alloc("Unable to change mode of file \"%s\": %s.", *tmp_path, strerror(errno));
+        close(fd);
+        unlink(*tmp_path);
+        free(*tmp_path);
+        *tmp_path = NULL;
+        return -1;
     }
-    log_filename = sprintf_alloc("%s/texput.log", dir);
-    if (log_filename == NULL) {
-        goto cleanup;
+    return fd;
+}
+
+/*! Write a buffer into a file atomically.
+ *
+ *  The buffer is written into a temporary file next to \c path,
+ *  as created by create_temporary_file(),
+ *  which is then renamed to \c path.
+ *  That way, concurrent readers never see a partially written file.
+ *
+ *  \return
+ *      0 on success, -1 on failure
+ *
+ *  \param error
+ *      On failure, \c error will be set to a newly allocated string
+ *      that contains the error message.
+ *      On success, or when out of memory,
+ *      \c error will be set to \c NULL.
+ *
+ *  \param path
+ *      path of the file to write to
+ *
+ *  \param source
+ *      buffer to write
+ *
+ *  \param source_size
+ *      size of \c source
+ */
+static int write_file_atomically(char **error, const char *path, const char *source, size_t source_size)
+{
+    char *tmp_path;
+    size_t written_size = 0;
+    int fd;
+    fd = create_temporary_file(error, &tmp_path, path);
+    if (fd == -1) {
+        return -1;
     }
-    if (strcmp(result_format, "DVI") == 0) {
-        result_filename = sprintf_alloc("%s/texput.dvi", dir);
-    } else {
-        result_filename = sprintf_alloc("%s/texput.pdf", dir);
+    while (written_size < source_size) {
+        const ssize_t n = write(fd, source + written_size, source_size - written_size);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n == -1) {
+            *error = sprintf_alloc("Unable to write %lu bytes to file \"%s\": %s.",
+                                   (unsigned long)source_size, tmp_path, strerror(errno));
+            close(fd);
+            goto error_cleanup;
+        }
+        written_size += n;
     }
-    if (result_filename == NULL) {
-        goto cleanup;
+    if (close(fd) != 0) {
+        *error = sprintf_alloc("Unable to close file \"%s\" after writing: %s.",
+                               tmp_path, strerror(errno));
+        goto error_cleanup;
     }
-    /* create source file */
-    if (write_file(&error, source_filename, source, source_size) != 0) {
-        *info = error;
-        goto cleanup;
+    if (rename(tmp_path, path) != 0) {
+        *error = sprintf_alloc("Unable to rename file \"%s\" to \"%s\": %s.",
+                               tmp_path, path, strerror(errno));
+        goto error_cleanup;
     }
-    /* run command as often as necessary */
-    for (runs = 1; runs <= max_runs; runs++) {
-        pid_t pid;
-        pid = fork();
-        if (pid == -1) {
-            *info = sprintf_alloc("Unable to fork child process: %s.",
-                                  strerror(errno));
-            goto cleanup;
-        }
-        /* child process */
-        if (pid == 0) {
-            /* run command within the temporary directory */
-            if (chdir(dir) != 0) {
-                exit(1);
-            }
-            /* prevent access to stdin, stdout and stderr */
-            fclose(stdin);
-            fclose(stdout);
-            fclose(stderr);
-            /* execute command */
-            execlp(cmd,
-                   cmd,
-                   "-interaction=batchmode",
-                   "-halt-on-error",
-                   "-file-line-error",
-                   "-no-shell-escape",
-                   "texput.tex",
-                   NULL);
-        }
-        /* wait for child process */
-        for (;;) {
-            int status;
-            pid_t wpid = waitpid(pid, &status, 0);
-            if (wpid == -1) {
-                *info = sprintf_alloc("Unable to wait for child process: %s.",
-                                      strerror(errno));
-                goto cleanup;
-            }
-            if (WIFSIGNALED(status)) {
-                *info = sprintf_alloc("Command \"%s\" was terminated by signal %i.",
-                                      cmd, (int)WTERMSIG(status));
-                goto cleanup;
-            }
-            if (WIFEXITED(status) && WEXITSTATUS(status) != 0) {
-                *info = sprintf_alloc("Command \"%s\" terminated with exit status %i.",
-                                      cmd, (int)WEXITSTATUS(status));
-                goto cleanup;
-            }
-            if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
-                break;
-            }
-        }
-        /* read new aux file, saving old one */
-        free(aux_old);
-        aux_old      = aux;
-        aux_old_size = aux_size;
-        read_file(&aux, &aux_size, &error, aux_filename);
-        /* tolerate missing aux file */
-        free(error);
-        /* check whether aux file stabilized,
-           which is also true if there isn't and wasn't any aux file */
-        if (aux_size == aux_old_size && memcmp(aux, aux_old, aux_size) == 0) {
-            read_file(result, result_size, &error, result_filename);
-            if (*result == NULL) {
-                *info = error;
-                goto cleanup;
-            }
-            *info = sprintf_alloc("Generated %s (%lu bytes)"
-                                  " from %s (%lu bytes) after %i runs.",
-                                  result_format, (unsigned long)*result_size,
-                                  source_format, (unsigned long)source_size, runs);
-            goto cleanup;
+    free(tmp_path);
+    return 0;
+error_cleanup:
+    unlink(tmp_path);
+    free(tmp_path);
+    return -1;
+}
+
+/*! A growable buffer.
+ *
+ *  An empty buffer is initialized with all members set to \c NULL or 0.
+ */
+struct buffer {
+    char *data;
+    size_t size;
+    size_t capacity;
+};
+
+/*! Make room in a buffer for data to be appended,
+ *  such as for writing it in place.
+ *
+ *  \return
+ *      0 on success, -1 when out of memory
+ *
+ *  \param buffer
+ *      the buffer
+ *
+ *  \param size
+ *      size of the data, without a terminating \c '\\0'
+ */
+static int buffer_reserve(struct buffer *buffer, size_t size)
+{
+    if (buffer->size + size + 1 > buffer->capacity) {
+        size_t new_capacity = buffer->capacity == 0 ? 4096 : buffer->capacity;
+        char *new_data;
+        while (buffer->size + size + 1 > new_capacity) {
+            new_capacity *= 2;
         }
-    }
-    /* aux file didn't stabilize */
-    *info = sprintf_alloc("Output didn't stabilize after %i runs.",
-                          max_runs);
-    goto cleanup;
-    /* cleanup all used resources */
-cleanup:
-    if (log_filename != NULL) {
-        char *log;
-        size_t log_size;
-        read_file(&log, &log_size, &error, log_filename);
-        free(error);
-        if (log != NULL) {
-            if (*info == NULL) {
-                *info = log;
-            } else {
-                char *info_old = *info;
-                *info = sprintf_alloc("%s\n\n%s", info_old, log);
-                free(info_old);
-                free(log);
-            }
+        new_data = (char *)realloc(buffer->data, new_capacity);
+        if (new_data == NULL) {
+            return -1;
         }
+        buffer->data = new_data;
+        buffer->capacity = new_capacity;
     }
-    if (dir != NULL && remove_directory_recursively(&error, dir) != 0) {
-        free(*result);
-        *result = NULL;
-        *result_size = 0;
-        free(*info);
-        *info = error;
+    return 0;
+}
+
+/*! Append data to a buffer.
+ *
+ *  The buffer's data is always kept \c '\\0' terminated,
+ *  so it can be used as a string.
+ *
+ *  \return
+ *      0 on success, -1 when out of memory
+ *
+ *  \param buffer
+ *      the buffer to append to
+ *
+ *  \param data
+ *      data to append
+ *
+ *  \param size
+ *      size of \c data
+ */
+static int buffer_append(struct buffer *buffer, const char *data, size_t size)
+{
+    if (buffer_reserve(buffer, size) != 0) {
+        return -1;
     }
-    free(dir_template);
-    free(source_filename);
-    free(aux_filename);
-    free(log_filename);
-    free(result_filename);
-    free(aux);
-    free(aux_old);
+    memcpy(buffer->data + buffer->size, data, size);
+    buffer->size += size;
+    buffer->data[buffer->size] = '\0';
+    return 0;
 }
 
-/*! Escape a string for direct use in LaTeX.
+/*! A growable list of strings.
+ *
+ *  An empty list is initialized with all members set to \c NULL or 0.
  */
-char *texcaller_escape_latex(const char *s)
+struct string_list {
+    char **items;
+    size_t count;
+    size_t capacity;
+};
+
+/*! Check whether a string list contains a string.
+ *
+ *  \return
+ *      1 if \c list contains the string, 0 otherwise
+ *
+ *  \param list
+ *      the list to search
+ *
+ *  \param s
+ *      the string to search for, which doesn't need to be \c '\\0' terminated
+ *
+ *  \param length
+ *      length of \c s
+ */
+static int string_list_contains(const struct string_list *list, const char *s, size_t length)
 {
-    char *escaped_string;
     size_t i;
-    size_t length;
-    size_t pos;
-    /* calculate result length */
-    length = 0;
-    for (i = 0; s[i] != '\0'; i++) {
-        const char *escaped_char = escape_latex_char(s[i]);
-        if (escaped_char == NULL) {
-            length++;
-        } else {
-            length += strlen(escaped_char);
+    for (i = 0; i < list->count; i++) {
+        if (strlen(list->items[i]) == length && memcmp(list->items[i], s, length) == 0) {
+            return 1;
         }
     }
-    /* allocate memory for result */
-    escaped_string = (char *)malloc(length + 1);
-    if (escaped_string == NULL) {
-        return NULL;
-    }
-    /* calculate result */
-    pos = 0;
-    for (i = 0; s[i] != '\0'; i++) {
-        const char *escaped_char = escape_latex_char(s[i]);
-        if (escaped_char == NULL) {
-            escaped_string[pos++] = s[i];
-        } else {
-            const size_t length = strlen(escaped_char);
-            memcpy(escaped_string + pos, escaped_char, length);
-            pos += length;
-        }
+    return 0;
+}
+
+/*! Append a copy of a string to a string list, even if it is already contained.
+ *
+ *  \return
+ *      0 on success, -1 when out of memory
+ *
+ *  \param list
+ *      the list to append to
+ *
+ *  \param s
+ *      the string to append, which doesn't need to be \c '\\0' terminated
+ *
+ *  \param length
+ *      length of \c s
+ */
+static int string_list_append(struct string_list *list, const char *s, size_t length)
+{
+    char *item;
+    if (list->count == list->capacity) {
+        size_t new_capacity = list->capacity == 0 ? 16 : 2 * list->capacity;
+        char **new_items = (char **)realloc(list->items, new_capacity * sizeof(char *));
+        if (new_items == NULL) {
+            return -1;
+        }
+        list->items = new_items;
+        list->capacity = new_capacity;
+    }
+    item = (char *)malloc(length + 1);
+    if (item == NULL) {
+        return -1;
+    }
+    memcpy(item, s, length);
+    item[length] = '\0';
+    list->items[list->count++] = item;
+    return 0;
+}
+
+/*! Add a copy of a string to a string list, unless it is already contained.
+ *
+ *  \return
+ *      0 on success, -1 when out of memory
+ *
+ *  \param list
+ *      the list to add to
+ *
+ *  \param s
+ *      the string to add, which doesn't need to be \c '\\0' terminated
+ *
+ *  \param length
+ *      length of \c s
+ */
+static int string_list_add(struct string_list *list, const char *s, size_t length)
+{
+    if (string_list_contains(list, s, length)) {
+        return 0;
+    }
+    return string_list_append(list, s, length);
+}
+
+/*! Compare two strings for qsort().
+ */
+static int compare_strings(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/*! Sort a string list and remove all duplicates.
+ *
+ *  This is faster than string_list_add() for large lists.
+ *
+ *  \param list
+ *      the list to sort
+ */
+static void string_list_sort_unique(struct string_list *list)
+{
+    size_t i;
+    size_t count = 0;
+    if (list->count == 0) {
+        return;
+    }
+    qsort(list->items, list->count, sizeof(char *), compare_strings);
+    for (i = 0; i < list->count; i++) {
+        if (count > 0 && strcmp(list->items[count - 1], list->items[i]) == 0) {
+            free(list->items[i]);
+        } else {
+            list->items[count++] = list->items[i];
+        }
+    }
+    list->count = count;
+}
+
+/*! Free all strings of a string list, as well as the list itself.
+ *
+ *  \param list
+ *      the list to free, which will be empty afterwards
+ */
+static void string_list_free(struct string_list *list)
+{
+    size_t i;
+    for (i = 0; i < list->count; i++) {
+        free(list->items[i]);
+    }
+    free(list->items);
+    list->items = NULL;
+    list->count = 0;
+    list->capacity = 0;
+}
+
+/*! Check whether a string ends with a given suffix.
+ *
+ *  \return
+ *      1 if \c s ends with \c suffix, 0 otherwise
+ */
+static int has_suffix(const char *s, size_t length, const char *suffix)
+{
+    const size_t suffix_length = strlen(suffix);
+    return length >= suffix_length && memcmp(s + length - suffix_length, suffix, suffix_length) == 0;
+}
+
+/*! Initial value of a hash as used by hash_update().
+ *
+ *  The hash consists of two independent 32 bit hashes,
+ *  FNV-1a and FNV-1,
+ *  which are combined to a 64 bit cache key.
+ *  It is fast, but not collision resistant,
+ *  so content-addressed cache entries use a \ref digest instead.
+ */
+#define HASH_INIT { 2166136261UL, 2166136261UL }
+
+/*! Feed data into a hash.
+ *
+ *  \param hash
+ *      the hash to update, initialized with \ref HASH_INIT
+ *
+ *  \param data
+ *      data to feed into the hash
+ *
+ *  \param size
+ *      size of \c data
+ */
+static void hash_update(unsigned long hash[2], const char *data, size_t size)
+{
+    size_t i;
+    for (i = 0; i < size; i++) {
+        hash[0] = ((hash[0] ^ (unsigned char)data[i]) * 16777619UL) & 0xffffffffUL;
+        hash[1] = ((hash[1] * 16777619UL) & 0xffffffffUL) ^ (unsigned char)data[i];
+    }
+}
+
+/*! Format a hash as cache key.
+ *
+ *  \return
+ *      a newly allocated string of 16 hex digits,
+ *      or \c NULL when out of memory.
+ */
+static char *hash_key(const unsigned long hash[2])
+{
+    return sprintf_alloc("%08lx%08lx", hash[0], hash[1]);
+}
+
+/*! State of a SHA-256 digest as used by digest_update().
+ *
+ *  Unlike the hash of hash_update(),
+ *  this digest is collision resistant.
+ *  It is used for content-addressed cache entries,
+ *  where a collision would make one document
+ *  silently use the content of another one.
+ *
+ *  All members hold 32 bit words in an <tt>unsigned long</tt>,
+ *  to stay within ANSI C.
+ */
+struct digest {
+    unsigned long state[8];
+    unsigned long count[2];
+    unsigned char block[64];
+};
+
+/*! SHA-256 round constants. */
+static const unsigned long digest_constants[64] = {
+    0x428a2f98UL, 0x71374491UL, 0xb5c0fbcfUL, 0xe9b5dba5UL, 0x3956c25bUL, 0x59f111f1UL, 0x923f82a4UL, 0xab1c5ed5UL,
+    0xd807aa98UL, 0x12835b01UL, 0x243185beUL, 0x550c7dc3UL, 0x72be5d74UL, 0x80deb1feUL, 0x9bdc06a7UL, 0xc19bf174UL,
+    0xe49b69c1UL, 0xefbe4786UL, 0x0fc19dc6UL, 0x240ca1ccUL, 0x2de92c6fUL, 0x4a7484aaUL, 0x5cb0a9dcUL, 0x76f988daUL,
+    0x983e5152UL, 0xa831c66dUL, 0xb00327c8UL, 0xbf597fc7UL, 0xc6e00bf3UL, 0xd5a79147UL, 0x06ca6351UL, 0x14292967UL,
+    0x27b70a85UL, 0x2e1b2138UL, 0x4d2c6dfcUL, 0x53380d13UL, 0x650a7354UL, 0x766a0abbUL, 0x81c2c92eUL, 0x92722c85UL,
+    0xa2bfe8a1UL, 0xa81a664bUL, 0xc24b8b70UL, 0xc76c51a3UL, 0xd192e819UL, 0xd6990624UL, 0xf40e3585UL, 0x106aa070UL,
+    0x19a4c116UL, 0x1e376c08UL, 0x2748774cUL, 0x34b0bcb5UL, 0x391c0cb3UL, 0x4ed8aa4aUL, 0x5b9cca4fUL, 0x682e6ff3UL,
+    0x748f82eeUL, 0x78a5636fUL, 0x84c87814UL, 0x8cc70208UL, 0x90befffaUL, 0xa4506cebUL, 0xbef9a3f7UL, 0xc67178f2UL
+};
+
+/*! Rotate a 32 bit word to the right. */
+#define DIGEST_ROTATE(x, n) ((((x) >> (n)) | ((x) << (32 - (n)))) & 0xffffffffUL)
+
+/*! Initialize a digest.
+ *
+ *  \param digest
+ *      the digest to initialize
+ */
+static void digest_init(struct digest *digest)
+{
+    static const unsigned long initial_state[8] = {
+        0x6a09e667UL, 0xbb67ae85UL, 0x3c6ef372UL, 0xa54ff53aUL,
+        0x510e527fUL, 0x9b05688cUL, 0x1f83d9abUL, 0x5be0cd19UL
+    };
+    memcpy(digest->state, initial_state, sizeof(initial_state));
+    digest->count[0] = 0;
+    digest->count[1] = 0;
+}
+
+/*! Process the current block of a digest.
+ *
+ *  \param digest
+ *      the digest, whose \c block is complete
+ */
+static void digest_process_block(struct digest *digest)
+{
+    unsigned long w[64];
+    unsigned long s[8];
+    int i;
+    for (i = 0; i < 16; i++) {
+        w[i] = ((unsigned long)digest->block[i * 4] << 24)
+             | ((unsigned long)digest->block[i * 4 + 1] << 16)
+             | ((unsigned long)digest->block[i * 4 + 2] << 8)
+             | (unsigned long)digest->block[i * 4 + 3];
+    }
+    for (i = 16; i < 64; i++) {
+        const unsigned long s0 = DIGEST_ROTATE(w[i - 15], 7) ^ DIGEST_ROTATE(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        const unsigned long s1 = DIGEST_ROTATE(w[i - 2], 17) ^ DIGEST_ROTATE(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = (w[i - 16] + s0 + w[i - 7] + s1) & 0xffffffffUL;
+    }
+    memcpy(s, digest->state, sizeof(s));
+    for (i = 0; i < 64; i++) {
+        const unsigned long sum1 = DIGEST_ROTATE(s[4], 6) ^ DIGEST_ROTATE(s[4], 11) ^ DIGEST_ROTATE(s[4], 25);
+        const unsigned long choice = (s[4] & s[5]) ^ (~s[4] & s[6]);
+        const unsigned long t1 = (s[7] + sum1 + choice + digest_constants[i] + w[i]) & 0xffffffffUL;
+        const unsigned long sum0 = DIGEST_ROTATE(s[0], 2) ^ DIGEST_ROTATE(s[0], 13) ^ DIGEST_ROTATE(s[0], 22);
+        const unsigned long majority = (s[0] & s[1]) ^ (s[0] & s[2]) ^ (s[1] & s[2]);
+        const unsigned long t2 = (sum0 + majority) & 0xffffffffUL;
+        s[7] = s[6];
+        s[6] = s[5];
+        s[5] = s[4];
+        s[4] = (s[3] + t1) & 0xffffffffUL;
+        s[3] = s[2];
+        s[2] = s[1];
+        s[1] = s[0];
+        s[0] = (t1 + t2) & 0xffffffffUL;
+    }
+    for (i = 0; i < 8; i++) {
+        digest->state[i] = (digest->state[i] + s[i]) & 0xffffffffUL;
+    }
+}
+
+/*! Feed data into a digest.
+ *
+ *  \param digest
+ *      the digest to update, initialized with digest_init()
+ *
+ *  \param data
+ *      data to feed into the digest
+ *
+ *  \param size
+ *      size of \c data
+ */
+static void digest_update(struct digest *digest, const char *data, size_t size)
+{
+    size_t used = digest->count[0] & 63;
+    const unsigned long low = (digest->count[0] + (unsigned long)(size & 0xffffffffUL)) & 0xffffffffUL;
+    /* count bytes as a 64 bit number, split into two words */
+    digest->count[1] = (digest->count[1] + (unsigned long)(size >> 16 >> 16) + (low < digest->count[0])) & 0xffffffffUL;
+    digest->count[0] = low;
+    while (size > 0) {
+        const size_t n = size < 64 - used ? size : 64 - used;
+        memcpy(digest->block + used, data, n);
+        data += n;
+        size -= n;
+        used += n;
+        if (used == 64) {
+            digest_process_block(digest);
+            used = 0;
+        }
+    }
+}
+
+/*! Finish a digest.
+ *
+ *  The digest must not be updated afterwards.
+ *
+ *  \param digest
+ *      the digest
+ *
+ *  \param result
+ *      will be set to the 32 bytes of the digest
+ */
+static void digest_final(struct digest *digest, unsigned char result[32])
+{
+    static const char padding[64] = { '\200' };
+    unsigned char length[8];
+    int i;
+    /* message length in bits, big endian */
+    for (i = 0; i < 4; i++) {
+        length[i] = (unsigned char)(((digest->count[1] << 3) | (digest->count[0] >> 29)) >> (24 - i * 8));
+        length[i + 4] = (unsigned char)((digest->count[0] << 3) >> (24 - i * 8));
+    }
+    digest_update(digest, padding, 1 + ((119 - (digest->count[0] & 63)) & 63));
+    digest_update(digest, (const char *)length, 8);
+    for (i = 0; i < 32; i++) {
+        result[i] = (unsigned char)(digest->state[i / 4] >> (24 - (i % 4) * 8));
+    }
+}
+
+/*! Finish a digest and format it as cache key.
+ *
+ *  The digest must not be updated afterwards.
+ *
+ *  \return
+ *      a newly allocated string of 64 hex digits,
+ *      or \c NULL when out of memory.
+ */
+static char *digest_key(struct digest *digest)
+{
+    unsigned char result[32];
+    char *key;
+    int i;
+    digest_final(digest, result);
+    key = (char *)malloc(65);
+    if (key == NULL) {
+        return NULL;
+    }
+    for (i = 0; i < 32; i++) {
+        sprintf(key + i * 2, "%02x", (unsigned int)result[i]);
+    }
+    return key;
+}
+
+/*! Determine the cache directory.
+ *
+ *  The cache directory is set via the \c TEXCALLER_CACHE_DIR
+ *  environment variable.
+ *  It must exist and be writable.
+ *
+ *  \return
+ *      the cache directory (not to be freed),
+ *      or \c NULL if caching is disabled.
+ */
+static const char *cache_directory(void)
+{
+    const char *cache_dir = getenv("TEXCALLER_CACHE_DIR");
+    if (cache_dir == NULL || strcmp(cache_dir, "") == 0) {
+        return NULL;
+    }
+    return cache_dir;
+}
+
+/*! Determine the size of the preamble of a source.
+ *
+ *  For LaTeX sources, the preamble is everything before
+ *  <tt>\\begin{document}</tt>.
+ *  Plain TeX sources don't have a preamble,
+ *  so the complete source is taken instead.
+ *
+ *  \return
+ *      the size of the preamble
+ */
+static size_t preamble_size(const char *source, size_t source_size, const char *source_format)
+{
+    const char begin_document[] = "\\begin{document}";
+    const size_t begin_document_length = sizeof(begin_document) - 1;
+    size_t i;
+    if (strcmp(source_format, "LaTeX") != 0) {
+        return source_size;
+    }
+    for (i = 0; i + begin_document_length <= source_size; i++) {
+        if (memcmp(source + i, begin_document, begin_document_length) == 0) {
+            return i;
+        }
+    }
+    return source_size;
+}
+
+/*! Collect the fonts and font map files read by a TeX run.
+ *
+ *  The information is taken from the \c texput.fls file
+ *  which TeX writes when run with the \c -recorder option.
+ *
+ *  \return
+ *      0 on success, -1 on failure
+ *
+ *  \param fonts
+ *      list to which the names of all used TFM fonts are added
+ *
+ *  \param maps
+ *      list to which the paths of all read font map files are added,
+ *      except for those within \c dir
+ *
+ *  \param dir
+ *      the directory TeX was run in
+ */
+static int read_recorded_fonts(struct string_list *fonts, struct string_list *maps, const char *dir)
+{
+    char *error;
+    char *fls_filename;
+    char *fls;
+    size_t fls_size;
+    char *line;
+    fls_filename = sprintf_alloc("%s/texput.fls", dir);
+    if (fls_filename == NULL) {
+        return -1;
+    }
+    read_file(&fls, &fls_size, &error, fls_filename);
+    free(fls_filename);
+    free(error);
+    if (fls == NULL) {
+        return -1;
+    }
+    for (line = fls; *line != '\0'; ) {
+        char *line_end = strchr(line, '\n');
+        size_t length = line_end == NULL ? strlen(line) : (size_t)(line_end - line);
+        if (length > 6 && memcmp(line, "INPUT ", 6) == 0) {
+            const char *path = line + 6;
+            const size_t path_length = length - 6;
+            if (has_suffix(path, path_length, ".tfm")) {
+                const char *name = path;
+                size_t i;
+                for (i = 0; i < path_length; i++) {
+                    if (path[i] == '/') {
+                        name = path + i + 1;
+                    }
+                }
+                if (string_list_add(fonts, name, path + path_length - 4 - name) != 0) {
+                    free(fls);
+                    return -1;
+                }
+            } else if (has_suffix(path, path_length, ".map") && path[0] == '/') {
+                if (string_list_add(maps, path, path_length) != 0) {
+                    free(fls);
+                    return -1;
+                }
+            }
+        }
+        line += length;
+        if (*line == '\n') {
+            line++;
+        }
+    }
+    free(fls);
+    return 0;
+}
+
+/*! Marker for fonts that are used but have no font map entry.
+ *
+ *  Such fonts are recorded in trimmed font maps as comments,
+ *  so they don't count as missing.
+ */
+#define FONTMAP_UNMAPPED "% texcaller-unmapped "
+
+/*! Collect the names of all fonts covered by a trimmed font map.
+ *
+ *  \return
+ *      0 on success, -1 when out of memory
+ *
+ *  \param names
+ *      list to which the font names are added
+ *
+ *  \param map
+ *      content of the font map file
+ */
+static int fontmap_names(struct string_list *names, const char *map)
+{
+    const size_t unmapped_length = strlen(FONTMAP_UNMAPPED);
+    const char *line;
+    for (line = map; *line != '\0'; ) {
+        const char *line_end = strchr(line, '\n');
+        const size_t length = line_end == NULL ? strlen(line) : (size_t)(line_end - line);
+        const char *name = NULL;
+        size_t name_length = 0;
+        if (length > unmapped_length && memcmp(line, FONTMAP_UNMAPPED, unmapped_length) == 0) {
+            name = line + unmapped_length;
+            name_length = length - unmapped_length;
+        } else if (length > 0 && strchr("%#*; \t\r", line[0]) == NULL) {
+            name = line;
+            while (name_length < length && strchr(" \t\r", name[name_length]) == NULL) {
+                name_length++;
+            }
+        }
+        if (name != NULL && string_list_add(names, name, name_length) != 0) {
+            return -1;
+        }
+        line += length;
+        if (*line == '\n') {
+            line++;
+        }
+    }
+    return 0;
+}
+
+/*! Generate a trimmed font map.
+ *
+ *  The trimmed font map contains only those entries of the full font maps
+ *  that refer to the given fonts.
+ *  Fonts which have no entry are recorded as such via \ref FONTMAP_UNMAPPED.
+ *
+ *  \return
+ *      a newly allocated string containing the trimmed font map,
+ *      or \c NULL on failure.
+ *
+ *  \param fonts
+ *      names of the fonts to keep
+ *
+ *  \param maps
+ *      paths of the full font map files
+ */
+static char *fontmap_generate(const struct string_list *fonts, const struct string_list *maps)
+{
+    struct buffer trimmed = { NULL, 0, 0 };
+    struct string_list mapped = { NULL, 0, 0 };
+    size_t i;
+    if (buffer_append(&trimmed, "% Generated by texcaller.\n", 26) != 0) {
+        goto error_cleanup;
+    }
+    for (i = 0; i < maps->count; i++) {
+        char *error;
+        char *map;
+        size_t map_size;
+        const char *line;
+        read_file(&map, &map_size, &error, maps->items[i]);
+        free(error);
+        if (map == NULL) {
+            goto error_cleanup;
+        }
+        for (line = map; *line != '\0'; ) {
+            const char *line_end = strchr(line, '\n');
+            const size_t length = line_end == NULL ? strlen(line) : (size_t)(line_end - line);
+            size_t name_length = 0;
+            while (name_length < length && strchr(" \t\r", line[name_length]) == NULL) {
+                name_length++;
+            }
+            if (   name_length > 0
+                && strchr("%#*;", line[0]) == NULL
+                && string_list_contains(fonts, line, name_length)) {
+                if (   buffer_append(&trimmed, line, length) != 0
+                    || buffer_append(&trimmed, "\n", 1) != 0
+                    || string_list_add(&mapped, line, name_length) != 0) {
+                    free(map);
+                    goto error_cleanup;
+                }
+            }
+            line += length;
+            if (*line == '\n') {
+                line++;
+            }
+        }
+        free(map);
+    }
+    for (i = 0; i < fonts->count; i++) {
+        const char *name = fonts->items[i];
+        if (string_list_contains(&mapped, name, strlen(name))) {
+            continue;
+        }
+        if (   buffer_append(&trimmed, FONTMAP_UNMAPPED, strlen(FONTMAP_UNMAPPED)) != 0
+            || buffer_append(&trimmed, name, strlen(name)) != 0
+            || buffer_append(&trimmed, "\n", 1) != 0) {
+            goto error_cleanup;
+        }
+    }
+    string_list_free(&mapped);
+    return trimmed.data;
+error_cleanup:
+    string_list_free(&mapped);
+    free(trimmed.data);
+    return NULL;
+}
+
+/*! Return the current wall-clock time in seconds.
+ */
+static double current_time(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+#ifndef IOPRIO_WHO_PROCESS
+/*! Argument of ioprio_set() to set the I/O priority of a process,
+ *  as defined by \c linux/ioprio.h.
+ */
+#define IOPRIO_WHO_PROCESS 1
+#endif
+
+#ifndef IOPRIO_CLASS_SHIFT
+/*! Position of the I/O scheduling class within an I/O priority,
+ *  as defined by \c linux/ioprio.h.
+ */
+#define IOPRIO_CLASS_SHIFT 13
+#endif
+
+#ifndef IOPRIO_CLASS_BE
+/*! Best-effort I/O scheduling class, as defined by \c linux/ioprio.h.
+ */
+#define IOPRIO_CLASS_BE 2
+#endif
+
+#ifndef IOPRIO_CLASS_IDLE
+/*! Idle I/O scheduling class, as defined by \c linux/ioprio.h.
+ */
+#define IOPRIO_CLASS_IDLE 3
+#endif
+
+/*! Priority of child processes, see texcaller_priority.
+ */
+struct child_priority {
+    /*! niceness to add */
+    int nice;
+    /*! I/O priority for ioprio_set(), or -1 to inherit it */
+    int ioprio;
+    /*! scheduling policy for sched_setscheduler(), or -1 to inherit it */
+    int policy;
+};
+
+/*! Check a priority and convert it for child processes.
+ *
+ *  \return
+ *      0 on success, -1 on failure
+ *
+ *  \param info
+ *      On failure, \c info will be set to a newly allocated string
+ *      that contains the error message.
+ *      On success, or when out of memory,
+ *      \c info will be set to \c NULL.
+ *
+ *  \param child
+ *      will be set to the priority of child processes
+ *
+ *  \param priority
+ *      the priority, or \c NULL to inherit it
+ *
+ *  \param stats
+ *      statistics to set the applied priority in, or \c NULL
+ */
+static int parse_priority(char **info, struct child_priority *child, const texcaller_priority *priority, texcaller_stats *stats)
+{
+    const char *io_class = NULL;
+    const char *cpu_policy = NULL;
+    int io_level = -1;
+    *info = NULL;
+    child->nice = 0;
+    child->ioprio = -1;
+    child->policy = -1;
+    if (priority != NULL) {
+        if (priority->nice < 0 || priority->nice > 19) {
+            *info = sprintf_alloc("Niceness is %i, but must be between 0 and 19.", priority->nice);
+            return -1;
+        }
+        child->nice = priority->nice;
+#ifndef __linux__
+        if (priority->io_class != NULL) {
+            *info = sprintf_alloc("I/O scheduling class \"%s\" is only supported on Linux.",
+                                  priority->io_class);
+            return -1;
+        }
+#endif
+        if (priority->io_class == NULL) {
+            /* inherit the I/O priority */
+        } else if (strcmp(priority->io_class, "best-effort") == 0) {
+            if (priority->io_level < 0 || priority->io_level > 7) {
+                *info = sprintf_alloc("I/O priority level is %i, but must be between 0 and 7.",
+                                      priority->io_level);
+                return -1;
+            }
+            io_class = "best-effort";
+            io_level = priority->io_level;
+            child->ioprio = (IOPRIO_CLASS_BE << IOPRIO_CLASS_SHIFT) | io_level;
+        } else if (strcmp(priority->io_class, "idle") == 0) {
+            io_class = "idle";
+            child->ioprio = IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT;
+        } else {
+            *info = sprintf_alloc("Unknown I/O scheduling class \"%s\".", priority->io_class);
+            return -1;
+        }
+        if (priority->cpu_policy == NULL) {
+            /* inherit the scheduling policy */
+        } else if (strcmp(priority->cpu_policy, "batch") == 0) {
+            cpu_policy = "batch";
+            child->policy = SCHED_BATCH;
+        } else if (strcmp(priority->cpu_policy, "idle") == 0) {
+            cpu_policy = "idle";
+            child->policy = SCHED_IDLE;
+        } else {
+            *info = sprintf_alloc("Unknown CPU scheduling policy \"%s\".", priority->cpu_policy);
+            return -1;
+        }
+    }
+    if (stats != NULL) {
+        stats->nice = child->nice;
+        stats->io_class = io_class;
+        stats->io_level = io_level;
+        stats->cpu_policy = cpu_policy;
+    }
+    return 0;
+}
+
+/*! Set the priority of the calling process, within a child process.
+ *
+ *  Failures are ignored, as the host may not permit this,
+ *  such as within a container that blocks ioprio_set().
+ *
+ *  \param priority
+ *      the priority
+ */
+static void set_priority(const struct child_priority *priority)
+{
+    if (priority->nice > 0) {
+        setpriority(PRIO_PROCESS, 0, getpriority(PRIO_PROCESS, 0) + priority->nice);
+    }
+#if defined(__linux__) && defined(SYS_ioprio_set)
+    if (priority->ioprio != -1) {
+        syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, priority->ioprio);
+    }
+#endif
+    if (priority->policy != -1) {
+        struct sched_param param;
+        param.sched_priority = 0;
+        sched_setscheduler(0, priority->policy, &param);
+    }
+}
+
+/*! Start a command in a child process.
+ *
+ *  The command is run within the given directory
+ *  and is disconnected from stdin, stdout and stderr.
+ *
+ *  \return
+ *      the process ID of the child process, or -1 on failure
+ *
+ *  \param info
+ *      On failure, \c info will be set to a newly allocated string
+ *      that contains the error message.
+ *      On success, or when out of memory,
+ *      \c info will be set to \c NULL.
+ *
+ *  \param dir
+ *      the directory to run the command in
+ *
+ *  \param args
+ *      the command and its arguments, terminated by \c NULL
+ *
+ *  \param stdout_filename
+ *      name of the file within \c dir that receives
+ *      the standard output of the command,
+ *      or \c NULL to disconnect standard output as well
+ *
+ *  \param priority
+ *      the priority of the child processes, or \c NULL to inherit it
+ */
+static pid_t spawn_command(char **info, const char *dir, const char *const *args, const char *stdout_filename, const struct child_priority *priority)
+{
+    pid_t pid;
+    *info = NULL;
+    pid = fork();
+    if (pid == -1) {
+        *info = sprintf_alloc("Unable to fork child process: %s.",
+                              strerror(errno));
+        return -1;
+    }
+    /* child process */
+    if (pid == 0) {
+        /* run command within the directory,
+           using _exit() to not flush the parent's stdio buffers */
+        if (chdir(dir) != 0) {
+            _exit(1);
+        }
+        /* prevent access to stdin, stdout and stderr */
+        close(0);
+        close(1);
+        close(2);
+        /* redirect stdout if requested */
+        if (stdout_filename != NULL) {
+            int fd = open(stdout_filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+            if (fd == -1 || (fd != 1 && dup2(fd, 1) == -1)) {
+                _exit(1);
+            }
+            if (fd != 1) {
+                close(fd);
+            }
+        }
+        if (priority != NULL) {
+            set_priority(priority);
+        }
+        /* execute command */
+        execvp(args[0], (char *const *)args);
+        _exit(1);
+    }
+    return pid;
+}
+
+/*! Initialize the statistics of a conversion before any TeX run.
+ *
+ *  \param stats
+ *      the statistics
+ */
+static void init_stats(texcaller_stats *stats)
+{
+    stats->runs = 0;
+    stats->run_time = 0;
+    stats->cpu_time = 0;
+    stats->max_rss = 0;
+    stats->truncated = 0;
+    stats->nice = 0;
+    stats->io_class = NULL;
+    stats->io_level = -1;
+    stats->cpu_policy = NULL;
+}
+
+/*! Wait for a command started by spawn_command() to terminate.
+ *
+ *  \return
+ *      0 if the command terminated successfully, -1 otherwise
+ *
+ *  \param info
+ *      On failure, \c info will be set to a newly allocated string
+ *      that contains the error message.
+ *      On success, or when out of memory,
+ *      \c info will be set to \c NULL.
+ *
+ *  \param pid
+ *      the process ID of the command
+ *
+ *  \param cmd
+ *      the name of the command, for error messages
+ *
+ *  \param start_time
+ *      the time the command was started, see current_time()
+ *
+ *  \param stats
+ *      statistics to update with the run time and memory usage
+ *      of the command, or \c NULL
+ */
+static int wait_command(char **info, pid_t pid, const char *cmd, double start_time, texcaller_stats *stats)
+{
+    *info = NULL;
+    for (;;) {
+        int status;
+        struct rusage usage;
+        pid_t wpid = wait4(pid, &status, 0, &usage);
+        if (wpid == -1) {
+            *info = sprintf_alloc("Unable to wait for child process: %s.",
+                                  strerror(errno));
+            return -1;
+        }
+        if (stats != NULL) {
+            stats->run_time += current_time() - start_time;
+            stats->cpu_time += usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6
+                             + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+            if (usage.ru_maxrss > stats->max_rss) {
+                stats->max_rss = usage.ru_maxrss;
+            }
+        }
+        if (WIFSIGNALED(status)) {
+            *info = sprintf_alloc("Command \"%s\" was terminated by signal %i.",
+                                  cmd, (int)WTERMSIG(status));
+            return -1;
+        }
+        if (WIFEXITED(status) && WEXITSTATUS(status) != 0) {
+            *info = sprintf_alloc("Command \"%s\" terminated with exit status %i.",
+                                  cmd, (int)WEXITSTATUS(status));
+            return -1;
+        }
+        if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+            return 0;
+        }
+    }
+}
+
+/*! Run a command and wait for it to terminate.
+ *
+ *  See spawn_command() and wait_command() for the parameters.
+ *
+ *  \return
+ *      0 if the command terminated successfully, -1 otherwise
+ */
+static int run_command(char **info, const char *dir, const char *const *args, const char *stdout_filename, const struct child_priority *priority, texcaller_stats *stats)
+{
+    const double start_time = current_time();
+    const pid_t pid = spawn_command(info, dir, args, stdout_filename, priority);
+    if (pid == -1) {
+        return -1;
+    }
+    return wait_command(info, pid, args[0], start_time, stats);
+}
+
+/*! Determine the number of CPUs.
+ *
+ *  \return
+ *      the number of online CPUs, at least 1
+ */
+static int cpu_count(void)
+{
+    const long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int)count : 1;
+}
+
+/*! Maximum number of NUMA nodes to consider.
+ */
+#define MAX_NUMA_NODES 64
+
+/*! A NUMA node of the host.
+ */
+struct numa_node {
+    /*! ID of the node, or -1 if the host has no NUMA information */
+    int id;
+#ifdef __linux__
+    /*! CPUs of the node that the process may run on */
+    cpu_set_t cpus;
+#endif
+};
+
+#ifdef __linux__
+/*! Parse a list of CPUs as found in sysfs, such as \c "0-3,8-11".
+ *
+ *  \param cpus
+ *      will be set to the CPUs of the list
+ *
+ *  \param list
+ *      the list
+ */
+static void parse_cpu_list(cpu_set_t *cpus, const char *list)
+{
+    CPU_ZERO(cpus);
+    for (;;) {
+        char *end;
+        long first = strtol(list, &end, 10);
+        long last = first;
+        if (end == list) {
+            break;
+        }
+        if (*end == '-') {
+            list = end + 1;
+            last = strtol(list, &end, 10);
+            if (end == list) {
+                break;
+            }
+        }
+        for (; first <= last && first < CPU_SETSIZE; first++) {
+            CPU_SET(first, cpus);
+        }
+        if (*end != ',') {
+            break;
+        }
+        list = end + 1;
+    }
+}
+
+/*! Read the NUMA nodes of the host from sysfs, sorted by ID.
+ *
+ *  Only CPUs the process may run on are included,
+ *  and nodes without such CPUs are left out.
+ *  Without NUMA information, all these CPUs form a single node
+ *  with ID -1.
+ *
+ *  \return
+ *      the number of nodes, at least 1
+ *
+ *  \param nodes
+ *      array of \c MAX_NUMA_NODES nodes to fill
+ */
+static int read_numa_nodes(struct numa_node *nodes)
+{
+    cpu_set_t allowed;
+    DIR *dir;
+    int count = 0;
+    int i;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        CPU_ZERO(&allowed);
+        for (i = 0; i < cpu_count() && i < CPU_SETSIZE; i++) {
+            CPU_SET(i, &allowed);
+        }
+    }
+    dir = opendir("/sys/devices/system/node");
+    if (dir != NULL) {
+        struct dirent *entry;
+        while (count < MAX_NUMA_NODES && (entry = readdir(dir)) != NULL) {
+            char list[4096];
+            char *path;
+            FILE *file;
+            int id;
+            if (sscanf(entry->d_name, "node%d", &id) != 1) {
+                continue;
+            }
+            path = sprintf_alloc("/sys/devices/system/node/%s/cpulist", entry->d_name);
+            file = path == NULL ? NULL : fopen(path, "r");
+            free(path);
+            if (file == NULL) {
+                continue;
+            }
+            if (fgets(list, sizeof(list), file) != NULL) {
+                parse_cpu_list(&nodes[count].cpus, list);
+                CPU_AND(&nodes[count].cpus, &nodes[count].cpus, &allowed);
+                if (CPU_COUNT(&nodes[count].cpus) > 0) {
+                    nodes[count].id = id;
+                    count++;
+                }
+            }
+            fclose(file);
+        }
+        closedir(dir);
+    }
+    if (count == 0) {
+        nodes[0].id = -1;
+        nodes[0].cpus = allowed;
+        return 1;
+    }
+    /* sort by ID, as readdir() returns the nodes in any order */
+    for (i = 1; i < count; i++) {
+        struct numa_node node = nodes[i];
+        int j;
+        for (j = i; j > 0 && nodes[j - 1].id > node.id; j--) {
+            nodes[j] = nodes[j - 1];
+        }
+        nodes[j] = node;
+    }
+    return count;
+}
+
+#ifndef MPOL_PREFERRED
+/*! Memory policy of set_mempolicy() that prefers the given node,
+ *  as defined by \c linux/mempolicy.h.
+ */
+#define MPOL_PREFERRED 1
+#endif
+
+/*! Pin the calling thread to CPUs and prefer memory of a NUMA node.
+ *
+ *  Child processes inherit both,
+ *  and so do the memory pages the thread touches first.
+ *  Failures are ignored, as the host may not permit this.
+ *
+ *  \param cpus
+ *      the CPUs to run on
+ *
+ *  \param node
+ *      ID of the NUMA node to prefer, or -1
+ */
+static void pin_thread(const cpu_set_t *cpus, int node)
+{
+    sched_setaffinity(0, sizeof(cpu_set_t), cpus);
+#ifdef SYS_set_mempolicy
+    if (node >= 0 && node < MAX_NUMA_NODES) {
+        unsigned long mask[MAX_NUMA_NODES / (8 * sizeof(unsigned long)) + 1];
+        const size_t bits = 8 * sizeof(unsigned long);
+        memset(mask, 0, sizeof(mask));
+        mask[node / bits] |= 1UL << (node % bits);
+        /* the kernel reads one bit less than the given number */
+        syscall(SYS_set_mempolicy, MPOL_PREFERRED, mask, 8 * sizeof(mask) + 1);
+    }
+#else
+    (void)node;
+#endif
+}
+#endif
+
+/*! Run several commands in parallel and wait for all of them to terminate.
+ *
+ *  At most \c processes commands run at the same time.
+ *  Child processes are waited for in the order they were started,
+ *  so that no unrelated child processes of the caller are reaped.
+ *
+ *  \return
+ *      0 if all commands terminated successfully, -1 otherwise
+ *
+ *  \param info
+ *      On failure, \c info will be set to a newly allocated string
+ *      that contains the error message of the first failed command.
+ *      On success, or when out of memory,
+ *      \c info will be set to \c NULL.
+ *
+ *  \param dir
+ *      the directory to run the commands in
+ *
+ *  \param commands
+ *      \c count commands,
+ *      each consisting of up to \c stride arguments terminated by \c NULL,
+ *      so command \c i starts at <tt>commands + i * stride</tt>
+ *
+ *  \param stride
+ *      distance between two commands within \c commands
+ *
+ *  \param count
+ *      number of commands
+ *
+ *  \param processes
+ *      maximum number of commands to run at the same time
+ *
+ *  \param priority
+ *      the priority of the child processes, or \c NULL to inherit it
+ */
+static int run_commands_parallel(char **info, const char *dir, const char *const *commands, size_t stride, size_t count, int processes, const struct child_priority *priority)
+{
+    pid_t *pids;
+    size_t started = 0;
+    size_t finished = 0;
+    int status = 0;
+    *info = NULL;
+    if (count == 0) {
+        return 0;
+    }
+    pids = (pid_t *)malloc(count * sizeof(pid_t));
+    if (pids == NULL) {
+        return -1;
+    }
+    while (finished < count) {
+        char *error;
+        /* start commands while there are free slots, unless failed */
+        while (status == 0 && started < count && started - finished < (size_t)processes) {
+            pids[started] = spawn_command(&error, dir, commands + started * stride, NULL, priority);
+            if (pids[started] == -1) {
+                *info = error;
+                status = -1;
+                break;
+            }
+            started++;
+        }
+        if (finished == started) {
+            break;
+        }
+        /* wait for oldest command */
+        if (wait_command(&error, pids[finished], commands[finished * stride], current_time(), NULL) != 0) {
+            if (status == 0) {
+                *info = error;
+                status = -1;
+            } else {
+                free(error);
+            }
+        }
+        finished++;
+    }
+    free(pids);
+    return status;
+}
+
+/*! Create a new temporary directory.
+ *
+ *  The directory is created within \c TMPDIR, or \c /tmp if not set.
+ *
+ *  \return
+ *      a newly allocated string containing the path of the directory,
+ *      or \c NULL on failure.
+ *
+ *  \param info
+ *      On failure, \c info will be set to a newly allocated string
+ *      that contains the error message.
+ *      On success, or when out of memory,
+ *      \c info will be set to \c NULL.
+ */
+static char *create_temporary_directory(char **info)
+{
+    const char *tmpdir;
+    char *dir_template;
+    *info = NULL;
+    tmpdir = getenv("TMPDIR");
+    if (tmpdir == NULL || strcmp(tmpdir, "") == 0) {
+        tmpdir = "/tmp";
+    }
+    dir_template = sprintf_alloc("%s/texcaller-temp-XXXXXX", tmpdir);
+    if (dir_template == NULL) {
+        return NULL;
+    }
+    if (mkdtemp(dir_template) == NULL) {
+        *info = sprintf_alloc("Unable to create temporary directory from template \"%s\": %s.",
+                              dir_template, strerror(errno));
+        free(dir_template);
+        return NULL;
+    }
+    return dir_template;
+}
+
+/*! Append the log file of a TeX run to the \c info string.
+ *
+ *  Missing log files are silently ignored.
+ *
+ *  \param info
+ *      the info string to extend, may be \c NULL
+ *
+ *  \param log_filename
+ *      path of the log file
+ */
+static void append_log(char **info, const char *log_filename)
+{
+    char *error;
+    char *log;
+    size_t log_size;
+    read_file(&log, &log_size, &error, log_filename);
+    free(error);
+    if (log != NULL) {
+        if (*info == NULL) {
+            *info = log;
+        } else {
+            char *info_old = *info;
+            *info = sprintf_alloc("%s\n\n%s", info_old, log);
+            free(info_old);
+            free(log);
+        }
+    }
+}
+
+/*! Determine the TeX command for a conversion.
+ *
+ *  \return
+ *      the command (not to be freed),
+ *      or \c NULL if the conversion is not supported.
+ */
+static const char *convert_command(const char *source_format, const char *result_format)
+{
+    if        (strcmp(source_format, "TeX") == 0 && strcmp(result_format, "DVI") == 0) {
+        return "tex";
+    } else if (strcmp(source_format, "TeX") == 0 && strcmp(result_format, "PDF") == 0) {
+        return "pdftex";
+    } else if (strcmp(source_format, "LaTeX") == 0 && strcmp(result_format, "DVI") == 0) {
+        return "latex";
+    } else if (strcmp(source_format, "LaTeX") == 0 && strcmp(result_format, "PDF") == 0) {
+        return "pdflatex";
+    }
+    return NULL;
+}
+
+/*! Split a comma separated list of languages.
+ *
+ *  English is always added,
+ *  because it is TeX's default language.
+ *
+ *  \return
+ *      0 on success, -1 when out of memory
+ *
+ *  \param list
+ *      list to which the language names are added
+ *
+ *  \param languages
+ *      comma separated list of language names
+ */
+static int parse_languages(struct string_list *list, const char *languages)
+{
+    const char *name = languages;
+    if (   string_list_add(list, "english", 7) != 0
+        || string_list_add(list, "USenglish", 9) != 0) {
+        return -1;
+    }
+    while (*name != '\0') {
+        size_t length;
+        while (*name == ',' || *name == ' ') {
+            name++;
+        }
+        for (length = 0; name[length] != '\0' && name[length] != ',' && name[length] != ' '; length++) {
+        }
+        if (length > 0 && string_list_add(list, name, length) != 0) {
+            return -1;
+        }
+        name += length;
+    }
+    return 0;
+}
+
+/*! Reduce a \c language.dat file to the given languages.
+ *
+ *  An entry of \c language.dat consists of a line with
+ *  the language name and its pattern file,
+ *  followed by lines of the form <tt>=synonym</tt>.
+ *  An entry is kept if its name or any of its synonyms is requested.
+ *  Comments are dropped.
+ *
+ *  \return
+ *      a newly allocated string containing the reduced \c language.dat,
+ *      or \c NULL when out of memory.
+ */
+static char *filter_language_dat(const char *dat, const struct string_list *languages)
+{
+    struct buffer filtered = { NULL, 0, 0 };
+    const char *line;
+    int keep = 0;
+    if (buffer_append(&filtered, "", 0) != 0) {
+        return NULL;
+    }
+    for (line = dat; *line != '\0'; ) {
+        const char *line_end = strchr(line, '\n');
+        const size_t length = line_end == NULL ? strlen(line) : (size_t)(line_end - line);
+        const size_t name_length = strcspn(line, " \t\r\n%");
+        if (name_length > 0 && line[0] != '=') {
+            /* start of a new entry, so check its name and all synonyms */
+            const char *next = line;
+            keep = string_list_contains(languages, line, name_length);
+            for (;;) {
+                next += strcspn(next, "\n");
+                if (*next == '\n') {
+                    next++;
+                }
+                if (*next != '=') {
+                    break;
+                }
+                if (string_list_contains(languages, next + 1, strcspn(next + 1, " \t\r\n%"))) {
+                    keep = 1;
+                }
+            }
+        }
+        if (keep && name_length > 0) {
+            if (   buffer_append(&filtered, line, length) != 0
+                || buffer_append(&filtered, "\n", 1) != 0) {
+                free(filtered.data);
+                return NULL;
+            }
+        }
+        line += length;
+        if (*line == '\n') {
+            line++;
+        }
+    }
+    return filtered.data;
+}
+
+/*! Reduce a \c language.def file to the given languages.
+ *
+ *  All <tt>\\addlanguage</tt> lines of languages not requested are dropped.
+ *  All other lines are kept as they are.
+ *
+ *  \return
+ *      a newly allocated string containing the reduced \c language.def,
+ *      or \c NULL when out of memory.
+ */
+static char *filter_language_def(const char *def, const struct string_list *languages)
+{
+    const char addlanguage[] = "\\addlanguage";
+    const size_t addlanguage_length = sizeof(addlanguage) - 1;
+    struct buffer filtered = { NULL, 0, 0 };
+    const char *line;
+    if (buffer_append(&filtered, "", 0) != 0) {
+        return NULL;
+    }
+    for (line = def; *line != '\0'; ) {
+        const char *line_end = strchr(line, '\n');
+        const size_t length = line_end == NULL ? strlen(line) : (size_t)(line_end - line);
+        int keep = 1;
+        if (length > addlanguage_length && memcmp(line, addlanguage, addlanguage_length) == 0) {
+            const char *name = line + addlanguage_length;
+            size_t name_length = 0;
+            while (*name == ' ' || *name == '{') {
+                name++;
+            }
+            while (name + name_length < line + length && name[name_length] != '}') {
+                name_length++;
+            }
+            keep = string_list_contains(languages, name, name_length);
+        }
+        if (keep) {
+            if (   buffer_append(&filtered, line, length) != 0
+                || buffer_append(&filtered, "\n", 1) != 0) {
+                free(filtered.data);
+                return NULL;
+            }
+        }
+        line += length;
+        if (*line == '\n') {
+            line++;
+        }
+    }
+    return filtered.data;
+}
+
+/*! Determine the path of a custom format within the cache.
+ *
+ *  The languages are normalized the same way build_format() reads them,
+ *  so lists that differ only in order, spacing or duplicates,
+ *  such as <tt>"german,french"</tt> and <tt>"french, german"</tt>,
+ *  share the same format.
+ *
+ *  \return
+ *      a newly allocated string containing the path,
+ *      or \c NULL when out of memory.
+ */
+static char *format_cache_filename(const char *cache_dir, const char *cmd, const char *languages)
+{
+    unsigned long hash[2] = HASH_INIT;
+    struct string_list language_list = { NULL, 0, 0 };
+    char *key;
+    char *filename;
+    size_t i;
+    if (parse_languages(&language_list, languages) != 0) {
+        string_list_free(&language_list);
+        return NULL;
+    }
+    string_list_sort_unique(&language_list);
+    hash_update(hash, cmd, strlen(cmd) + 1);
+    for (i = 0; i < language_list.count; i++) {
+        hash_update(hash, language_list.items[i], strlen(language_list.items[i]) + 1);
+    }
+    string_list_free(&language_list);
+    key = hash_key(hash);
+    if (key == NULL) {
+        return NULL;
+    }
+    filename = sprintf_alloc("%s/format-%s.fmt", cache_dir, key);
+    free(key);
+    return filename;
+}
+
+/*! Build a custom format with only the given hyphenation languages.
+ *
+ *  This is done the same way \c fmtutil builds the stock formats,
+ *  but with a reduced language configuration in the current directory,
+ *  where it is found before the system-wide one.
+ *
+ *  \return
+ *      0 on success, -1 on failure
+ *
+ *  \param info
+ *      will be set to a newly allocated string that contains
+ *      additional information such as an error message,
+ *      or \c NULL when out of memory.
+ *
+ *  \param cmd
+ *      the TeX command the format is meant for
+ *
+ *  \param languages
+ *      comma separated list of hyphenation languages
+ *
+ *  \param fmt_filename
+ *      path to store the format at
+ */
+static int build_format(char **info, const char *cmd, const char *languages, const char *fmt_filename)
+{
+    char *error;
+    const char *ini;
+    const char *language_file;
+    char *dir = NULL;
+    char *kpsewhich_filename = NULL;
+    char *language_path = NULL;
+    size_t language_path_size;
+    char *language_config = NULL;
+    size_t language_config_size;
+    char *filtered = NULL;
+    char *language_filename = NULL;
+    char *log_filename = NULL;
+    char *built_filename = NULL;
+    char *fmt = NULL;
+    size_t fmt_size;
+    struct string_list language_list = { NULL, 0, 0 };
+    const char *kpsewhich_args[3];
+    char *progname_arg = NULL;
+    const char *ini_args[9];
+    int status = -1;
+    *info = NULL;
+    /* select initialization file like fmtutil.cnf does */
+    if        (strcmp(cmd, "pdftex") == 0) {
+        ini = "*pdfetex.ini";
+        language_file = "language.def";
+    } else if (strcmp(cmd, "latex") == 0) {
+        ini = "*latex.ini";
+        language_file = "language.dat";
+    } else if (strcmp(cmd, "pdflatex") == 0) {
+        ini = "*pdflatex.ini";
+        language_file = "language.dat";
+    } else {
+        *info = sprintf_alloc("Unable to build custom format for command \"%s\".",
+                              cmd);
+        goto cleanup;
+    }
+    if (parse_languages(&language_list, languages) != 0) {
+        goto cleanup;
+    }
+    dir = create_temporary_directory(info);
+    if (dir == NULL) {
+        goto cleanup;
+    }
+    kpsewhich_filename = sprintf_alloc("%s/kpsewhich.out", dir);
+    language_filename = sprintf_alloc("%s/%s", dir, language_file);
+    log_filename = sprintf_alloc("%s/texcaller.log", dir);
+    built_filename = sprintf_alloc("%s/texcaller.fmt", dir);
+    if (   kpsewhich_filename == NULL
+        || language_filename == NULL
+        || log_filename == NULL
+        || built_filename == NULL) {
+        goto cleanup;
+    }
+    /* locate system-wide language configuration */
+    kpsewhich_args[0] = "kpsewhich";
+    kpsewhich_args[1] = language_file;
+    kpsewhich_args[2] = NULL;
+    if (run_command(info, dir, kpsewhich_args, "kpsewhich.out", NULL, NULL) != 0) {
+        goto cleanup;
+    }
+    read_file(&language_path, &language_path_size, &error, kpsewhich_filename);
+    if (language_path == NULL) {
+        *info = error;
+        goto cleanup;
+    }
+    while (language_path_size > 0 && strchr("\r\n", language_path[language_path_size - 1]) != NULL) {
+        language_path[--language_path_size] = '\0';
+    }
+    /* reduce language configuration */
+    read_file(&language_config, &language_config_size, &error, language_path);
+    if (language_config == NULL) {
+        *info = error;
+        goto cleanup;
+    }
+    if (strcmp(language_file, "language.dat") == 0) {
+        filtered = filter_language_dat(language_config, &language_list);
+    } else {
+        filtered = filter_language_def(language_config, &language_list);
+    }
+    if (filtered == NULL) {
+        goto cleanup;
+    }
+    if (write_file(&error, language_filename, filtered, strlen(filtered)) != 0) {
+        *info = error;
+        goto cleanup;
+    }
+    /* build format */
+    progname_arg = sprintf_alloc("-progname=%s", cmd);
+    if (progname_arg == NULL) {
+        goto cleanup;
+    }
+    ini_args[0] = "pdftex";
+    ini_args[1] = "-ini";
+    ini_args[2] = "-interaction=batchmode";
+    ini_args[3] = "-halt-on-error";
+    ini_args[4] = "-jobname=texcaller";
+    ini_args[5] = progname_arg;
+    ini_args[6] = "-translate-file=cp227.tcx";
+    ini_args[7] = ini;
+    ini_args[8] = NULL;
+    if (run_command(info, dir, ini_args, NULL, NULL, NULL) != 0) {
+        append_log(info, log_filename);
+        goto cleanup;
+    }
+    /* store format in cache */
+    read_file(&fmt, &fmt_size, &error, built_filename);
+    if (fmt == NULL) {
+        *info = error;
+        goto cleanup;
+    }
+    if (write_file_atomically(&error, fmt_filename, fmt, fmt_size) != 0) {
+        *info = error;
+        goto cleanup;
+    }
+    *info = sprintf_alloc("Built format \"%s\" (%lu bytes) for \"%s\" with languages \"%s\".",
+                          fmt_filename, (unsigned long)fmt_size, cmd, languages);
+    status = 0;
+    goto cleanup;
+    /* cleanup all used resources */
+cleanup:
+    if (dir != NULL && remove_directory_recursively(&error, dir) != 0) {
+        free(*info);
+        *info = error;
+        status = -1;
+    }
+    string_list_free(&language_list);
+    free(dir);
+    free(kpsewhich_filename);
+    free(language_path);
+    free(language_config);
+    free(filtered);
+    free(language_filename);
+    free(log_filename);
+    free(built_filename);
+    free(progname_arg);
+    free(fmt);
+    return status;
+}
+
+/*! Copy the data of an open file to a file descriptor, without reading it into memory.
+ *
+ *  On Linux, the data is copied within the kernel via \c copy_file_range(),
+ *  falling back to \c sendfile() if the descriptor isn't a regular file.
+ *  Otherwise, or if neither is supported for these files,
+ *  the data is copied via \c read() and \c write().
+ *  It is written at the current offset of the descriptor.
+ *
+ *  \return
+ *      0 on success, -1 on failure
+ *
+ *  \param error
+ *      On failure, \c error will be set to a newly allocated string
+ *      that contains the error message.
+ *      On success, or when out of memory,
+ *      \c error will be set to \c NULL.
+ *
+ *  \param from_fd
+ *      the file descriptor to read from
+ *
+ *  \param from
+ *      path of the file, for error messages
+ *
+ *  \param fd
+ *      the file descriptor to write to
+ */
+static int copy_data(char **error, int from_fd, const char *from, int fd)
+{
+    char data[65536];
+    int method = 0;
+    ssize_t n;
+    *error = NULL;
+    for (;;) {
+        if (method == 0) {
+#if defined(__linux__) && defined(SYS_copy_file_range)
+            n = syscall(SYS_copy_file_range, from_fd, NULL, fd, NULL, (size_t)1 << 30, 0);
+#else
+            n = -1;
+            errno = ENOSYS;
+#endif
+        } else if (method == 1) {
+#ifdef __linux__
+            n = sendfile(fd, from_fd, NULL, (size_t)1 << 30);
+#else
+            n = -1;
+            errno = ENOSYS;
+#endif
+        } else {
+            n = read(from_fd, data, sizeof(data));
+            if (n > 0) {
+                ssize_t written = 0;
+                while (written < n) {
+                    const ssize_t w = write(fd, data + written, n - written);
+                    if (w == -1 && errno != EINTR) {
+                        *error = sprintf_alloc("Unable to copy file \"%s\": %s.", from, strerror(errno));
+                        return -1;
+                    }
+                    written += w == -1 ? 0 : w;
+                }
+            }
+        }
+        if (n == 0) {
+            break;
+        }
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        /* fall back to the next method if unsupported for these files */
+        if (n == -1 && method < 2
+            && (errno == ENOSYS || errno == EXDEV || errno == EINVAL || errno == EBADF || errno == EOPNOTSUPP)) {
+            method++;
+            continue;
+        }
+        if (n == -1) {
+            *error = sprintf_alloc("Unable to copy file \"%s\": %s.", from, strerror(errno));
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*! Copy a file, replacing the destination if it exists.
+ *
+ *  The file is cloned via \c FICLONE on Linux
+ *  where the file system supports it,
+ *  which shares the data until either file is modified,
+ *  and copied via copy_data() otherwise.
+ *  Unlike a hard link, the copy is a separate file,
+ *  so writing to it never affects the original,
+ *  which matters for files from the cache.
+ *  The copy is written into a temporary file next to \c to,
+ *  which is then renamed to \c to,
+ *  so \c to is never left partially written.
+ *
+ *  \return
+ *      0 on success, -1 on failure
+ *
+ *  \param error
+ *      On failure, \c error will be set to a newly allocated string
+ *      that contains the error message.
+ *      On success, or when out of memory,
+ *      \c error will be set to \c NULL.
+ *
+ *  \param from
+ *      path of the existing file
+ *
+ *  \param to
+ *      path of the copy
+ */
+static int copy_file(char **error, const char *from, const char *to)
+{
+    char *tmp_path = NULL;
+    int from_fd;
+    int fd = -1;
+    int status = -1;
+    *error = NULL;
+    from_fd = open(from, O_RDONLY | O_CLOEXEC);
+    if (from_fd == -1) {
+        *error = sprintf_alloc("Unable to open file \"%s\" for reading: %s.", from, strerror(errno));
+        return -1;
+    }
+    fd = create_temporary_file(error, &tmp_path, to);
+    if (fd == -1) {
+        goto cleanup;
+    }
+#ifdef FICLONE
+    if (ioctl(fd, FICLONE, from_fd) != 0)
+#endif
+    {
+        if (copy_data(error, from_fd, from, fd) != 0) {
+            goto cleanup;
+        }
+    }
+    if (close(fd) != 0) {
+        fd = -1;
+        *error = sprintf_alloc("Unable to close file \"%s\" after writing: %s.", tmp_path, strerror(errno));
+        goto cleanup;
+    }
+    fd = -1;
+    if (rename(tmp_path, to) != 0) {
+        *error = sprintf_alloc("Unable to rename file \"%s\" to \"%s\": %s.", tmp_path, to, strerror(errno));
+        goto cleanup;
+    }
+    status = 0;
+    goto cleanup;
+    /* cleanup all used resources */
+cleanup:
+    if (fd != -1) {
+        close(fd);
+    }
+    if (status != 0 && tmp_path != NULL) {
+        unlink(tmp_path);
+    }
+    free(tmp_path);
+    close(from_fd);
+    return status;
+}
+
+/*! Move a file, replacing the destination if it exists.
+ *
+ *  The file is renamed, which is atomic and doesn't touch the data.
+ *  If that fails across file systems,
+ *  it is copied via copy_file(),
+ *  which never leaves the destination partially written.
+ *
+ *  \return
+ *      0 on success, -1 on failure
+ *
+ *  \param error
+ *      On failure, \c error will be set to a newly allocated string
+ *      that contains the error message.
+ *      On success, or when out of memory,
+ *      \c error will be set to \c NULL.
+ *
+ *  \param from
+ *      path of the existing file
+ *
+ *  \param to
+ *      path of the destination
+ */
+static int move_file(char **error, const char *from, const char *to)
+{
+    *error = NULL;
+    if (rename(from, to) == 0) {
+        return 0;
+    }
+    if (errno != EXDEV) {
+        *error = sprintf_alloc("Unable to rename file \"%s\" to \"%s\": %s.", from, to, strerror(errno));
+        return -1;
+    }
+    if (copy_file(error, from, to) != 0) {
+        return -1;
+    }
+    unlink(from);
+    return 0;
+}
+
+/*! Check whether an asset name is a plain file name.
+ *
+ *  \return
+ *      1 if the name is valid, 0 otherwise
+ */
+static int is_valid_asset_name(const char *name)
+{
+    return name[0] != '\0'
+        && name[0] != '.'
+        && strchr(name, '/') == NULL
+        && strncmp(name, "texput.", 7) != 0;
+}
+
+/*! Convert an EPS or SVG asset to PDF, using the cache if possible.
+ *
+ *  \return
+ *      0 on success, -1 on failure
+ *
+ *  \param info
+ *      On failure, \c info will be set to a newly allocated string
+ *      that contains the error message.
+ *      On success, or when out of memory,
+ *      \c info will be set to \c NULL.
+ *
+ *  \param dir
+ *      the directory which already contains the asset
+ *
+ *  \param asset
+ *      the asset to convert
+ *
+ *  \param cache_dir
+ *      the cache directory, or \c NULL
+ *
+ *  \param priority
+ *      the priority of the child processes, or \c NULL to inherit it
+ */
+static int convert_graphic(char **info, const char *dir, const texcaller_asset *asset, const char *cache_dir, const struct child_priority *priority)
+{
+    char *error;
+    const size_t name_length = strlen(asset->name);
+    const size_t base_length = name_length - 4;
+    const int eps = has_suffix(asset->name, name_length, ".eps");
+    char *converted_name = NULL;
+    char *converted_filename = NULL;
+    char *pdf_filename = NULL;
+    char *cache_filename = NULL;
+    char *outfile_arg = NULL;
+    const char *args[5];
+    int status = -1;
+    *info = NULL;
+    if (eps) {
+        converted_name = sprintf_alloc("%.*s-eps-converted-to.pdf", (int)base_length, asset->name);
+    } else {
+        converted_name = sprintf_alloc("%.*s.pdf", (int)base_length, asset->name);
+    }
+    if (converted_name == NULL) {
+        goto cleanup;
+    }
+    converted_filename = sprintf_alloc("%s/%s", dir, converted_name);
+    pdf_filename = sprintf_alloc("%s/%.*s.pdf", dir, (int)base_length, asset->name);
+    if (converted_filename == NULL || pdf_filename == NULL) {
+        goto cleanup;
+    }
+    /* use converted graphic from cache, if any */
+    if (cache_dir != NULL) {
+        struct digest digest;
+        char *key;
+        digest_init(&digest);
+        digest_update(&digest, eps ? "eps" : "svg", 4);
+        digest_update(&digest, asset->data, asset->size);
+        key = digest_key(&digest);
+        if (key == NULL) {
+            goto cleanup;
+        }
+        cache_filename = sprintf_alloc("%s/graphic-%s.pdf", cache_dir, key);
+        free(key);
+        if (cache_filename == NULL) {
+            goto cleanup;
+        }
+    }
+    if (cache_filename == NULL || copy_file(&error, cache_filename, converted_filename) != 0) {
+        /* tolerate missing cache entry */
+        if (cache_filename != NULL) {
+            free(error);
+        }
+        /* convert graphic */
+        outfile_arg = sprintf_alloc(eps ? "--outfile=%s" : "--export-filename=%s", converted_name);
+        if (outfile_arg == NULL) {
+            goto cleanup;
+        }
+        if (eps) {
+            args[0] = "epstopdf";
+            args[1] = outfile_arg;
+            args[2] = asset->name;
+            args[3] = NULL;
+        } else {
+            args[0] = "inkscape";
+            args[1] = "--export-type=pdf";
+            args[2] = outfile_arg;
+            args[3] = asset->name;
+            args[4] = NULL;
+        }
+        if (run_command(&error, dir, args, NULL, priority, NULL) != 0) {
+            *info = sprintf_alloc("Unable to convert graphic \"%s\" to PDF: %s",
+                                  asset->name, error == NULL ? "Out of memory." : error);
+            free(error);
+            goto cleanup;
+        }
+        /* store converted graphic in cache */
+        if (cache_filename != NULL) {
+            char *converted;
+            size_t converted_size;
+            read_file(&converted, &converted_size, &error, converted_filename);
+            if (converted == NULL) {
+                *info = error;
+                goto cleanup;
+            }
+            write_file_atomically(&error, cache_filename, converted, converted_size);
+            free(error);
+            free(converted);
+        }
+    }
+    /* provide EPS graphics under their plain name as well, unless taken */
+    if (eps && access(pdf_filename, F_OK) != 0) {
+        if (copy_file(info, converted_filename, pdf_filename) != 0) {
+            goto cleanup;
+        }
+    }
+    status = 0;
+    goto cleanup;
+    /* cleanup all used resources */
+cleanup:
+    free(converted_name);
+    free(converted_filename);
+    free(pdf_filename);
+    free(cache_filename);
+    free(outfile_arg);
+    return status;
+}
+
+/*! Largest size an image can be printed at, in inches.
+ *
+ *  This is the long side of an A4 page,
+ *  which is slightly longer than that of a US letter page.
+ */
+#define MAX_PRINT_SIZE 11.7
+
+/*! Check whether an asset is a bitmap image that can be preprocessed.
+ *
+ *  \return
+ *      1 if the asset is a PNG or JPEG image, 0 otherwise
+ */
+static int is_bitmap_image(const char *name)
+{
+    const size_t length = strlen(name);
+    return has_suffix(name, length, ".png")
+        || has_suffix(name, length, ".jpg")
+        || has_suffix(name, length, ".jpeg");
+}
+
+/*! Downsample and strip all bitmap images of a document, in parallel.
+ *
+ *  Each PNG and JPEG asset is reduced to at most
+ *  \c image_dpi pixels per inch at \ref MAX_PRINT_SIZE,
+ *  and its metadata is stripped.
+ *  The resolution stored in the image is adjusted accordingly,
+ *  so the natural size of the image doesn't change.
+ *  The work is done by ImageMagick,
+ *  with one process per image and CPU.
+ *  If \c TEXCALLER_CACHE_DIR is set,
+ *  the results are cached by image content and \c image_dpi.
+ *
+ *  \return
+ *      0 on success, -1 on failure
+ *
+ *  \param info
+ *      On failure, \c info will be set to a newly allocated string
+ *      that contains the error message.
+ *      On success, or when out of memory,
+ *      \c info will be set to \c NULL.
+ *
+ *  \param dir
+ *      the directory which already contains the assets
+ *
+ *  \param options
+ *      the options containing the assets and \c image_dpi
+ *
+ *  \param cache_dir
+ *      the cache directory, or \c NULL
+ *
+ *  \param priority
+ *      the priority of the child processes, or \c NULL to inherit it
+ */
+static int preprocess_images(char **info, const char *dir, const texcaller_options *options, const char *cache_dir, const struct child_priority *priority)
+{
+    const size_t stride = 12;
+    const unsigned long max_pixels = (unsigned long)(options->image_dpi * MAX_PRINT_SIZE);
+    char *error;
+    struct string_list pending = { NULL, 0, 0 };
+    struct string_list cache_filenames = { NULL, 0, 0 };
+    struct string_list owned_args = { NULL, 0, 0 };
+    const char **identify_args = NULL;
+    const char **commands = NULL;
+    char *identify_filename = NULL;
+    char *identify = NULL;
+    size_t identify_size;
+    const char *line;
+    size_t i;
+    int status = -1;
+    *info = NULL;
+    /* use preprocessed images from cache, if any */
+    for (i = 0; i < options->assets_count; i++) {
+        const texcaller_asset *asset = &options->assets[i];
+        char *cache_filename = NULL;
+        if (!is_bitmap_image(asset->name)) {
+            continue;
+        }
+        if (cache_dir != NULL) {
+            struct digest digest;
+            char dpi[32];
+            char *key;
+            char *filename;
+            int cached;
+            sprintf(dpi, "%i", options->image_dpi);
+            digest_init(&digest);
+            digest_update(&digest, "image", 6);
+            digest_update(&digest, dpi, strlen(dpi) + 1);
+            digest_update(&digest, asset->data, asset->size);
+            key = digest_key(&digest);
+            if (key == NULL) {
+                goto cleanup;
+            }
+            cache_filename = sprintf_alloc("%s/image-%s%s", cache_dir, key, strrchr(asset->name, '.'));
+            free(key);
+            filename = sprintf_alloc("%s/%s", dir, asset->name);
+            if (cache_filename == NULL || filename == NULL) {
+                free(cache_filename);
+                free(filename);
+                goto cleanup;
+            }
+            /* replace the original image, which is kept if the cache entry is missing */
+            error = NULL;
+            cached = copy_file(&error, cache_filename, filename) == 0;
+            free(error);
+            free(filename);
+            if (cached) {
+                free(cache_filename);
+                continue;
+            }
+        }
+        if (   string_list_append(&pending, asset->name, strlen(asset->name)) != 0
+            || string_list_append(&cache_filenames, cache_filename == NULL ? "" : cache_filename,
+                                  cache_filename == NULL ? 0 : strlen(cache_filename)) != 0) {
+            free(cache_filename);
+            goto cleanup;
+        }
+        free(cache_filename);
+    }
+    if (pending.count == 0) {
+        status = 0;
+        goto cleanup;
+    }
+    /* determine sizes and resolutions of all images at once */
+    identify_args = (const char **)malloc((pending.count + 4) * sizeof(const char *));
+    if (identify_args == NULL) {
+        goto cleanup;
+    }
+    identify_args[0] = "identify";
+    identify_args[1] = "-format";
+    identify_args[2] = "%w %h %[resolution.x] %U\n";
+    for (i = 0; i < pending.count; i++) {
+        char *first_frame = sprintf_alloc("%s[0]", pending.items[i]);
+        if (first_frame == NULL || string_list_append(&owned_args, first_frame, strlen(first_frame)) != 0) {
+            free(first_frame);
+            goto cleanup;
+        }
+        free(first_frame);
+        identify_args[3 + i] = owned_args.items[owned_args.count - 1];
+    }
+    identify_args[3 + pending.count] = NULL;
+    if (run_command(info, dir, identify_args, "texcaller-identify.out", priority, NULL) != 0) {
+        goto cleanup;
+    }
+    identify_filename = sprintf_alloc("%s/texcaller-identify.out", dir);
+    if (identify_filename == NULL) {
+        goto cleanup;
+    }
+    read_file(&identify, &identify_size, info, identify_filename);
+    if (identify == NULL) {
+        goto cleanup;
+    }
+    /* downsample and strip all images in parallel */
+    commands = (const char **)malloc(pending.count * stride * sizeof(const char *));
+    if (commands == NULL) {
+        goto cleanup;
+    }
+    line = identify;
+    for (i = 0; i < pending.count; i++) {
+        const char **args = commands + i * stride;
+        unsigned long width = 0;
+        unsigned long height = 0;
+        double density = 0;
+        char units[64] = "";
+        char *geometry;
+        char *density_arg;
+        char *output;
+        if (sscanf(line, "%lu %lu %lf %63s", &width, &height, &density, units) < 2) {
+            *info = sprintf_alloc("Unable to determine the size of image \"%s\".",
+                                  pending.items[i]);
+            goto cleanup;
+        }
+        line += strcspn(line, "\n");
+        line += strspn(line, "\n");
+        /* undefined resolutions are taken as 72 dpi by pdfTeX */
+        if (density <= 0 || strcmp(units, "PixelsPerInch") != 0) {
+            density = strcmp(units, "PixelsPerCentimeter") == 0 && density > 0 ? density * 2.54 : 72;
+        }
+        if (width > max_pixels || height > max_pixels) {
+            density = density * max_pixels / (width > height ? width : height);
+        }
+        geometry = sprintf_alloc("%lux%lu>", max_pixels, max_pixels);
+        density_arg = sprintf_alloc("%g", density);
+        output = sprintf_alloc("texcaller-image-%s", pending.items[i]);
+        if (   geometry == NULL
+            || density_arg == NULL
+            || output == NULL
+            || string_list_append(&owned_args, geometry, strlen(geometry)) != 0
+            || string_list_append(&owned_args, density_arg, strlen(density_arg)) != 0
+            || string_list_append(&owned_args, output, strlen(output)) != 0) {
+            free(geometry);
+            free(density_arg);
+            free(output);
+            goto cleanup;
+        }
+        free(geometry);
+        free(density_arg);
+        free(output);
+        *args++ = "convert";
+        *args++ = identify_args[3 + i];
+        *args++ = "-auto-orient";
+        *args++ = "-strip";
+        *args++ = "-resize";
+        *args++ = owned_args.items[owned_args.count - 3];
+        *args++ = "-units";
+        *args++ = "PixelsPerInch";
+        *args++ = "-density";
+        *args++ = owned_args.items[owned_args.count - 2];
+        *args++ = owned_args.items[owned_args.count - 1];
+        *args++ = NULL;
+    }
+    if (run_commands_parallel(info, dir, commands, stride, pending.count, cpu_count(), priority) != 0) {
+        goto cleanup;
+    }
+    /* replace original images and store results in cache */
+    for (i = 0; i < pending.count; i++) {
+        char *output = sprintf_alloc("%s/texcaller-image-%s", dir, pending.items[i]);
+        char *filename = sprintf_alloc("%s/%s", dir, pending.items[i]);
+        if (output == NULL || filename == NULL) {
+            free(output);
+            free(filename);
+            goto cleanup;
+        }
+        if (rename(output, filename) != 0) {
+            *info = sprintf_alloc("Unable to rename file \"%s\" to \"%s\": %s.",
+                                  output, filename, strerror(errno));
+            free(output);
+            free(filename);
+            goto cleanup;
+        }
+        if (cache_filenames.items[i][0] != '\0') {
+            char *data;
+            size_t data_size;
+            read_file(&data, &data_size, &error, filename);
+            free(error);
+            if (data != NULL) {
+                write_file_atomically(&error, cache_filenames.items[i], data, data_size);
+                free(error);
+                free(data);
+            }
+        }
+        free(output);
+        free(filename);
+    }
+    status = 0;
+    goto cleanup;
+    /* cleanup all used resources */
+cleanup:
+    string_list_free(&pending);
+    string_list_free(&cache_filenames);
+    string_list_free(&owned_args);
+    free(identify_args);
+    free(commands);
+    free(identify_filename);
+    free(identify);
+    return status;
+}
+
+/*! Write the assets of a document into the directory TeX runs in.
+ *
+ *  \return
+ *      0 on success, -1 on failure
+ *
+ *  \param info
+ *      On failure, \c info will be set to a newly allocated string
+ *      that contains the error message.
+ *      On success, or when out of memory,
+ *      \c info will be set to \c NULL.
+ *
+ *  \param dir
+ *      the directory to write the assets to
+ *
+ *  \param options
+ *      the options containing the assets
+ *
+ *  \param result_format
+ *      \c "DVI" or \c "PDF"
+ *
+ *  \param cache_dir
+ *      the cache directory, or \c NULL
+ *
+ *  \param priority
+ *      the priority of the child processes, or \c NULL to inherit it
+ */
+static int write_assets(char **info, const char *dir, const texcaller_options *options, const char *result_format, const char *cache_dir, const struct child_priority *priority)
+{
+    size_t i;
+    *info = NULL;
+    for (i = 0; i < options->assets_count; i++) {
+        const texcaller_asset *asset = &options->assets[i];
+        char *filename;
+        if (!is_valid_asset_name(asset->name)) {
+            *info = sprintf_alloc("Invalid asset name \"%s\".",
+                                  asset->name);
+            return -1;
+        }
+        filename = sprintf_alloc("%s/%s", dir, asset->name);
+        if (filename == NULL) {
+            return -1;
+        }
+        if (write_file(info, filename, asset->data, asset->size) != 0) {
+            free(filename);
+            return -1;
+        }
+        free(filename);
+    }
+    if (strcmp(result_format, "PDF") != 0) {
+        return 0;
+    }
+    for (i = 0; i < options->assets_count; i++) {
+        const texcaller_asset *asset = &options->assets[i];
+        const size_t name_length = strlen(asset->name);
+        if (   has_suffix(asset->name, name_length, ".eps")
+            || has_suffix(asset->name, name_length, ".svg")) {
+            if (convert_graphic(info, dir, asset, cache_dir, priority) != 0) {
+                return -1;
+            }
+        }
+    }
+    if (options->image_dpi > 0) {
+        return preprocess_images(info, dir, options, cache_dir, priority);
+    }
+    return 0;
+}
+
+/*! TeX code that enables TikZ externalization as soon as TikZ is loaded.
+ *
+ *  The figures are not built by TeX itself,
+ *  which isn't allowed to run commands,
+ *  but listed in \c texput.figlist and built by build_figures().
+ *  The MD5 check ensures that a wrongly placed cached figure
+ *  is never used, but typeset normally.
+ */
+#define EXTERNALIZE_PROLOGUE \
+    "\\AddToHook{package/tikz/after}{" \
+    "\\usetikzlibrary{external}" \
+    "\\tikzexternalize[mode=list and make,up to date check=md5]}"
+
+/*! Compute the part of the cache keys of TikZ figures
+ *  that is common to all figures of a document.
+ *
+ *  It depends on the TeX command and the preamble,
+ *  see figure_key().
+ *
+ *  \return
+ *      the newly allocated key part,
+ *      or \c NULL if out of memory
+ */
+static char *figure_salt(const char *cmd, const char *source, size_t preamble_length)
+{
+    struct digest digest;
+    digest_init(&digest);
+    digest_update(&digest, "tikz", 5);
+    digest_update(&digest, cmd, strlen(cmd) + 1);
+    digest_update(&digest, source, preamble_length);
+    return digest_key(&digest);
+}
+
+/*! Compute the cache key of a TikZ figure.
+ *
+ *  The key depends on the MD5 checksum of the picture code,
+ *  which TikZ writes to the \c .md5 file of the figure
+ *  in <tt>list and make</tt> mode.
+ *  So the key always matches the picture TikZ assigned to the figure,
+ *  no matter how the picture appears in the source,
+ *  such as within a macro or an input file.
+ *
+ *  \return
+ *      the newly allocated key,
+ *      or \c NULL if there is no checksum or if out of memory
+ *
+ *  \param dir
+ *      the directory TeX runs in
+ *
+ *  \param name
+ *      the name of the figure, such as \c texput-figure0
+ *
+ *  \param salt
+ *      the common part of the keys, see figure_salt()
+ */
+static char *figure_key(const char *dir, const char *name, const char *salt)
+{
+    struct digest digest;
+    char *md5_filename;
+    char *md5;
+    size_t md5_size;
+    char *error;
+    char *key;
+    md5_filename = sprintf_alloc("%s/%s.md5", dir, name);
+    if (md5_filename == NULL) {
+        return NULL;
+    }
+    read_file(&md5, &md5_size, &error, md5_filename);
+    free(md5_filename);
+    free(error);
+    if (md5 == NULL || md5_size == 0) {
+        free(md5);
+        return NULL;
+    }
+    digest_init(&digest);
+    digest_update(&digest, salt, strlen(salt) + 1);
+    digest_update(&digest, md5, md5_size);
+    free(md5);
+    key = digest_key(&digest);
+    return key;
+}
+
+/*! Remove all TikZ figures left over from previous conversions
+ *  in the same directory, such as within a session,
+ *  so only figures placed or built for the document are used.
+ *
+ *  \return
+ *      0 on success, -1 when out of memory
+ *
+ *  \param dir
+ *      the directory TeX runs in
+ */
+static int remove_figures(const char *dir)
+{
+    DIR *dir_handle;
+    struct dirent *entry;
+    dir_handle = opendir(dir);
+    if (dir_handle == NULL) {
+        return 0;
+    }
+    for (entry = readdir(dir_handle); entry != NULL; entry = readdir(dir_handle)) {
+        char *filename;
+        if (strncmp(entry->d_name, "texput-figure", 13) != 0) {
+            continue;
+        }
+        filename = sprintf_alloc("%s/%s", dir, entry->d_name);
+        if (filename == NULL) {
+            closedir(dir_handle);
+            return -1;
+        }
+        unlink(filename);
+        free(filename);
+    }
+    closedir(dir_handle);
+    return 0;
+}
+
+/*! Place a cached TikZ figure into the directory TeX runs in.
+ *
+ *  The cached figure is copied, never linked,
+ *  so TeX writing to it can't modify the cache.
+ *
+ *  \return
+ *      0 if the figure was placed, -1 otherwise
+ *
+ *  \param dir
+ *      the directory TeX runs in
+ *
+ *  \param name
+ *      the name of the figure, such as \c texput-figure0
+ *
+ *  \param cache_dir
+ *      the cache directory
+ *
+ *  \param key
+ *      the cache key of the figure, see figure_key()
+ */
+static int place_cached_figure(const char *dir, const char *name, const char *cache_dir, const char *key)
+{
+    char *error;
+    char *cache_filename = sprintf_alloc("%s/tikz-%s.pdf", cache_dir, key);
+    char *filename = sprintf_alloc("%s/%s.pdf", dir, name);
+    int status = -1;
+    if (cache_filename != NULL && filename != NULL) {
+        status = copy_file(&error, cache_filename, filename);
+        free(error);
+    }
+    free(cache_filename);
+    free(filename);
+    return status;
+}
+
+/*! Build all TikZ figures a TeX run is missing.
+ *
+ *  The figures listed in \c texput.figlist which aren't ready yet,
+ *  that is, neither placed nor built before
+ *  during the same conversion,
+ *  are placed from the cache if possible.
+ *  The remaining ones are built in parallel, the same way the makefile of
+ *  TikZ' <tt>list and make</tt> mode does it.
+ *  Afterwards, they are stored in the cache.
+ *  Failures of the cache are ignored,
+ *  because the cache is only an optimization.
+ *
+ *  \return
+ *      0 on success, -1 on failure
+ *
+ *  \param info
+ *      On failure, \c info will be set to a newly allocated string
+ *      that contains the error message.
+ *      On success, or when out of memory,
+ *      \c info will be set to \c NULL.
+ *
+ *  \param added
+ *      will be set to the number of placed or built figures,
+ *      which require another TeX run
+ *
+ *  \param ready
+ *      names of the figures that are ready,
+ *      such as \c texput-figure0,
+ *      to which the placed and built figures are appended
+ *
+ *  \param dir
+ *      the directory TeX runs in
+ *
+ *  \param cmd
+ *      the TeX command
+ *
+ *  \param fmt_arg
+ *      the <tt>-fmt</tt> argument for TeX, or \c NULL
+ *
+ *  \param cache_dir
+ *      the cache directory, or \c NULL
+ *
+ *  \param salt
+ *      the common part of the cache keys, see figure_salt()
+ *
+ *  \param priority
+ *      the priority of the child processes, or \c NULL to inherit it
+ */
+static int build_figures(char **info, int *added, struct string_list *ready, const char *dir, const char *cmd, const char *fmt_arg, const char *cache_dir, const char *salt, const struct child_priority *priority)
+{
+    const size_t stride = 10;
+    char *error;
+    char *figlist_filename;
+    char *figlist;
+    size_t figlist_size;
+    char *line;
+    struct string_list missing = { NULL, 0, 0 };
+    struct string_list owned_args = { NULL, 0, 0 };
+    const char **commands = NULL;
+    size_t i;
+    int status = -1;
+    *info = NULL;
+    *added = 0;
+    /* find missing figures */
+    figlist_filename = sprintf_alloc("%s/texput.figlist", dir);
+    if (figlist_filename == NULL) {
+        return -1;
+    }
+    read_file(&figlist, &figlist_size, &error, figlist_filename);
+    free(figlist_filename);
+    /* tolerate missing figure list, which means there are no figures */
+    free(error);
+    if (figlist == NULL) {
+        return 0;
+    }
+    for (line = figlist; *line != '\0'; ) {
+        const size_t length = strcspn(line, "\r\n");
+        if (   length > 0
+            && !string_list_contains(ready, line, length)
+            && string_list_add(&missing, line, length) != 0) {
+            goto cleanup;
+        }
+        line += length;
+        line += strspn(line, "\r\n");
+    }
+    /* place cached figures */
+    for (i = 0; cache_dir != NULL && i < missing.count; ) {
+        char *key = figure_key(dir, missing.items[i], salt);
+        if (key == NULL || place_cached_figure(dir, missing.items[i], cache_dir, key) != 0) {
+            free(key);
+            i++;
+            continue;
+        }
+        free(key);
+        if (string_list_append(ready, missing.items[i], strlen(missing.items[i])) != 0) {
+            goto cleanup;
+        }
+        (*added)++;
+        free(missing.items[i]);
+        missing.items[i] = missing.items[--missing.count];
+    }
+    if (missing.count == 0) {
+        status = 0;
+        goto cleanup;
+    }
+    /* build missing figures in parallel */
+    commands = (const char **)malloc(missing.count * stride * sizeof(const char *));
+    if (commands == NULL) {
+        goto cleanup;
+    }
+    for (i = 0; i < missing.count; i++) {
+        const char **args = commands + i * stride;
+        char *jobname_arg = sprintf_alloc("-jobname=%s", missing.items[i]);
+        char *input_arg = sprintf_alloc("%s\\def\\tikzexternalrealjob{texput}\\input texput.tex ", EXTERNALIZE_PROLOGUE);
+        if (   jobname_arg == NULL
+            || input_arg == NULL
+            || string_list_append(&owned_args, jobname_arg, strlen(jobname_arg)) != 0
+            || string_list_append(&owned_args, input_arg, strlen(input_arg)) != 0) {
+            free(jobname_arg);
+            free(input_arg);
+            goto cleanup;
+        }
+        free(jobname_arg);
+        free(input_arg);
+        *args++ = cmd;
+        *args++ = "-interaction=batchmode";
+        *args++ = "-halt-on-error";
+        *args++ = "-no-shell-escape";
+        if (fmt_arg != NULL) {
+            *args++ = fmt_arg;
+        }
+        *args++ = owned_args.items[owned_args.count - 2];
+        *args++ = owned_args.items[owned_args.count - 1];
+        *args++ = NULL;
+    }
+    if (run_commands_parallel(info, dir, commands, stride, missing.count, cpu_count(), priority) != 0) {
+        /* report log of the first figure that couldn't be built */
+        for (i = 0; i < missing.count; i++) {
+            char *pdf_filename = sprintf_alloc("%s/%s.pdf", dir, missing.items[i]);
+            char *log_filename = sprintf_alloc("%s/%s.log", dir, missing.items[i]);
+            const int failed = pdf_filename != NULL && access(pdf_filename, F_OK) != 0;
+            if (failed && log_filename != NULL) {
+                append_log(info, log_filename);
+            }
+            free(pdf_filename);
+            free(log_filename);
+            if (failed) {
+                break;
+            }
+        }
+        goto cleanup;
+    }
+    *added += (int)missing.count;
+    for (i = 0; i < missing.count; i++) {
+        if (string_list_append(ready, missing.items[i], strlen(missing.items[i])) != 0) {
+            goto cleanup;
+        }
+    }
+    /* store built figures in cache */
+    for (i = 0; cache_dir != NULL && i < missing.count; i++) {
+        char *data;
+        size_t data_size;
+        char *key = figure_key(dir, missing.items[i], salt);
+        char *filename = sprintf_alloc("%s/%s.pdf", dir, missing.items[i]);
+        char *cache_filename = key == NULL ? NULL : sprintf_alloc("%s/tikz-%s.pdf", cache_dir, key);
+        data = NULL;
+        if (filename != NULL && cache_filename != NULL) {
+            read_file(&data, &data_size, &error, filename);
+            free(error);
+            if (data != NULL) {
+                write_file_atomically(&error, cache_filename, data, data_size);
+                free(error);
+            }
+        }
+        free(key);
+        free(filename);
+        free(cache_filename);
+        free(data);
+    }
+    status = 0;
+    goto cleanup;
+    /* cleanup all used resources */
+cleanup:
+    free(figlist);
+    free(commands);
+    string_list_free(&missing);
+    string_list_free(&owned_args);
+    return status;
+}
+
+/*! Store the files read by a TeX run in the cache.
+ *
+ *  The \c texput.fls file of the run is copied into the cache,
+ *  unless the cache already contains a file list for the template.
+ *  These file lists are used by texcaller_warmup().
+ *  Failures are ignored,
+ *  because the cache is only an optimization.
+ *
+ *  \param dir
+ *      the directory TeX was run in
+ *
+ *  \param cache_filename
+ *      path of the file list within the cache
+ */
+static void cache_recorded_files(const char *dir, const char *cache_filename)
+{
+    char *error;
+    char *fls_filename;
+    char *fls;
+    size_t fls_size;
+    if (access(cache_filename, F_OK) == 0) {
+        return;
+    }
+    fls_filename = sprintf_alloc("%s/texput.fls", dir);
+    if (fls_filename == NULL) {
+        return;
+    }
+    read_file(&fls, &fls_size, &error, fls_filename);
+    free(fls_filename);
+    free(error);
+    if (fls == NULL) {
+        return;
+    }
+    write_file_atomically(&error, cache_filename, fls, fls_size);
+    free(error);
+    free(fls);
+}
+
+/*! Collect the files to warm up from the cache.
+ *
+ *  These are all system-wide files recorded in the cached file lists,
+ *  as well as the custom formats within the cache.
+ *
+ *  \return
+ *      0 on success, -1 on failure
+ *
+ *  \param info
+ *      On failure, \c info will be set to a newly allocated string
+ *      that contains the error message.
+ *      On success, or when out of memory,
+ *      \c info will be set to \c NULL.
+ *
+ *  \param files
+ *      list to which the paths of all files are added
+ *
+ *  \param templates
+ *      will be set to the number of file lists found
+ *
+ *  \param cache_dir
+ *      the cache directory
+ */
+static int collect_warmup_files(char **info, struct string_list *files, size_t *templates, const char *cache_dir)
+{
+    DIR *dir;
+    struct dirent *entry;
+    *info = NULL;
+    *templates = 0;
+    dir = opendir(cache_dir);
+    if (dir == NULL) {
+        *info = sprintf_alloc("Unable to read directory entries of \"%s\": %s.",
+                              cache_dir, strerror(errno));
+        return -1;
+    }
+    for (entry = readdir(dir); entry != NULL; entry = readdir(dir)) {
+        const size_t name_length = strlen(entry->d_name);
+        char *path;
+        char *fls;
+        size_t fls_size;
+        char *line;
+        if (   strncmp(entry->d_name, "format-", 7) != 0
+            && strncmp(entry->d_name, "files-", 6) != 0) {
+            continue;
+        }
+        path = sprintf_alloc("%s/%s", cache_dir, entry->d_name);
+        if (path == NULL) {
+            closedir(dir);
+            return -1;
+        }
+        if (has_suffix(entry->d_name, name_length, ".fmt")) {
+            if (string_list_append(files, path, strlen(path)) != 0) {
+                free(path);
+                closedir(dir);
+                return -1;
+            }
+        } else if (has_suffix(entry->d_name, name_length, ".fls")) {
+            read_file(&fls, &fls_size, info, path);
+            if (fls == NULL) {
+                free(path);
+                closedir(dir);
+                return -1;
+            }
+            (*templates)++;
+            for (line = fls; *line != '\0'; ) {
+                const size_t length = strcspn(line, "\n");
+                if (length > 7 && memcmp(line, "INPUT /", 7) == 0) {
+                    if (string_list_append(files, line + 6, length - 6) != 0) {
+                        free(fls);
+                        free(path);
+                        closedir(dir);
+                        return -1;
+                    }
+                }
+                line += length;
+                if (*line == '\n') {
+                    line++;
+                }
+            }
+            free(fls);
+        }
+        free(path);
+    }
+    closedir(dir);
+    string_list_sort_unique(files);
+    return 0;
+}
+
+/*! Read files completely, to get them into the page cache.
+ *
+ *  The work is distributed among several child processes,
+ *  which read in parallel.
+ *  Unreadable files are silently skipped.
+ *
+ *  \return
+ *      0 on success, -1 on failure
+ *
+ *  \param info
+ *      On failure, \c info will be set to a newly allocated string
+ *      that contains the error message.
+ *      On success, or when out of memory,
+ *      \c info will be set to \c NULL.
+ *
+ *  \param files
+ *      paths of the files to read
+ *
+ *  \param processes
+ *      number of child processes to use
+ */
+static int prefault_files(char **info, const struct string_list *files, int processes)
+{
+    pid_t *pids;
+    int process;
+    int started = 0;
+    int status = 0;
+    *info = NULL;
+    pids = (pid_t *)malloc(processes * sizeof(pid_t));
+    if (pids == NULL) {
+        return -1;
+    }
+    for (process = 0; process < processes; process++) {
+        pid_t pid = fork();
+        if (pid == -1) {
+            status = -1;
+            *info = sprintf_alloc("Unable to fork child process: %s.",
+                                  strerror(errno));
+            break;
+        }
+        /* child process */
+        if (pid == 0) {
+            size_t i;
+            char buf[65536];
+            /* first schedule read-ahead of all files, then wait for it */
+            for (i = process; i < files->count; i += processes) {
+                int fd = open(files->items[i], O_RDONLY);
+                if (fd != -1) {
+                    posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+                    close(fd);
+                }
+            }
+            for (i = process; i < files->count; i += processes) {
+                int fd = open(files->items[i], O_RDONLY);
+                if (fd != -1) {
+                    while (read(fd, buf, sizeof(buf)) > 0) {
+                    }
+                    close(fd);
+                }
+            }
+            _exit(0);
+        }
+        pids[started++] = pid;
+    }
+    /* wait for our own child processes only,
+       as other threads may have children of their own */
+    for (process = 0; process < started; process++) {
+        int child_status;
+        while (waitpid(pids[process], &child_status, 0) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (status == 0) {
+                *info = sprintf_alloc("Unable to wait for child process %li: %s.",
+                                      (long)pids[process], strerror(errno));
+                status = -1;
+            }
+            break;
+        }
+    }
+    free(pids);
+    return status;
+}
+
+/*! Check a trimmed font map against a finished TeX run, and update the cache.
+ *
+ *  If the run used a trimmed font map,
+ *  check whether that map covered all fonts of the run.
+ *  If the run used the full font maps,
+ *  generate a trimmed font map from it and store it in the cache.
+ *  The new trimmed font map also keeps the fonts of the previous one,
+ *  so that documents sharing the same preamble
+ *  but using different fonts don't evict each other's fonts.
+ *
+ *  Failures are ignored,
+ *  because the cache is only an optimization.
+ *
+ *  \return
+ *      1 if the trimmed font map missed a font,
+ *      so the run has to be repeated with the full font maps,
+ *      0 otherwise
+ *
+ *  \param dir
+ *      the directory TeX was run in
+ *
+ *  \param fontmap
+ *      content of the trimmed font map from the cache,
+ *      or \c NULL if there was none
+ *
+ *  \param fontmap_in_use
+ *      whether \c fontmap was used by the run
+ *
+ *  \param cache_filename
+ *      path of the trimmed font map within the cache
+ */
+static int fontmap_update(const char *dir, const char *fontmap, int fontmap_in_use, const char *cache_filename)
+{
+    struct string_list fonts = { NULL, 0, 0 };
+    struct string_list maps = { NULL, 0, 0 };
+    struct string_list names = { NULL, 0, 0 };
+    char *trimmed = NULL;
+    int miss = 0;
+    size_t i;
+    if (read_recorded_fonts(&fonts, &maps, dir) != 0) {
+        goto cleanup;
+    }
+    if (fontmap != NULL) {
+        if (fontmap_names(&names, fontmap) != 0) {
+            goto cleanup;
+        }
+        if (fontmap_in_use) {
+            for (i = 0; i < fonts.count; i++) {
+                if (!string_list_contains(&names, fonts.items[i], strlen(fonts.items[i]))) {
+                    miss = 1;
+                }
+            }
+            if (miss) {
+                unlink(cache_filename);
+            }
+            goto cleanup;
+        }
+        for (i = 0; i < names.count; i++) {
+            if (string_list_add(&fonts, names.items[i], strlen(names.items[i])) != 0) {
+                goto cleanup;
+            }
+        }
+    }
+    trimmed = fontmap_generate(&fonts, &maps);
+    if (trimmed != NULL) {
+        char *error;
+        write_file_atomically(&error, cache_filename, trimmed, strlen(trimmed));
+        free(error);
+    }
+cleanup:
+    string_list_free(&fonts);
+    string_list_free(&maps);
+    string_list_free(&names);
+    free(trimmed);
+    return miss;
+}
+
+/*! TeX code that stops typesetting after a number of pages.
+ *
+ *  This is a format string for sprintf_alloc(),
+ *  which takes the number of pages twice.
+ *  After the last page has been shipped out,
+ *  the job is ended as soon as TeX is back at the outer level,
+ *  which needs \c \\aftergroup because \c \\end
+ *  isn't allowed within the output routine.
+ *  Pages shipped out in the meantime are discarded.
+ *  Both cases write \ref PREVIEW_TRUNCATED to the log.
+ */
+#define PREVIEW_PROLOGUE \
+    "\\newcount\\texcallerpages" \
+    "\\def\\texcallertruncated{\\immediate\\write-1{" PREVIEW_TRUNCATED "}}" \
+    "\\def\\texcallerstop{\\ifnum\\currentgrouplevel>0 \\aftergroup\\texcallerstop" \
+    "\\else\\texcallertruncated\\csname @@end\\endcsname\\fi}" \
+    "\\AddToHook{shipout/before}{\\global\\advance\\texcallerpages1 " \
+    "\\ifnum\\texcallerpages>%i \\DiscardShipoutBox\\texcallertruncated\\fi}" \
+    "\\AddToHook{shipout/after}{\\ifnum\\texcallerpages=%i \\texcallerstop\\fi}"
+
+/*! Log message of a preview that omitted some pages.
+ *
+ *  \see PREVIEW_PROLOGUE
+ */
+#define PREVIEW_TRUNCATED "texcaller: preview truncated"
+
+/*! Check whether a preview omitted some pages of the document.
+ *
+ *  \return
+ *      1 if the log contains \ref PREVIEW_TRUNCATED, 0 otherwise
+ *
+ *  \param log_filename
+ *      path of the log file
+ */
+static int preview_truncated(const char *log_filename)
+{
+    char *log;
+    size_t log_size;
+    char *error;
+    int truncated;
+    read_file(&log, &log_size, &error, log_filename);
+    if (log == NULL) {
+        free(error);
+        return 0;
+    }
+    truncated = strstr(log, PREVIEW_TRUNCATED) != NULL;
+    free(log);
+    return truncated;
+}
+
+/*! Derive additional outputs from the DVI result, in parallel.
+ *
+ *  All outputs are produced concurrently from \c texput.dvi,
+ *  each by its own process.
+ *
+ *  \return
+ *      0 on success, -1 on failure
+ *
+ *  \param info
+ *      On failure, \c info will be set to a newly allocated string
+ *      that contains the error message.
+ *      On success, or when out of memory,
+ *      \c info will be set to \c NULL.
+ *
+ *  \param dir
+ *      the directory containing \c texput.dvi
+ *
+ *  \param outputs
+ *      the outputs to produce,
+ *      whose results are all set to \c NULL on failure
+ *
+ *  \param outputs_count
+ *      number of elements in \c outputs
+ *
+ *  \param priority
+ *      the priority of the child processes, or \c NULL to inherit it
+ */
+static int produce_outputs(char **info, const char *dir, texcaller_output *outputs, size_t outputs_count, const struct child_priority *priority)
+{
+    const size_t stride = 10;
+    const char **commands = NULL;
+    struct string_list owned_args = { NULL, 0, 0 };
+    pid_t *pids = NULL;
+    double *start_times = NULL;
+    size_t started = 0;
+    size_t i;
+    int status = -1;
+    *info = NULL;
+    commands = (const char **)malloc(outputs_count * stride * sizeof(const char *));
+    pids = (pid_t *)malloc(outputs_count * sizeof(pid_t));
+    start_times = (double *)malloc(outputs_count * sizeof(double));
+    if (commands == NULL || pids == NULL || start_times == NULL) {
+        goto cleanup;
+    }
+    /* assemble command lines */
+    for (i = 0; i < outputs_count; i++) {
+        const char **args = commands + i * stride;
+        const char *format = outputs[i].format;
+        char *output_arg;
+        char *resolution_arg = NULL;
+        if (strcmp(format, "PDF") == 0) {
+            output_arg = sprintf_alloc("texput-output-%lu.pdf", (unsigned long)i);
+        } else if (strcmp(format, "SVG") == 0) {
+            output_arg = sprintf_alloc("--output=texput-output-%lu.svg", (unsigned long)i);
+        } else if (strcmp(format, "PNG") == 0) {
+            output_arg = sprintf_alloc("texput-output-%lu.png", (unsigned long)i);
+            resolution_arg = sprintf_alloc("%i", outputs[i].resolution > 0 ? outputs[i].resolution : 96);
+            if (   resolution_arg == NULL
+                || string_list_append(&owned_args, resolution_arg, strlen(resolution_arg)) != 0) {
+                free(output_arg);
+                free(resolution_arg);
+                goto cleanup;
+            }
+            free(resolution_arg);
+        } else {
+            *info = sprintf_alloc("Unable to derive output \"%s\" from \"DVI\".",
+                                  format);
+            goto cleanup;
+        }
+        if (output_arg == NULL || string_list_append(&owned_args, output_arg, strlen(output_arg)) != 0) {
+            free(output_arg);
+            goto cleanup;
+        }
+        free(output_arg);
+        if (strcmp(format, "PDF") == 0) {
+            *args++ = "dvipdfmx";
+            *args++ = "-q";
+            *args++ = "-o";
+            *args++ = owned_args.items[owned_args.count - 1];
+        } else if (strcmp(format, "SVG") == 0) {
+            *args++ = "dvisvgm";
+            *args++ = "--page=1";
+            *args++ = "--no-fonts";
+            *args++ = owned_args.items[owned_args.count - 1];
+        } else {
+            *args++ = "dvipng";
+            *args++ = "-q";
+            *args++ = "-pp";
+            *args++ = "1";
+            *args++ = "-D";
+            *args++ = owned_args.items[owned_args.count - 2];
+            *args++ = "-o";
+            *args++ = owned_args.items[owned_args.count - 1];
+        }
+        *args++ = "texput.dvi";
+        *args++ = NULL;
+    }
+    /* start all outputs at once */
+    for (started = 0; started < outputs_count; started++) {
+        start_times[started] = current_time();
+        pids[started] = spawn_command(info, dir, commands + started * stride, NULL, priority);
+        if (pids[started] == -1) {
+            break;
+        }
+    }
+    status = started == outputs_count ? 0 : -1;
+    /* wait for all started outputs, measuring their CPU time */
+    for (i = 0; i < started; i++) {
+        char *error;
+        texcaller_stats stats;
+        init_stats(&stats);
+        if (wait_command(&error, pids[i], commands[i * stride], start_times[i], &stats) != 0) {
+            if (status == 0) {
+                *info = error;
+                status = -1;
+            } else {
+                free(error);
+            }
+        }
+        outputs[i].time = stats.cpu_time;
+    }
+    if (status != 0) {
+        goto cleanup;
+    }
+    /* read all outputs */
+    for (i = 0; i < outputs_count; i++) {
+        char *filename;
+        char *error;
+        filename = sprintf_alloc("%s/texput-output-%lu.%s", dir, (unsigned long)i,
+                                 strcmp(outputs[i].format, "PDF") == 0 ? "pdf"
+                                 : strcmp(outputs[i].format, "SVG") == 0 ? "svg" : "png");
+        if (filename == NULL) {
+            status = -1;
+            goto cleanup;
+        }
+        read_file(&outputs[i].result, &outputs[i].result_size, &error, filename);
+        free(filename);
+        if (outputs[i].result == NULL) {
+            *info = error;
+            status = -1;
+            goto cleanup;
+        }
+    }
+    goto cleanup;
+    /* cleanup all used resources */
+cleanup:
+    if (status != 0) {
+        for (i = 0; i < outputs_count; i++) {
+            free(outputs[i].result);
+            outputs[i].result = NULL;
+            outputs[i].result_size = 0;
+        }
+    }
+    free(commands);
+    free(pids);
+    free(start_times);
+    string_list_free(&owned_args);
+    return status;
+}
+
+/*! Lua code that profiles a LuaTeX run.
+ *
+ *  The CPU time between two events is attributed
+ *  to the source line read last,
+ *  within the environments entered via \ref PROFILE_ENVIRONMENTS.
+ *  Events are the reading of a source line
+ *  and the beginning and end of an environment.
+ *  At the end of the run, the times are written
+ *  to \c texput-profile.folded in the folded stack format
+ *  of flame graph tools, in microseconds.
+ */
+static const char *const profile_lua[] = {
+    "local times = {}\n",
+    "local stack = {}\n",
+    "local frame = ''\n",
+    "local position = '?'\n",
+    "local last = os.clock()\n",
+    "local function account()\n",
+    "  local now = os.clock()\n",
+    "  local key = frame .. position\n",
+    "  times[key] = (times[key] or 0) + (now - last)\n",
+    "  last = now\n",
+    "end\n",
+    "texcaller_profile = {}\n",
+    "function texcaller_profile.enter(name)\n",
+    "  account()\n",
+    "  stack[#stack + 1] = frame\n",
+    "  frame = frame .. name .. ';'\n",
+    "end\n",
+    "function texcaller_profile.leave()\n",
+    "  account()\n",
+    "  if #stack > 0 then\n",
+    "    frame = stack[#stack]\n",
+    "    stack[#stack] = nil\n",
+    "  end\n",
+    "end\n",
+    "local function line(buffer)\n",
+    "  account()\n",
+    "  position = (status.filename or '?') .. ':' .. (status.linenumber or 0)\n",
+    "  return buffer\n",
+    "end\n",
+    "local function stop()\n",
+    "  account()\n",
+    "  local keys = {}\n",
+    "  for key in pairs(times) do keys[#keys + 1] = key end\n",
+    "  table.sort(keys)\n",
+    "  local f = io.open('texput-profile.folded', 'w')\n",
+    "  for _, key in ipairs(keys) do\n",
+    "    local us = math.floor(times[key] * 1000000 + 0.5)\n",
+    "    if us > 0 then f:write(key, ' ', us, '\\n') end\n",
+    "  end\n",
+    "  f:close()\n",
+    "end\n",
+    "local add = callback.register\n",
+    "if luatexbase then\n",
+    "  add = function(name, f) luatexbase.add_to_callback(name, f, 'texcaller') end\n",
+    "end\n",
+    "add('process_input_buffer', line)\n",
+    "add('stop_run', stop)\n",
+    NULL
+};
+
+/*! TeX code that loads \ref profile_lua.
+ */
+#define PROFILE_PROLOGUE "\\directlua{dofile('texput-profile.lua')}"
+
+/*! TeX code that reports the beginning and end
+ *  of all LaTeX environments to \ref profile_lua.
+ */
+#define PROFILE_ENVIRONMENTS \
+    "\\let\\texcallerbegin\\begin" \
+    "\\let\\texcallerend\\end" \
+    "\\protected\\def\\begin#1{" \
+    "\\directlua{texcaller_profile.enter('\\luaescapestring{#1}')}" \
+    "\\texcallerbegin{#1}}" \
+    "\\protected\\def\\end#1{" \
+    "\\texcallerend{#1}" \
+    "\\directlua{texcaller_profile.leave()}}"
+
+/*! Profile a document by an additional LuaTeX run.
+ *
+ *  The run starts with the aux file of the conversion,
+ *  so it typesets the final document.
+ *
+ *  \return
+ *      0 on success, -1 on failure
+ *
+ *  \param profile
+ *      On success, \c profile will be set to a newly allocated string
+ *      that contains the folded stacks, see \ref profile_lua.
+ *      On failure, \c profile will be set to \c NULL.
+ *
+ *  \param info
+ *      On failure, \c info will be set to a newly allocated string
+ *      that contains the error message.
+ *      On success, or when out of memory,
+ *      \c info will be set to \c NULL.
+ *
+ *  \param dir
+ *      the directory containing \c texput.tex and \c texput.aux
+ *
+ *  \param source_format
+ *      \c "TeX" or \c "LaTeX"
+ *
+ *  \param priority
+ *      the priority of the child processes, or \c NULL to inherit it
+ */
+static int profile_document(char **profile, char **info, const char *dir, const char *source_format, const struct child_priority *priority)
+{
+    const int latex = strcmp(source_format, "LaTeX") == 0;
+    const char *args[8];
+    char *error;
+    char *lua_filename = NULL;
+    char *aux_filename = NULL;
+    char *profile_aux_filename = NULL;
+    char *folded_filename = NULL;
+    char *input_arg = NULL;
+    struct buffer lua = { NULL, 0, 0 };
+    char *aux;
+    size_t aux_size;
+    size_t profile_size;
+    size_t i;
+    int status = -1;
+    *profile = NULL;
+    *info = NULL;
+    lua_filename = sprintf_alloc("%s/texput-profile.lua", dir);
+    aux_filename = sprintf_alloc("%s/texput.aux", dir);
+    profile_aux_filename = sprintf_alloc("%s/texput-profile.aux", dir);
+    folded_filename = sprintf_alloc("%s/texput-profile.folded", dir);
+    input_arg = sprintf_alloc("%s%s\\input texput.tex ",
+                              PROFILE_PROLOGUE, latex ? PROFILE_ENVIRONMENTS : "");
+    if (   lua_filename == NULL || aux_filename == NULL || profile_aux_filename == NULL
+        || folded_filename == NULL || input_arg == NULL) {
+        goto cleanup;
+    }
+    for (i = 0; profile_lua[i] != NULL; i++) {
+        if (buffer_append(&lua, profile_lua[i], strlen(profile_lua[i])) != 0) {
+            goto cleanup;
+        }
+    }
+    if (write_file(info, lua_filename, lua.data, lua.size) != 0) {
+        goto cleanup;
+    }
+    /* resolve references as in the final run of the conversion */
+    read_file(&aux, &aux_size, &error, aux_filename);
+    free(error);
+    if (aux != NULL) {
+        if (write_file(info, profile_aux_filename, aux, aux_size) != 0) {
+            free(aux);
+            goto cleanup;
+        }
+        free(aux);
+    }
+    args[0] = latex ? "lualatex" : "luatex";
+    args[1] = "-interaction=batchmode";
+    args[2] = "-halt-on-error";
+    args[3] = "-no-shell-escape";
+    args[4] = "-jobname=texput-profile";
+    args[5] = input_arg;
+    args[6] = NULL;
+    if (run_command(info, dir, args, NULL, priority, NULL) != 0) {
+        goto cleanup;
+    }
+    read_file(profile, &profile_size, &error, folded_filename);
+    if (*profile == NULL) {
+        *info = error;
+        goto cleanup;
+    }
+    status = 0;
+cleanup:
+    free(lua_filename);
+    free(aux_filename);
+    free(profile_aux_filename);
+    free(folded_filename);
+    free(input_arg);
+    free(lua.data);
+    return status;
+}
+
+/*! Kinds of tokens of the PDF syntax.
+ */
+enum pdf_token_type {
+    PDF_END,
+    PDF_INTEGER,
+    PDF_REAL,
+    PDF_NAME,
+    PDF_STRING,
+    PDF_DICT_BEGIN,
+    PDF_DICT_END,
+    PDF_ARRAY_BEGIN,
+    PDF_ARRAY_END,
+    PDF_KEYWORD
+};
+
+/*! A token of the PDF syntax, such as a number or a name.
+ */
+struct pdf_token {
+    enum pdf_token_type type;
+    const char *start;
+    const char *end;
+};
+
+/*! Check whether a character is PDF whitespace.
+ */
+static int pdf_is_space(char c)
+{
+    return c == '\0' || c == '\t' || c == '\n' || c == '\f' || c == '\r' || c == ' ';
+}
+
+/*! Check whether a character is a PDF delimiter.
+ */
+static int pdf_is_delimiter(char c)
+{
+    return c != '\0' && strchr("()<>[]{}/%", c) != NULL;
+}
+
+/*! Read the next token.
+ *
+ *  Whitespace and comments are skipped.
+ *
+ *  \return
+ *      the position after the token
+ *
+ *  \param token
+ *      will be set to the token,
+ *      which is of type \c PDF_END at the end of the data
+ *
+ *  \param p
+ *      the position to start reading
+ *
+ *  \param end
+ *      the end of the data
+ */
+static const char *pdf_next_token(struct pdf_token *token, const char *p, const char *end)
+{
+    for (;;) {
+        while (p < end && pdf_is_space(*p)) {
+            p++;
+        }
+        if (p < end && *p == '%') {
+            while (p < end && *p != '\r' && *p != '\n') {
+                p++;
+            }
+            continue;
+        }
+        break;
+    }
+    token->start = p;
+    if (p == end) {
+        token->type = PDF_END;
+    } else if (*p == '(') {
+        int depth = 0;
+        token->type = PDF_STRING;
+        for (; p < end; p++) {
+            if (*p == '\\') {
+                p++;
+            } else if (*p == '(') {
+                depth++;
+            } else if (*p == ')' && --depth == 0) {
+                p++;
+                break;
+            }
+        }
+        if (p > end) {
+            p = end;
+        }
+    } else if (*p == '<' && p + 1 < end && p[1] == '<') {
+        token->type = PDF_DICT_BEGIN;
+        p += 2;
+    } else if (*p == '>' && p + 1 < end && p[1] == '>') {
+        token->type = PDF_DICT_END;
+        p += 2;
+    } else if (*p == '<') {
+        token->type = PDF_STRING;
+        while (p < end && *p != '>') {
+            p++;
+        }
+        if (p < end) {
+            p++;
+        }
+    } else if (*p == '[') {
+        token->type = PDF_ARRAY_BEGIN;
+        p++;
+    } else if (*p == ']') {
+        token->type = PDF_ARRAY_END;
+        p++;
+    } else if (*p == '/') {
+        token->type = PDF_NAME;
+        p++;
+        while (p < end && !pdf_is_space(*p) && !pdf_is_delimiter(*p)) {
+            p++;
+        }
+    } else if (pdf_is_delimiter(*p)) {
+        token->type = PDF_KEYWORD;
+        p++;
+    } else {
+        const char *q;
+        int digits = 0;
+        int dots = 0;
+        while (p < end && !pdf_is_space(*p) && !pdf_is_delimiter(*p)) {
+            p++;
+        }
+        q = token->start;
+        if (*q == '+' || *q == '-') {
+            q++;
+        }
+        for (; q < p; q++) {
+            if (*q >= '0' && *q <= '9') {
+                digits++;
+            } else if (*q == '.') {
+                dots++;
+            } else {
+                break;
+            }
+        }
+        if (q < p || digits == 0 || dots > 1) {
+            token->type = PDF_KEYWORD;
+        } else {
+            token->type = dots == 0 ? PDF_INTEGER : PDF_REAL;
+        }
+    }
+    token->end = p;
+    return p;
+}
+
+/*! Check whether a token is the given keyword or name.
+ */
+static int pdf_token_is(const struct pdf_token *token, const char *s)
+{
+    return (size_t)(token->end - token->start) == strlen(s)
+        && memcmp(token->start, s, token->end - token->start) == 0;
+}
+
+/*! Determine the value of an integer token, which must not be negative.
+ */
+static size_t pdf_token_integer(const struct pdf_token *token)
+{
+    size_t value = 0;
+    const char *p;
+    for (p = token->start; p < token->end; p++) {
+        if (*p >= '0' && *p <= '9') {
+            value = 10 * value + (*p - '0');
+        }
+    }
+    return value;
+}
+
+/*! Check for an indirect reference such as <tt>12 0 R</tt>.
+ *
+ *  \return
+ *      the position after the reference,
+ *      or \c NULL if there isn't any reference
+ *
+ *  \param number
+ *      will be set to the referenced object number
+ *
+ *  \param token
+ *      the token that might start a reference
+ *
+ *  \param end
+ *      the end of the data
+ */
+static const char *pdf_reference(size_t *number, const struct pdf_token *token, const char *end)
+{
+    struct pdf_token generation;
+    struct pdf_token r;
+    const char *p;
+    if (token->type != PDF_INTEGER) {
+        return NULL;
+    }
+    p = pdf_next_token(&generation, token->end, end);
+    if (generation.type != PDF_INTEGER) {
+        return NULL;
+    }
+    p = pdf_next_token(&r, p, end);
+    if (r.type != PDF_KEYWORD || !pdf_token_is(&r, "R")) {
+        return NULL;
+    }
+    *number = pdf_token_integer(token);
+    return p;
+}
+
+/*! Skip a single value, such as a dictionary or a reference.
+ *
+ *  \return
+ *      the position after the value, or \c NULL if it is malformed
+ */
+static const char *pdf_skip_value(const char *p, const char *end)
+{
+    struct pdf_token token;
+    int depth = 0;
+    do {
+        const char *after_reference;
+        size_t number;
+        p = pdf_next_token(&token, p, end);
+        switch (token.type) {
+        case PDF_END:
+            return NULL;
+        case PDF_DICT_BEGIN:
+        case PDF_ARRAY_BEGIN:
+            depth++;
+            break;
+        case PDF_DICT_END:
+        case PDF_ARRAY_END:
+            if (--depth < 0) {
+                return NULL;
+            }
+            break;
+        case PDF_INTEGER:
+            after_reference = pdf_reference(&number, &token, end);
+            if (after_reference != NULL) {
+                p = after_reference;
+            }
+            break;
+        default:
+            break;
+        }
+    } while (depth > 0);
+    return p;
+}
+
+/*! Look up a key of a dictionary.
+ *
+ *  \return
+ *      0 if found, -1 if not found or malformed
+ *
+ *  \param value
+ *      will be set to the start of the value
+ *
+ *  \param value_end
+ *      will be set to the end of the value
+ *
+ *  \param p
+ *      the start of the dictionary
+ *
+ *  \param end
+ *      the end of the data
+ *
+ *  \param key
+ *      the key to look up, such as \c "/Root"
+ */
+static int pdf_dict_get(const char **value, const char **value_end, const char *p, const char *end, const char *key)
+{
+    struct pdf_token token;
+    p = pdf_next_token(&token, p, end);
+    if (token.type != PDF_DICT_BEGIN) {
+        return -1;
+    }
+    for (;;) {
+        p = pdf_next_token(&token, p, end);
+        if (token.type != PDF_NAME) {
+            return -1;
+        }
+        if (pdf_token_is(&token, key)) {
+            pdf_next_token(&token, p, end);
+            *value = token.start;
+            *value_end = pdf_skip_value(p, end);
+            return *value_end == NULL ? -1 : 0;
+        }
+        p = pdf_skip_value(p, end);
+        if (p == NULL) {
+            return -1;
+        }
+    }
+}
+
+/*! Look up a key of a dictionary whose value is a reference.
+ *
+ *  \return
+ *      0 if found, -1 if not found or not a reference
+ */
+static int pdf_dict_get_reference(size_t *number, const char *p, const char *end, const char *key)
+{
+    const char *value;
+    const char *value_end;
+    struct pdf_token token;
+    if (pdf_dict_get(&value, &value_end, p, end, key) != 0) {
+        return -1;
+    }
+    pdf_next_token(&token, value, value_end);
+    return pdf_reference(number, &token, value_end) == NULL ? -1 : 0;
+}
+
+/*! A PDF file with a classic cross-reference table.
+ *
+ *  Cross-reference streams and object streams are not supported,
+ *  so pdfTeX has to be run with <tt>\\pdfobjcompresslevel=0</tt>.
+ *  Content streams may still be compressed,
+ *  because they are never decompressed.
+ */
+struct pdf_document {
+    /*! content of the file */
+    const char *data;
+    /*! size of \c data */
+    size_t size;
+    /*! file offset of every object, or 0 for free objects */
+    size_t *offsets;
+    /*! number of elements in \c offsets */
+    size_t objects_count;
+    /*! object number of the document catalog */
+    size_t root;
+};
+
+/*! Parse the cross-reference table and trailer of a PDF file.
+ *
+ *  \return
+ *      0 on success, -1 on failure
+ *
+ *  \param error
+ *      On failure, \c error will be set to a newly allocated string
+ *      that contains the error message.
+ *      On success, or when out of memory,
+ *      \c error will be set to \c NULL.
+ *
+ *  \param doc
+ *      the document to initialize,
+ *      which has to be freed via free(doc->offsets)
+ *
+ *  \param data
+ *      content of the PDF file
+ *
+ *  \param size
+ *      size of \c data
+ */
+static int pdf_parse(char **error, struct pdf_document *doc, const char *data, size_t size)
+{
+    const char startxref[] = "startxref";
+    const size_t startxref_length = sizeof(startxref) - 1;
+    const char *end = data + size;
+    const char *p;
+    const char *value;
+    const char *value_end;
+    struct pdf_token token;
+    size_t i;
+    *error = NULL;
+    doc->data = data;
+    doc->size = size;
+    doc->offsets = NULL;
+    doc->objects_count = 0;
+    doc->root = 0;
+    /* find offset of the cross-reference table */
+    for (i = size >= startxref_length ? size - startxref_length + 1 : 0; i > 0; i--) {
+        if (memcmp(data + i - 1, startxref, startxref_length) == 0) {
+            break;
+        }
+    }
+    if (i == 0) {
+        *error = sprintf_alloc("Unable to find \"startxref\" in PDF.");
+        return -1;
+    }
+    pdf_next_token(&token, data + i - 1 + startxref_length, end);
+    if (token.type != PDF_INTEGER || pdf_token_integer(&token) >= size) {
+        *error = sprintf_alloc("Invalid \"startxref\" in PDF.");
+        return -1;
+    }
+    p = pdf_next_token(&token, data + pdf_token_integer(&token), end);
+    if (token.type != PDF_KEYWORD || !pdf_token_is(&token, "xref")) {
+        *error = sprintf_alloc("PDF doesn't have a classic cross-reference table.");
+        return -1;
+    }
+    /* read all subsections of the cross-reference table */
+    for (;;) {
+        size_t first;
+        size_t count;
+        p = pdf_next_token(&token, p, end);
+        if (token.type == PDF_KEYWORD && pdf_token_is(&token, "trailer")) {
+            break;
+        }
+        if (token.type != PDF_INTEGER) {
+            goto invalid;
+        }
+        first = pdf_token_integer(&token);
+        p = pdf_next_token(&token, p, end);
+        if (token.type != PDF_INTEGER) {
+            goto invalid;
+        }
+        count = pdf_token_integer(&token);
+        if (count > size / 20 || first > size / 20) {
+            goto invalid;
+        }
+        if (first + count > doc->objects_count) {
+            size_t *offsets = (size_t *)realloc(doc->offsets, (first + count) * sizeof(size_t));
+            if (offsets == NULL) {
+                goto cleanup;
+            }
+            memset(offsets + doc->objects_count, 0, (first + count - doc->objects_count) * sizeof(size_t));
+            doc->offsets = offsets;
+            doc->objects_count = first + count;
+        }
+        for (i = first; i < first + count; i++) {
+            size_t offset;
+            p = pdf_next_token(&token, p, end);
+            if (token.type != PDF_INTEGER) {
+                goto invalid;
+            }
+            offset = pdf_token_integer(&token);
+            p = pdf_next_token(&token, p, end);
+            if (token.type != PDF_INTEGER) {
+                goto invalid;
+            }
+            p = pdf_next_token(&token, p, end);
+            if (token.type != PDF_KEYWORD) {
+                goto invalid;
+            }
+            doc->offsets[i] = pdf_token_is(&token, "n") && offset < size ? offset : 0;
+        }
+    }
+    /* read trailer */
+    if (pdf_dict_get(&value, &value_end, p, end, "/Prev") == 0) {
+        *error = sprintf_alloc("PDF with incremental updates is not supported.");
+        goto cleanup;
+    }
+    if (pdf_dict_get_reference(&doc->root, p, end, "/Root") != 0) {
+        goto invalid;
+    }
+    return 0;
+invalid:
+    *error = sprintf_alloc("Invalid cross-reference table in PDF.");
+cleanup:
+    free(doc->offsets);
+    doc->offsets = NULL;
+    return -1;
+}
+
+/*! Locate the value of an object of a PDF file, ignoring any stream.
+ *
+ *  \return
+ *      0 on success, -1 if the object is free or malformed
+ *
+ *  \param body
+ *      will be set to the start of the object's value
+ *
+ *  \param body_end
+ *      will be set to the end of the object's value
+ *
+ *  \param doc
+ *      the document
+ *
+ *  \param number
+ *      the object number
+ */
+static int pdf_object_value(const char **body, const char **body_end, const struct pdf_document *doc, size_t number)
+{
+    const char *end = doc->data + doc->size;
+    const char *p;
+    struct pdf_token token;
+    if (number >= doc->objects_count || doc->offsets[number] == 0) {
+        return -1;
+    }
+    p = pdf_next_token(&token, doc->data + doc->offsets[number], end);
+    if (token.type != PDF_INTEGER || pdf_token_integer(&token) != number) {
+        return -1;
+    }
+    p = pdf_next_token(&token, p, end);
+    if (token.type != PDF_INTEGER) {
+        return -1;
+    }
+    p = pdf_next_token(&token, p, end);
+    if (token.type != PDF_KEYWORD || !pdf_token_is(&token, "obj")) {
+        return -1;
+    }
+    pdf_next_token(&token, p, end);
+    *body = token.start;
+    *body_end = pdf_skip_value(p, end);
+    return *body_end == NULL ? -1 : 0;
+}
+
+/*! Locate an object of a PDF file.
+ *
+ *  An indirect \c /Length of a stream is resolved only one level:
+ *  the referenced object has to be a plain integer, not a stream.
+ *
+ *  \return
+ *      0 on success, -1 if the object is free or malformed
+ *
+ *  \param body
+ *      will be set to the start of the object's value
+ *
+ *  \param body_end
+ *      will be set to the end of the object's value
+ *
+ *  \param stream
+ *      will be set to the data of the object's stream,
+ *      or \c NULL if the object is not a stream
+ *
+ *  \param stream_size
+ *      will be set to the size of \c stream
+ *
+ *  \param doc
+ *      the document
+ *
+ *  \param number
+ *      the object number
+ */
+static int pdf_object(const char **body, const char **body_end, const char **stream, size_t *stream_size, const struct pdf_document *doc, size_t number)
+{
+    const char *end = doc->data + doc->size;
+    const char *p;
+    struct pdf_token token;
+    if (pdf_object_value(body, body_end, doc, number) != 0) {
+        return -1;
+    }
+    p = pdf_next_token(&token, *body_end, end);
+    *stream = NULL;
+    *stream_size = 0;
+    if (token.type == PDF_KEYWORD && pdf_token_is(&token, "stream")) {
+        const char *value;
+        const char *value_end;
+        size_t length_number;
+        if (pdf_dict_get(&value, &value_end, *body, *body_end, "/Length") != 0) {
+            return -1;
+        }
+        pdf_next_token(&token, value, value_end);
+        if (pdf_reference(&length_number, &token, value_end) != NULL) {
+            const char *length_body;
+            const char *length_body_end;
+            struct pdf_token after;
+            if (pdf_object_value(&length_body, &length_body_end, doc, length_number) != 0) {
+                return -1;
+            }
+            pdf_next_token(&after, length_body_end, end);
+            if (after.type == PDF_KEYWORD && pdf_token_is(&after, "stream")) {
+                return -1;
+            }
+            pdf_next_token(&token, length_body, length_body_end);
+            if (token.end != length_body_end) {
+                return -1;
+            }
+        }
+        if (token.type != PDF_INTEGER) {
+            return -1;
+        }
+        *stream_size = pdf_token_integer(&token);
+        if (p < end && *p == '\r') {
+            p++;
+        }
+        if (p < end && *p == '\n') {
+            p++;
+        }
+        if (*stream_size > (size_t)(end - p)) {
+            return -1;
+        }
+        *stream = p;
+    }
+    return 0;
+}
+
+/*! Page attributes which pages inherit from the page tree.
+ */
+static const char *const pdf_inheritable_keys[] = {
+    "/Resources", "/MediaBox", "/CropBox", "/Rotate"
+};
+
+/*! Number of elements in \ref pdf_inheritable_keys.
+ */
+#define PDF_INHERITABLE_KEYS_COUNT 4
+
+/*! A page of a PDF file.
+ */
+struct pdf_page {
+    /*! object number of the page */
+    size_t number;
+    /*! start of the values of \ref pdf_inheritable_keys
+     *  inherited from the page tree, or \c NULL */
+    const char *inherited[PDF_INHERITABLE_KEYS_COUNT];
+    /*! end of the values in \c inherited */
+    const char *inherited_end[PDF_INHERITABLE_KEYS_COUNT];
+};
+
+/*! The pages of a PDF file, in order.
+ */
+struct pdf_pages {
+    struct pdf_page *items;
+    size_t count;
+    size_t capacity;
+    /*! for every object, whether it is an inner node of the page tree */
+    char *is_tree_node;
+};
+
+/*! Collect all pages of a page tree node.
+ *
+ *  \return
+ *      0 on success, -1 on failure
+ *
+ *  \param pages
+ *      the list the pages are added to
+ *
+ *  \param doc
+ *      the document
+ *
+ *  \param number
+ *      the object number of the page tree node
+ *
+ *  \param parent
+ *      the inherited attributes of the parent node
+ *
+ *  \param depth
+ *      the depth of the node, to guard against cycles
+ */
+static int pdf_collect_pages(struct pdf_pages *pages, const struct pdf_document *doc, size_t number, const struct pdf_page *parent, int depth)
+{
+    const char *body;
+    const char *body_end;
+    const char *stream;
+    size_t stream_size;
+    const char *value;
+    const char *value_end;
+    struct pdf_page node;
+    struct pdf_token token;
+    const char *p;
+    size_t i;
+    if (depth > 64 || pdf_object(&body, &body_end, &stream, &stream_size, doc, number) != 0) {
+        return -1;
+    }
+    node = *parent;
+    node.number = number;
+    for (i = 0; i < PDF_INHERITABLE_KEYS_COUNT; i++) {
+        if (pdf_dict_get(&value, &value_end, body, body_end, pdf_inheritable_keys[i]) == 0) {
+            node.inherited[i] = value;
+            node.inherited_end[i] = value_end;
+        }
+    }
+    /* add page */
+    if (pdf_dict_get(&value, &value_end, body, body_end, "/Kids") != 0) {
+        if (pages->count == pages->capacity) {
+            size_t capacity = pages->capacity == 0 ? 16 : 2 * pages->capacity;
+            struct pdf_page *items = (struct pdf_page *)realloc(pages->items, capacity * sizeof(struct pdf_page));
+            if (items == NULL) {
+                return -1;
+            }
+            pages->items = items;
+            pages->capacity = capacity;
+        }
+        pages->items[pages->count++] = node;
+        return 0;
+    }
+    /* add pages of all kids */
+    pages->is_tree_node[number] = 1;
+    p = pdf_next_token(&token, value, value_end);
+    if (token.type != PDF_ARRAY_BEGIN) {
+        return -1;
+    }
+    for (;;) {
+        size_t kid;
+        p = pdf_next_token(&token, p, value_end);
+        if (token.type == PDF_ARRAY_END) {
+            return 0;
+        }
+        p = pdf_reference(&kid, &token, value_end);
+        if (p == NULL || pdf_collect_pages(pages, doc, kid, &node, depth + 1) != 0) {
+            return -1;
+        }
+    }
+}
+
+/*! Collect all pages of a PDF file, in order.
+ *
+ *  \return
+ *      0 on success, -1 on failure
+ *
+ *  \param pages
+ *      the list to initialize,
+ *      which has to be freed via pdf_pages_free()
+ *
+ *  \param doc
+ *      the document
+ */
+static int pdf_pages_init(struct pdf_pages *pages, const struct pdf_document *doc)
+{
+    const char *body;
+    const char *body_end;
+    const char *stream;
+    size_t stream_size;
+    size_t number;
+    struct pdf_page root;
+    size_t i;
+    pages->items = NULL;
+    pages->count = 0;
+    pages->capacity = 0;
+    pages->is_tree_node = (char *)calloc(doc->objects_count + 1, 1);
+    if (pages->is_tree_node == NULL) {
+        return -1;
+    }
+    root.number = 0;
+    for (i = 0; i < PDF_INHERITABLE_KEYS_COUNT; i++) {
+        root.inherited[i] = NULL;
+        root.inherited_end[i] = NULL;
+    }
+    if (   pdf_object(&body, &body_end, &stream, &stream_size, doc, doc->root) != 0
+        || pdf_dict_get_reference(&number, body, body_end, "/Pages") != 0) {
+        return -1;
+    }
+    return pdf_collect_pages(pages, doc, number, &root, 0);
+}
+
+/*! Free all resources of a list of pages.
+ */
+static void pdf_pages_free(struct pdf_pages *pages)
+{
+    free(pages->items);
+    free(pages->is_tree_node);
+}
+
+/*! Object number of the document catalog written by \ref pdf_writer.
+ */
+#define PDF_CATALOG_NUMBER 1
+
+/*! Object number of the page tree root written by \ref pdf_writer.
+ */
+#define PDF_PAGES_NUMBER 2
+
+/*! An object written by \ref pdf_writer, for deduplication.
+ */
+struct pdf_dedup_entry {
+    /*! SHA-256 digest of the renumbered object,
+     *  so different objects are never merged,
+     *  without keeping the written objects in memory */
+    unsigned char digest[32];
+    /*! object number, or 0 for unused entries */
+    size_t number;
+};
+
+/*! Size of the output buffer of a \ref pdf_writer writing to a file.
+ */
+#define PDF_WRITER_BUFFER_SIZE 65536
+
+/*! A PDF file being written.
+ *
+ *  The document catalog and a flat page tree
+ *  are written by pdf_writer_finish(),
+ *  after the pages have been copied via pdf_copy_pages().
+ *
+ *  When writing to a file descriptor,
+ *  memory usage doesn't depend on the size of the copied objects,
+ *  but only on their number.
+ */
+struct pdf_writer {
+    /*! the file descriptor to write to, or -1 to keep \c output */
+    int fd;
+    /*! the data not yet written to \c fd */
+    struct buffer output;
+    /*! total size of the PDF so far */
+    size_t position;
+    /*! \c errno of a failed write, or 0 */
+    int write_errno;
+    /*! file offset of every object, or 0 if not written yet */
+    size_t *offsets;
+    /*! number of allocated object numbers, including object 0 */
+    size_t objects_count;
+    /*! number of elements allocated for \c offsets */
+    size_t objects_capacity;
+    /*! references to all pages, such as <tt>"5 0 R 9 0 R "</tt> */
+    struct buffer kids;
+    /*! number of pages */
+    size_t pages_count;
+    /*! whether identical objects are written only once */
+    int deduplicate;
+    /*! hash table of all written objects, if \c deduplicate */
+    struct pdf_dedup_entry *dedup;
+    /*! number of used entries in \c dedup */
+    size_t dedup_count;
+    /*! number of entries in \c dedup, a power of 2 */
+    size_t dedup_capacity;
+};
+
+/*! Initialize a PDF writer.
+ *
+ *  \param writer
+ *      the writer to initialize,
+ *      which has to be freed via pdf_writer_free()
+ *
+ *  \param fd
+ *      the file descriptor to write to,
+ *      or -1 to collect the PDF in <tt>writer->output</tt>
+ *
+ *  \param deduplicate
+ *      whether to write identical objects only once,
+ *      such as fonts and images shared by several documents
+ */
+static void pdf_writer_init(struct pdf_writer *writer, int fd, int deduplicate)
+{
+    writer->fd = fd;
+    writer->position = 0;
+    writer->write_errno = 0;
+    writer->output.data = NULL;
+    writer->output.size = 0;
+    writer->output.capacity = 0;
+    writer->offsets = NULL;
+    writer->objects_count = PDF_PAGES_NUMBER + 1;
+    writer->objects_capacity = 0;
+    writer->kids.data = NULL;
+    writer->kids.size = 0;
+    writer->kids.capacity = 0;
+    writer->pages_count = 0;
+    writer->deduplicate = deduplicate;
+    writer->dedup = NULL;
+    writer->dedup_count = 0;
+    writer->dedup_capacity = 0;
+}
+
+/*! Free all resources of a PDF writer.
+ */
+static void pdf_writer_free(struct pdf_writer *writer)
+{
+    free(writer->output.data);
+    free(writer->offsets);
+    free(writer->kids.data);
+    free(writer->dedup);
+}
+
+/*! Write the buffered data of a PDF file to its file descriptor.
+ *
+ *  \return
+ *      0 on success, -1 on failure,
+ *      in which case <tt>writer->write_errno</tt> is set
+ */
+static int pdf_writer_flush(struct pdf_writer *writer)
+{
+    size_t written = 0;
+    while (written < writer->output.size) {
+        const ssize_t n = write(writer->fd, writer->output.data + written, writer->output.size - written);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n == -1) {
+            writer->write_errno = errno;
+            return -1;
+        }
+        written += n;
+    }
+    writer->output.size = 0;
+    return 0;
+}
+
+/*! Append data to a PDF file.
+ *
+ *  \return
+ *      0 on success, -1 on failure
+ */
+static int pdf_write(struct pdf_writer *writer, const char *data, size_t size)
+{
+    if (buffer_append(&writer->output, data, size) != 0) {
+        return -1;
+    }
+    writer->position += size;
+    if (writer->fd != -1 && writer->output.size >= PDF_WRITER_BUFFER_SIZE) {
+        return pdf_writer_flush(writer);
+    }
+    return 0;
+}
+
+/*! Append a formatted number to a PDF file.
+ *
+ *  \return
+ *      0 on success, -1 if out of memory
+ *
+ *  \param writer
+ *      the writer
+ *
+ *  \param format
+ *      a format string for a single <tt>unsigned long</tt>
+ *
+ *  \param number
+ *      the number to format
+ */
+static int pdf_write_number(struct pdf_writer *writer, const char *format, size_t number)
+{
+    char s[64];
+    sprintf(s, format, (unsigned long)number);
+    return pdf_write(writer, s, strlen(s));
+}
+
+/*! Allocate a new object number.
+ *
+ *  \return
+ *      the object number, or 0 if out of memory
+ */
+static size_t pdf_writer_reserve(struct pdf_writer *writer)
+{
+    if (writer->objects_count >= writer->objects_capacity) {
+        size_t capacity = writer->objects_capacity == 0 ? 256 : 2 * writer->objects_capacity;
+        size_t *offsets = (size_t *)realloc(writer->offsets, capacity * sizeof(size_t));
+        if (offsets == NULL) {
+            return 0;
+        }
+        memset(offsets + writer->objects_capacity, 0, (capacity - writer->objects_capacity) * sizeof(size_t));
+        writer->offsets = offsets;
+        writer->objects_capacity = capacity;
+    }
+    return writer->objects_count++;
+}
+
+/*! Write the header of a PDF file.
+ *
+ *  The PDF version is taken over from the given document,
+ *  if not \c NULL.
+ *
+ *  \return
+ *      0 on success, -1 if out of memory
+ */
+static int pdf_writer_begin(struct pdf_writer *writer, const struct pdf_document *doc)
+{
+    const char *version = "%PDF-1.5";
+    size_t number;
+    if (doc != NULL && doc->size >= 8 && memcmp(doc->data, "%PDF-1.", 7) == 0) {
+        version = doc->data;
+    }
+    /* make room for the document catalog and page tree */
+    number = pdf_writer_reserve(writer);
+    if (number == 0) {
+        return -1;
+    }
+    writer->objects_count = number;
+    return pdf_write(writer, version, 8) != 0
+        || pdf_write(writer, "\n%\320\324\305\330\n", 7) != 0 ? -1 : 0;
+}
+
+/*! Write an object to a PDF file.
+ *
+ *  \return
+ *      0 on success, -1 if out of memory
+ *
+ *  \param writer
+ *      the writer
+ *
+ *  \param number
+ *      the object number, as returned by pdf_writer_reserve()
+ *
+ *  \param body
+ *      the value of the object
+ *
+ *  \param body_size
+ *      size of \c body
+ *
+ *  \param stream
+ *      the data of the object's stream,
+ *      or \c NULL if the object is not a stream
+ *
+ *  \param stream_size
+ *      size of \c stream
+ */
+static int pdf_write_object(struct pdf_writer *writer, size_t number, const char *body, size_t body_size, const char *stream, size_t stream_size)
+{
+    if (number >= writer->objects_capacity) {
+        return -1;
+    }
+    writer->offsets[number] = writer->position;
+    if (   pdf_write_number(writer, "%lu 0 obj\n", number) != 0
+        || pdf_write(writer, body, body_size) != 0) {
+        return -1;
+    }
+    if (stream != NULL) {
+        if (   pdf_write(writer, "\nstream\n", 8) != 0
+            || pdf_write(writer, stream, stream_size) != 0
+            || pdf_write(writer, "\nendstream", 10) != 0) {
+            return -1;
+        }
+    }
+    return pdf_write(writer, "\nendobj\n", 8);
+}
+
+/*! Write the document catalog, page tree, cross-reference table
+ *  and trailer of a PDF file.
+ *
+ *  \return
+ *      0 on success, -1 if out of memory
+ */
+static int pdf_writer_finish(struct pdf_writer *writer)
+{
+    const char catalog[] = "<< /Type /Catalog /Pages 2 0 R >>";
+    size_t xref_offset;
+    size_t i;
+    writer->offsets[PDF_CATALOG_NUMBER] = writer->position;
+    if (   pdf_write_number(writer, "%lu 0 obj\n", PDF_CATALOG_NUMBER) != 0
+        || pdf_write(writer, catalog, sizeof(catalog) - 1) != 0
+        || pdf_write(writer, "\nendobj\n", 8) != 0) {
+        return -1;
+    }
+    writer->offsets[PDF_PAGES_NUMBER] = writer->position;
+    if (   pdf_write_number(writer, "%lu 0 obj\n", PDF_PAGES_NUMBER) != 0
+        || pdf_write_number(writer, "<< /Type /Pages /Count %lu /Kids [ ", writer->pages_count) != 0
+        || (writer->kids.size > 0 && pdf_write(writer, writer->kids.data, writer->kids.size) != 0)
+        || pdf_write(writer, "] >>\nendobj\n", 12) != 0) {
+        return -1;
+    }
+    xref_offset = writer->position;
+    if (   pdf_write_number(writer, "xref\n0 %lu\n", writer->objects_count) != 0
+        || pdf_write(writer, "0000000000 65535 f \n", 20) != 0) {
+        return -1;
+    }
+    for (i = 1; i < writer->objects_count; i++) {
+        if (pdf_write_number(writer, "%010lu 00000 n \n", writer->offsets[i]) != 0) {
+            return -1;
+        }
+    }
+    if (   pdf_write_number(writer, "trailer\n<< /Size %lu /Root 1 0 R >>\n", writer->objects_count) != 0
+        || pdf_write_number(writer, "startxref\n%lu\n%%%%EOF\n", xref_offset) != 0) {
+        return -1;
+    }
+    return writer->fd != -1 ? pdf_writer_flush(writer) : 0;
+}
+
+/*! Look up an object with the given digest, or add it.
+ *
+ *  \return
+ *      the number of the object with the given digest,
+ *      which is \c number if there wasn't any yet,
+ *      or 0 if out of memory
+ *
+ *  \param writer
+ *      the writer
+ *
+ *  \param digest
+ *      the SHA-256 digest of the renumbered object, including its stream
+ *
+ *  \param number
+ *      the number of the object if it is new
+ */
+static size_t pdf_writer_dedup(struct pdf_writer *writer, const unsigned char digest[32], size_t number)
+{
+    const size_t slot = ((size_t)digest[0] << 24) | ((size_t)digest[1] << 16) | ((size_t)digest[2] << 8) | digest[3];
+    size_t i;
+    /* grow hash table at half load */
+    if (2 * (writer->dedup_count + 1) > writer->dedup_capacity) {
+        const size_t capacity = writer->dedup_capacity == 0 ? 1024 : 2 * writer->dedup_capacity;
+        struct pdf_dedup_entry *dedup = (struct pdf_dedup_entry *)calloc(capacity, sizeof(struct pdf_dedup_entry));
+        if (dedup == NULL) {
+            return 0;
+        }
+        for (i = 0; i < writer->dedup_capacity; i++) {
+            const struct pdf_dedup_entry *entry = &writer->dedup[i];
+            size_t j;
+            if (entry->number == 0) {
+                continue;
+            }
+            for (j = (((size_t)entry->digest[0] << 24) | ((size_t)entry->digest[1] << 16)
+                      | ((size_t)entry->digest[2] << 8) | entry->digest[3]) & (capacity - 1);
+                 dedup[j].number != 0;
+                 j = (j + 1) & (capacity - 1)) {
+            }
+            dedup[j] = *entry;
+        }
+        free(writer->dedup);
+        writer->dedup = dedup;
+        writer->dedup_capacity = capacity;
+    }
+    /* look up object, adding it if not found */
+    for (i = slot & (writer->dedup_capacity - 1);
+         writer->dedup[i].number != 0;
+         i = (i + 1) & (writer->dedup_capacity - 1)) {
+        if (memcmp(writer->dedup[i].digest, digest, 32) == 0) {
+            return writer->dedup[i].number;
+        }
+    }
+    memcpy(writer->dedup[i].digest, digest, 32);
+    writer->dedup[i].number = number;
+    writer->dedup_count++;
+    return number;
+}
+
+/*! Marks an object that is replaced by \c null when copying.
+ *
+ *  \see pdf_copy
+ */
+#define PDF_NULL ((size_t)-1)
+
+/*! State of copying pages from one PDF file to another.
+ */
+struct pdf_copy {
+    /*! the writer to copy to */
+    struct pdf_writer *writer;
+    /*! the document to copy from */
+    const struct pdf_document *doc;
+    /*! all pages of \c doc */
+    const struct pdf_pages *pages;
+    /*! for every object of \c doc,
+     *  its object number in \c writer,
+     *  \ref PDF_NULL if it must not be copied,
+     *  or 0 if not assigned yet */
+    size_t *mapped;
+    /*! for every object of \c doc,
+     *  1 while being copied and 2 when copied */
+    char *state;
+};
+
+static int pdf_copy_object(struct pdf_copy *copy, size_t number);
+
+/*! Copy a value, renumbering all its references.
+ *
+ *  All referenced objects are copied as well.
+ *
+ *  \return
+ *      0 on success, -1 on failure
+ *
+ *  \param copy
+ *      the copy state
+ *
+ *  \param text
+ *      the buffer to append the renumbered value to
+ *
+ *  \param p
+ *      the start of the value
+ *
+ *  \param end
+ *      the end of the value
+ */
+static int pdf_copy_value(struct pdf_copy *copy, struct buffer *text, const char *p, const char *end)
+{
+    const char *copied = p;
+    struct pdf_token token;
+    for (;;) {
+        const char *after_reference;
+        size_t number;
+        p = pdf_next_token(&token, p, end);
+        if (token.type == PDF_END) {
+            return buffer_append(text, copied, end - copied);
+        }
+        after_reference = pdf_reference(&number, &token, end);
+        if (after_reference == NULL) {
+            continue;
+        }
+        if (buffer_append(text, copied, token.start - copied) != 0) {
+            return -1;
+        }
+        if (   number >= copy->doc->objects_count
+            || copy->doc->offsets[number] == 0
+            || copy->mapped[number] == PDF_NULL) {
+            if (buffer_append(text, "null", 4) != 0) {
+                return -1;
+            }
+        } else {
+            char s[64];
+            if (copy->state[number] == 0 && pdf_copy_object(copy, number) != 0) {
+                return -1;
+            }
+            /* reference within a cycle */
+            if (copy->mapped[number] == 0) {
+                copy->mapped[number] = pdf_writer_reserve(copy->writer);
+                if (copy->mapped[number] == 0) {
+                    return -1;
+                }
+            }
+            sprintf(s, "%lu 0 R", (unsigned long)copy->mapped[number]);
+            if (buffer_append(text, s, strlen(s)) != 0) {
+                return -1;
+            }
+        }
+        p = copied = after_reference;
+    }
+}
+
+/*! Write a copied object.
+ *
+ *  If the writer deduplicates objects,
+ *  an identical object written before is used instead,
+ *  unless this object is part of a reference cycle.
+ *  Since referenced objects are copied first,
+ *  identical fonts and images are detected
+ *  even though their object numbers differ between documents.
+ *
+ *  \return
+ *      0 on success, -1 on failure
+ *
+ *  \param copy
+ *      the copy state
+ *
+ *  \param number
+ *      the object number within the source document
+ *
+ *  \param body
+ *      the value of the object
+ *
+ *  \param body_end
+ *      the end of \c body
+ *
+ *  \param stream
+ *      the stream data of the object, or \c NULL
+ *
+ *  \param stream_size
+ *      size of \c stream
+ *
+ *  \param deduplicate
+ *      whether this object may be deduplicated,
+ *      which must be 0 for pages
+ */
+static int pdf_copy_body(struct pdf_copy *copy, size_t number, const char *body, const char *body_end, const char *stream, size_t stream_size, int deduplicate)
+{
+    struct buffer text = { NULL, 0, 0 };
+    int status = -1;
+    copy->state[number] = 1;
+    if (pdf_copy_value(copy, &text, body, body_end) != 0) {
+        goto cleanup;
+    }
+    if (copy->mapped[number] == 0 && deduplicate && copy->writer->deduplicate) {
+        struct digest digest;
+        unsigned char result[32];
+        size_t new_number = copy->writer->objects_count;
+        digest_init(&digest);
+        digest_update(&digest, text.data, text.size + 1);
+        if (stream != NULL) {
+            digest_update(&digest, stream, stream_size);
+        }
+        digest_final(&digest, result);
+        copy->mapped[number] = pdf_writer_dedup(copy->writer, result, new_number);
+        if (copy->mapped[number] == 0) {
+            goto cleanup;
+        }
+        /* identical object already written */
+        if (copy->mapped[number] != new_number) {
+            copy->state[number] = 2;
+            status = 0;
+            goto cleanup;
+        }
+        if (pdf_writer_reserve(copy->writer) != new_number) {
+            goto cleanup;
+        }
+    }
+    if (copy->mapped[number] == 0) {
+        copy->mapped[number] = pdf_writer_reserve(copy->writer);
+        if (copy->mapped[number] == 0) {
+            goto cleanup;
+        }
+    }
+    if (pdf_write_object(copy->writer, copy->mapped[number], text.data, text.size, stream, stream_size) != 0) {
+        goto cleanup;
+    }
+    copy->state[number] = 2;
+    status = 0;
+cleanup:
+    free(text.data);
+    return status;
+}
+
+/*! Copy an object and all objects it references.
+ *
+ *  \return
+ *      0 on success, -1 on failure
+ */
+static int pdf_copy_object(struct pdf_copy *copy, size_t number)
+{
+    const char *body;
+    const char *body_end;
+    const char *stream;
+    size_t stream_size;
+    if (pdf_object(&body, &body_end, &stream, &stream_size, copy->doc, number) != 0) {
+        return -1;
+    }
+    return pdf_copy_body(copy, number, body, body_end, stream, stream_size, 1);
+}
+
+/*! Copy a page and all objects it references.
+ *
+ *  Inherited attributes are added to the page,
+ *  and the reference to its parent is replaced by
+ *  the page tree root of the writer.
+ *
+ *  \return
+ *      0 on success, -1 on failure
+ */
+static int pdf_copy_page(struct pdf_copy *copy, const struct pdf_page *page)
+{
+    struct buffer body = { NULL, 0, 0 };
+    const char *page_body;
+    const char *page_body_end;
+    const char *stream;
+    size_t stream_size;
+    size_t i;
+    int status = -1;
+    if (   pdf_object(&page_body, &page_body_end, &stream, &stream_size, copy->doc, page->number) != 0
+        || page_body_end - page_body < 4
+        || memcmp(page_body_end - 2, ">>", 2) != 0) {
+        return -1;
+    }
+    /* add inherited attributes before the closing ">>" */
+    if (buffer_append(&body, page_body, page_body_end - page_body - 2) != 0) {
+        goto cleanup;
+    }
+    for (i = 0; i < PDF_INHERITABLE_KEYS_COUNT; i++) {
+        const char *value;
+        const char *value_end;
+        if (   page->inherited[i] != NULL
+            && pdf_dict_get(&value, &value_end, page_body, page_body_end, pdf_inheritable_keys[i]) != 0) {
+            if (   buffer_append(&body, " ", 1) != 0
+                || buffer_append(&body, pdf_inheritable_keys[i], strlen(pdf_inheritable_keys[i])) != 0
+                || buffer_append(&body, " ", 1) != 0
+                || buffer_append(&body, page->inherited[i], page->inherited_end[i] - page->inherited[i]) != 0) {
+                goto cleanup;
+            }
+        }
+    }
+    if (buffer_append(&body, ">>", 2) != 0) {
+        goto cleanup;
+    }
+    status = pdf_copy_body(copy, page->number, body.data, body.data + body.size, stream, stream_size, 0);
+cleanup:
+    free(body.data);
+    return status;
+}
+
+/*! Prepare copying pages from a PDF file.
+ *
+ *  Pages to copy are selected via pdf_copy_select(),
+ *  and copied via pdf_copy_selected().
+ *  Only objects reachable from these pages are copied.
+ *  References to other pages and to the document catalog
+ *  are replaced by \c null.
+ *
+ *  \return
+ *      0 on success, -1 if out of memory
+ *
+ *  \param copy
+ *      the copy state to initialize,
+ *      which has to be freed via pdf_copy_free()
+ *
+ *  \param writer
+ *      the writer to copy to
+ *
+ *  \param doc
+ *      the document to copy from
+ *
+ *  \param pages
+ *      all pages of \c doc
+ */
+static int pdf_copy_init(struct pdf_copy *copy, struct pdf_writer *writer, const struct pdf_document *doc, const struct pdf_pages *pages)
+{
+    size_t i;
+    copy->writer = writer;
+    copy->doc = doc;
+    copy->pages = pages;
+    copy->mapped = (size_t *)calloc(doc->objects_count + 1, sizeof(size_t));
+    copy->state = (char *)calloc(doc->objects_count + 1, 1);
+    if (copy->mapped == NULL || copy->state == NULL) {
+        return -1;
+    }
+    /* redirect the page tree and exclude everything above it */
+    for (i = 0; i < doc->objects_count; i++) {
+        if (pages->is_tree_node[i]) {
+            copy->mapped[i] = PDF_PAGES_NUMBER;
+            copy->state[i] = 2;
+        }
+    }
+    if (doc->root < doc->objects_count) {
+        copy->mapped[doc->root] = PDF_NULL;
+    }
+    for (i = 0; i < pages->count; i++) {
+        copy->mapped[pages->items[i].number] = PDF_NULL;
+    }
+    return 0;
+}
+
+/*! Free all resources of a copy state.
+ */
+static void pdf_copy_free(struct pdf_copy *copy)
+{
+    free(copy->mapped);
+    free(copy->state);
+}
+
+/*! Select a range of pages to copy, appending them to the page tree.
+ *
+ *  The selected pages are numbered in advance,
+ *  since they may reference each other,
+ *  and are copied only via pdf_copy_page().
+ *
+ *  \return
+ *      0 on success, -1 if out of memory
+ *
+ *  \param copy
+ *      the copy state
+ *
+ *  \param first
+ *      index of the first page to select
+ *
+ *  \param count
+ *      number of pages to select
+ */
+static int pdf_copy_select(struct pdf_copy *copy, size_t first, size_t count)
+{
+    size_t i;
+    for (i = first; i < first + count; i++) {
+        char s[64];
+        const size_t number = pdf_writer_reserve(copy->writer);
+        if (number == 0) {
+            return -1;
+        }
+        copy->mapped[copy->pages->items[i].number] = number;
+        copy->state[copy->pages->items[i].number] = 1;
+        sprintf(s, "%lu 0 R ", (unsigned long)number);
+        if (buffer_append(&copy->writer->kids, s, strlen(s)) != 0) {
+            return -1;
+        }
+        copy->writer->pages_count++;
+    }
+    return 0;
+}
+
+/*! Copy all selected pages.
+ *
+ *  \return
+ *      0 on success, -1 on failure
+ */
+static int pdf_copy_selected(struct pdf_copy *copy)
+{
+    size_t i;
+    for (i = 0; i < copy->pages->count; i++) {
+        const struct pdf_page *page = &copy->pages->items[i];
+        if (copy->mapped[page->number] != PDF_NULL && pdf_copy_page(copy, page) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*! Copy a range of pages from a PDF file.
+ *
+ *  See pdf_copy_init() and pdf_copy_select() for the parameters.
+ *
+ *  \return
+ *      0 on success, -1 on failure
+ */
+static int pdf_copy_pages(struct pdf_writer *writer, const struct pdf_document *doc, const struct pdf_pages *pages, size_t first, size_t count)
+{
+    struct pdf_copy copy;
+    int status = -1;
+    if (   pdf_copy_init(&copy, writer, doc, pages) == 0
+        && pdf_copy_select(&copy, first, count) == 0
+        && pdf_copy_selected(&copy) == 0) {
+        status = 0;
+    }
+    pdf_copy_free(&copy);
+    return status;
+}
+
+/*! Split a PDF file into several ones.
+ *
+ *  \return
+ *      0 on success, -1 on failure
+ *
+ *  \param info
+ *      On failure, \c info will be set to a newly allocated string
+ *      that contains the error message.
+ *      On success, or when out of memory,
+ *      \c info will be set to \c NULL.
+ *
+ *  \param results
+ *      array of \c count elements,
+ *      each of which will be set to a newly allocated PDF file
+ *      on success, or to \c NULL on failure
+ *
+ *  \param result_sizes
+ *      array of \c count elements,
+ *      which will be set to the sizes of \c results
+ *
+ *  \param pdf
+ *      the PDF file to split
+ *
+ *  \param pdf_size
+ *      size of \c pdf
+ *
+ *  \param first_pages
+ *      array of \c count elements,
+ *      containing the index of the first page of every part,
+ *      in ascending order
+ *
+ *  \param count
+ *      number of parts
+ */
+static int pdf_split(char **info, char **results, size_t *result_sizes, const char *pdf, size_t pdf_size, const size_t *first_pages, size_t count)
+{
+    struct pdf_document doc;
+    struct pdf_pages pages;
+    size_t i;
+    int status = -1;
+    for (i = 0; i < count; i++) {
+        results[i] = NULL;
+        result_sizes[i] = 0;
+    }
+    if (pdf_parse(info, &doc, pdf, pdf_size) != 0) {
+        return -1;
+    }
+    if (pdf_pages_init(&pages, &doc) != 0) {
+        *info = sprintf_alloc("Unable to read the page tree of the PDF.");
+        goto cleanup;
+    }
+    for (i = 0; i < count; i++) {
+        const size_t end = i + 1 < count ? first_pages[i + 1] : pages.count;
+        struct pdf_writer writer;
+        if (first_pages[i] > end || end > pages.count) {
+            *info = sprintf_alloc("Invalid page range %lu to %lu of PDF with %lu pages.",
+                                  (unsigned long)first_pages[i] + 1, (unsigned long)end,
+                                  (unsigned long)pages.count);
+            goto cleanup;
+        }
+        pdf_writer_init(&writer, -1, 0);
+        if (   pdf_writer_begin(&writer, &doc) != 0
+            || pdf_copy_pages(&writer, &doc, &pages, first_pages[i], end - first_pages[i]) != 0
+            || pdf_writer_finish(&writer) != 0) {
+            pdf_writer_free(&writer);
+            *info = sprintf_alloc("Unable to copy pages %lu to %lu of the PDF.",
+                                  (unsigned long)first_pages[i] + 1, (unsigned long)end);
+            goto cleanup;
+        }
+        results[i] = writer.output.data;
+        result_sizes[i] = writer.output.size;
+        writer.output.data = NULL;
+        pdf_writer_free(&writer);
+    }
+    status = 0;
+cleanup:
+    if (status != 0) {
+        for (i = 0; i < count; i++) {
+            free(results[i]);
+            results[i] = NULL;
+            result_sizes[i] = 0;
+        }
+    }
+    pdf_pages_free(&pages);
+    free(doc.offsets);
+    return status;
+}
+
+/*! Page count of a \ref pdf_range that extends to the last page.
+ */
+#define PDF_REMAINING_PAGES ((size_t)-1)
+
+/*! A range of pages to copy by pdf_splice().
+ */
+struct pdf_range {
+    /*! index of the PDF file to copy from */
+    size_t pdf;
+    /*! index of the first page */
+    size_t first;
+    /*! number of pages, or \ref PDF_REMAINING_PAGES */
+    size_t count;
+};
+
+/*! Assemble a PDF file from page ranges of several PDF files.
+ *
+ *  Objects shared by the PDF files, such as fonts,
+ *  are deduplicated.
+ *
+ *  \return
+ *      0 on success, -1 on failure
+ *
+ *  \param info
+ *      On failure, \c info will be set to a newly allocated string
+ *      that contains the error message.
+ *      On success, or when out of memory,
+ *      \c info will be set to \c NULL.
+ *
+ *  \param result
+ *      will be set to the newly allocated PDF file on success,
+ *      or to \c NULL on failure
+ *
+ *  \param result_size
+ *      will be set to the size of \c result
+ *
+ *  \param pdfs
+ *      array of \c pdfs_count PDF files to copy from
+ *
+ *  \param pdf_sizes
+ *      the sizes of \c pdfs
+ *
+ *  \param pdfs_count
+ *      number of PDF files, whose first one provides the PDF version
+ *
+ *  \param ranges
+ *      array of \c ranges_count page ranges, in the order of the result
+ *
+ *  \param ranges_count
+ *      number of page ranges
+ */
+static int pdf_splice(char **info, char **result, size_t *result_size, const char *const *pdfs, const size_t *pdf_sizes, size_t pdfs_count, const struct pdf_range *ranges, size_t ranges_count)
+{
+    struct pdf_document *docs;
+    struct pdf_pages *pages;
+    struct pdf_copy *copies;
+    struct pdf_writer writer;
+    size_t parsed = 0;
+    size_t i;
+    int status = -1;
+    *info = NULL;
+    *result = NULL;
+    *result_size = 0;
+    docs = (struct pdf_document *)malloc(pdfs_count * sizeof(struct pdf_document));
+    pages = (struct pdf_pages *)malloc(pdfs_count * sizeof(struct pdf_pages));
+    copies = (struct pdf_copy *)calloc(pdfs_count, sizeof(struct pdf_copy));
+    pdf_writer_init(&writer, -1, 1);
+    if (docs == NULL || pages == NULL || copies == NULL) {
+        goto cleanup;
+    }
+    for (parsed = 0; parsed < pdfs_count; parsed++) {
+        if (pdf_parse(info, &docs[parsed], pdfs[parsed], pdf_sizes[parsed]) != 0) {
+            goto cleanup;
+        }
+        if (pdf_pages_init(&pages[parsed], &docs[parsed]) != 0) {
+            pdf_pages_free(&pages[parsed]);
+            free(docs[parsed].offsets);
+            *info = sprintf_alloc("Unable to read the page tree of the PDF.");
+            goto cleanup;
+        }
+        if (pdf_copy_init(&copies[parsed], &writer, &docs[parsed], &pages[parsed]) != 0) {
+            pdf_copy_free(&copies[parsed]);
+            pdf_pages_free(&pages[parsed]);
+            free(docs[parsed].offsets);
+            goto cleanup;
+        }
+    }
+    if (pdf_writer_begin(&writer, &docs[0]) != 0) {
+        goto cleanup;
+    }
+    /* select all ranges first, since pages may reference each other */
+    for (i = 0; i < ranges_count; i++) {
+        const struct pdf_range *range = &ranges[i];
+        size_t count = range->count;
+        if (range->first <= pages[range->pdf].count && count == PDF_REMAINING_PAGES) {
+            count = pages[range->pdf].count - range->first;
+        }
+        if (   range->first > pages[range->pdf].count
+            || count > pages[range->pdf].count - range->first) {
+            *info = sprintf_alloc("Invalid page range %lu to %lu of PDF with %lu pages.",
+                                  (unsigned long)range->first + 1,
+                                  (unsigned long)(range->first + count),
+                                  (unsigned long)pages[range->pdf].count);
+            goto cleanup;
+        }
+        if (pdf_copy_select(&copies[range->pdf], range->first, count) != 0) {
+            goto cleanup;
+        }
+    }
+    for (i = 0; i < pdfs_count; i++) {
+        if (pdf_copy_selected(&copies[i]) != 0) {
+            *info = sprintf_alloc("Unable to copy the pages of the PDF.");
+            goto cleanup;
+        }
+    }
+    if (pdf_writer_finish(&writer) != 0) {
+        goto cleanup;
+    }
+    *result = writer.output.data;
+    *result_size = writer.output.size;
+    writer.output.data = NULL;
+    status = 0;
+cleanup:
+    for (i = 0; i < parsed; i++) {
+        pdf_copy_free(&copies[i]);
+        pdf_pages_free(&pages[i]);
+        free(docs[i].offsets);
+    }
+    pdf_writer_free(&writer);
+    free(docs);
+    free(pages);
+    free(copies);
+    return status;
+}
+
+/*! TeX code that disables object streams,
+ *  so the PDF has a classic cross-reference table
+ *  as required by pdf_parse().
+ */
+#define CLASSIC_XREF_PROLOGUE "\\pdfobjcompresslevel=0 "
+
+/*! TeX code that prepares a document whose PDF is split into page ranges,
+ *  such as a combined mail merge document.
+ *
+ *  Object streams are disabled so that pdf_parse() can read the PDF,
+ *  and shipped out pages are counted in <tt>\\texcallershippedpages</tt>,
+ *  which is written to the log at the boundaries of the ranges.
+ */
+#define PAGE_RANGES_PROLOGUE \
+    CLASSIC_XREF_PROLOGUE \
+    "\\newcount\\texcallershippedpages" \
+    "\\AddToHook{shipout/after}{\\global\\advance\\texcallershippedpages1 }"
+
+/*! Add the statistics of a conversion to the ones of several conversions.
+ *
+ *  All conversions have the same priority, which is taken over.
+ *
+ *  \param total
+ *      the statistics to add to
+ *
+ *  \param stats
+ *      the statistics of the conversion
+ */
+static void add_stats(texcaller_stats *total, const texcaller_stats *stats)
+{
+    total->runs += stats->runs;
+    total->run_time += stats->run_time;
+    total->cpu_time += stats->cpu_time;
+    if (stats->max_rss > total->max_rss) {
+        total->max_rss = stats->max_rss;
+    }
+    total->nice = stats->nice;
+    total->io_class = stats->io_class;
+    total->io_level = stats->io_level;
+    total->cpu_policy = stats->cpu_policy;
+}
+
+/*! Log message that marks the first page of a mail merge record,
+ *  followed by the number of pages shipped out before.
+ */
+#define MERGE_RECORD "texcaller: record after pages "
+
+/*! Create the TeX code that prepares a combined mail merge document,
+ *  see merge_document().
+ *
+ *  <tt>\\texcallermergerecord{n}</tt> starts record \c n
+ *  by resetting all LaTeX counters
+ *  and writing <tt>\\texcallerrecordlabels{n}</tt> to the aux file.
+ *  When reading the aux file,
+ *  that collects the labels of record \c n
+ *  in <tt>\\texcallerlabels</tt><i>n</i>,
+ *  so that every record only sees its own labels.
+ *
+ *  \return
+ *      the newly allocated TeX code,
+ *      or \c NULL if out of memory
+ */
+static char *merge_prologue(void)
+{
+    const char collect_labels[] =
+        "\\def\\texcallerrecordlabels#1{"
+            "\\def\\newlabel##1##2{"
+                "\\expandafter\\xdef\\csname texcallerlabels#1\\endcsname{"
+                    "\\unexpanded\\expandafter\\expandafter\\expandafter{\\csname texcallerlabels#1\\endcsname}"
+                    "\\unexpanded{\\texcallerlabel{##1}{##2}}}}}";
+    const char switch_labels[] =
+        "\\def\\texcallerpreviousrecord{}"
+        "\\def\\texcallerswitchlabels#1{"
+            "\\def\\texcallerlabel##1##2{"
+                "\\expandafter\\global\\expandafter\\let\\csname r@##1\\endcsname\\texcallerundefined}"
+            "\\csname texcallerlabels\\texcallerpreviousrecord\\endcsname"
+            "\\def\\texcallerlabel##1##2{\\expandafter\\gdef\\csname r@##1\\endcsname{##2}}"
+            "\\csname texcallerlabels#1\\endcsname"
+            "\\gdef\\texcallerpreviousrecord{#1}}";
+    const char merge_record[] =
+        "\\def\\texcallermergerecord#1{"
+            "\\begingroup"
+            "\\texcallerswitchlabels{#1}"
+            "\\expandafter\\def\\csname @elt\\endcsname##1{\\global\\csname c@##1\\endcsname=0 }"
+            "\\csname cl@@ckpt\\endcsname"
+            "\\endgroup"
+            "\\immediate\\write\\csname @auxout\\endcsname{\\string\\texcallerrecordlabels{#1}}"
+            "\\setcounter{page}{1}}";
+    return sprintf_alloc("%s%s%s%s", PAGE_RANGES_PROLOGUE, collect_labels, switch_labels, merge_record);
+}
+
+/*! Assemble a combined mail merge document.
+ *
+ *  Every record starts on a fresh page with all LaTeX counters reset
+ *  and only its own labels defined,
+ *  which requires the TeX code of merge_prologue().
+ *
+ *  \return
+ *      0 on success, -1 if out of memory
+ *
+ *  \param document
+ *      the buffer to append the document to
+ *
+ *  \param source
+ *      the template
+ *
+ *  \param body_start
+ *      offset of the body within \c source,
+ *      right after <tt>\\begin{document}</tt>
+ *
+ *  \param body_end
+ *      offset of <tt>\\end{document}</tt> within \c source
+ *
+ *  \param records
+ *      the records to combine
+ *
+ *  \param record_sizes
+ *      the sizes of \c records
+ *
+ *  \param records_count
+ *      number of records
+ */
+static int merge_document(struct buffer *document, const char *source, size_t body_start, size_t body_end, const char *const *records, const size_t *record_sizes, size_t records_count)
+{
+    const char record_begin[] =
+        "\\clearpage"
+        "\\immediate\\write-1{" MERGE_RECORD "\\the\\texcallershippedpages}"
+        "\\texcallermergerecord{%lu}"
+        "\\begingroup\n";
+    const char record_end[] = "\n\\endgroup\n";
+    const char document_end[] = "\\end{document}\n";
+    char begin[sizeof(record_begin) + 32];
+    size_t i;
+    if (buffer_append(document, source, body_start) != 0) {
+        return -1;
+    }
+    for (i = 0; i < records_count; i++) {
+        sprintf(begin, record_begin, (unsigned long)i + 1);
+        if (   buffer_append(document, begin, strlen(begin)) != 0
+            || buffer_append(document, records[i], record_sizes[i]) != 0
+            || buffer_append(document, "\n", 1) != 0
+            || buffer_append(document, source + body_start, body_end - body_start) != 0
+            || buffer_append(document, record_end, sizeof(record_end) - 1) != 0) {
+            return -1;
+        }
+    }
+    return buffer_append(document, document_end, sizeof(document_end) - 1);
+}
+
+/*! Determine the first pages of all mail merge records from the log.
+ *
+ *  \return
+ *      0 on success, -1 if the log doesn't contain all records
+ *
+ *  \param first_pages
+ *      array of \c records_count elements,
+ *      which will be set to the index of the first page of each record
+ *
+ *  \param log
+ *      the log of the combined document
+ *
+ *  \param records_count
+ *      number of records
+ */
+static int merge_first_pages(size_t *first_pages, const char *log, size_t records_count)
+{
+    const size_t marker_length = strlen(MERGE_RECORD);
+    size_t i = 0;
+    const char *p;
+    for (p = strstr(log, MERGE_RECORD); p != NULL; p = strstr(p, MERGE_RECORD)) {
+        p += marker_length;
+        if (i == records_count) {
+            return -1;
+        }
+        first_pages[i++] = strtoul(p, NULL, 10);
+    }
+    return i == records_count ? 0 : -1;
+}
+
+/*! A PDF file being concatenated from several PDF files.
+ */
+struct texcaller_concat {
+    /*! the writer of the concatenated PDF */
+    struct pdf_writer writer;
+    /*! number of documents added so far */
+    size_t documents;
+    /*! whether adding a document failed */
+    int failed;
+};
+
+/*! A chapter of the last project build of a session.
+ */
+struct project_chapter {
+    /*! name of the chapter, see texcaller_chapter */
+    char *name;
+    /*! hash of the content of the chapter */
+    unsigned long hash[2];
+    /*! index of the first page of the chapter */
+    size_t first_page;
+    /*! number of pages of the chapter */
+    size_t pages;
+    /*! content of the aux file of the chapter */
+    char *aux;
+    /*! size of \c aux */
+    size_t aux_size;
+};
+
+/*! A document being converted repeatedly.
+ *
+ *  The process ID and the cancellation flag
+ *  are accessed via atomic builtins,
+ *  because texcaller_session_cancel() may be called by another thread.
+ */
+struct texcaller_session {
+    /*! the directory all conversions run in */
+    char *dir;
+    /*! the source format, see texcaller_convert() */
+    char *source_format;
+    /*! the result format, see texcaller_convert() */
+    char *result_format;
+    /*! the options of all conversions */
+    texcaller_options options;
+    /*! process ID of the running TeX process, or 0 */
+    pid_t pid;
+    /*! whether the current conversion was cancelled */
+    int cancelled;
+    /*! chapters of the running project build, whose aux files
+     *  are checked for stability as well, or \c NULL */
+    const texcaller_chapter *building;
+    /*! number of elements of \c building */
+    size_t building_count;
+    /*! chapters of the last project build */
+    struct project_chapter *chapters;
+    /*! number of elements of \c chapters */
+    size_t chapters_count;
+    /*! hash of the main source of the last project build */
+    unsigned long source_hash[2];
+    /*! PDF of the last project build,
+     *  or \c NULL if there is no valid project build */
+    char *pdf;
+    /*! size of \c pdf */
+    size_t pdf_size;
+};
+
+/*! Run TeX and wait for it to terminate.
+ *
+ *  Within a session, the TeX process can be killed
+ *  via texcaller_session_cancel().
+ *  The process isn't reaped before it is unpublished,
+ *  so its process ID can't be reused by an unrelated process
+ *  while it may still be killed.
+ *
+ *  See run_command() for the other parameters.
+ *
+ *  \return
+ *      0 if TeX terminated successfully, -1 otherwise
+ *
+ *  \param session
+ *      the session, or \c NULL
+ */
+static int run_tex(char **info, const char *dir, const char *const *args, const struct child_priority *priority, texcaller_stats *stats, texcaller_session *session)
+{
+    double start_time;
+    pid_t pid;
+    siginfo_t siginfo;
+    int status;
+    if (session == NULL) {
+        return run_command(info, dir, args, NULL, priority, stats);
+    }
+    *info = NULL;
+    if (__sync_fetch_and_add(&session->cancelled, 0)) {
+        *info = sprintf_alloc("Conversion was cancelled.");
+        return -1;
+    }
+    start_time = current_time();
+    pid = spawn_command(info, dir, args, NULL, priority);
+    if (pid == -1) {
+        return -1;
+    }
+    __sync_val_compare_and_swap(&session->pid, 0, pid);
+    /* cancelled before the process ID was published */
+    if (__sync_fetch_and_add(&session->cancelled, 0)) {
+        kill(pid, SIGKILL);
+    }
+    while (waitid(P_PID, pid, &siginfo, WEXITED | WNOWAIT) == -1 && errno == EINTR) {
+    }
+    __sync_val_compare_and_swap(&session->pid, pid, 0);
+    status = wait_command(info, pid, args[0], start_time, stats);
+    if (__sync_fetch_and_add(&session->cancelled, 0)) {
+        free(*info);
+        *info = sprintf_alloc("Conversion was cancelled.");
+        return -1;
+    }
+    return status;
+}
+
+/*! Remove all files of the previous build from a session directory.
+ *
+ *  This is done after failed builds,
+ *  since a killed or failed TeX run may leave a broken aux file
+ *  that would break all later builds.
+ *  Assets are kept.
+ *
+ *  \param dir
+ *      the session directory
+ */
+static void reset_session(const char *dir)
+{
+    DIR *d = opendir(dir);
+    struct dirent *entry;
+    if (d == NULL) {
+        return;
+    }
+    while ((entry = readdir(d)) != NULL) {
+        if (   strncmp(entry->d_name, "texput", 6) == 0
+            || strcmp(entry->d_name, "pdftex.map") == 0) {
+            char *filename = sprintf_alloc("%s/%s", dir, entry->d_name);
+            if (filename != NULL) {
+                unlink(filename);
+                free(filename);
+            }
+        }
+    }
+    closedir(d);
+}
+
+/*! Read the aux file of a build,
+ *  followed by the aux files of all chapters of a project build.
+ *
+ *  Missing aux files are tolerated.
+ *
+ *  \param aux
+ *      will be set to a newly allocated buffer
+ *      that contains all aux files,
+ *      or to \c NULL if there isn't any aux file or if out of memory
+ *
+ *  \param aux_size
+ *      will be set to the size of \c aux
+ *
+ *  \param dir
+ *      the build directory
+ *
+ *  \param aux_filename
+ *      the aux file of the build
+ *
+ *  \param session
+ *      the session, or \c NULL
+ */
+static void read_aux(char **aux, size_t *aux_size, const char *dir, const char *aux_filename, const texcaller_session *session)
+{
+    struct buffer all = { NULL, 0, 0 };
+    char *error;
+    size_t i;
+    read_file(aux, aux_size, &error, aux_filename);
+    free(error);
+    if (session == NULL || session->building_count == 0) {
+        return;
+    }
+    if (*aux != NULL) {
+        all.data = *aux;
+        all.size = *aux_size;
+        all.capacity = *aux_size;
+    }
+    *aux = NULL;
+    *aux_size = 0;
+    for (i = 0; i < session->building_count; i++) {
+        char *chapter_aux;
+        size_t chapter_aux_size;
+        char *filename = sprintf_alloc("%s/%s.aux", dir, session->building[i].name);
+        if (filename == NULL) {
+            free(all.data);
+            return;
+        }
+        read_file(&chapter_aux, &chapter_aux_size, &error, filename);
+        free(error);
+        free(filename);
+        if (   chapter_aux != NULL
+            && buffer_append(&all, chapter_aux, chapter_aux_size) != 0) {
+            free(chapter_aux);
+            free(all.data);
+            return;
+        }
+        free(chapter_aux);
+    }
+    *aux = all.data;
+    *aux_size = all.size;
+}
+
+/*! File to which a project build writes the page ranges of its chapters.
+ *
+ *  This isn't the log, which wraps lines
+ *  longer than \c max_print_line of 79 characters,
+ *  so long chapter names would break the page counts.
+ */
+#define PROJECT_PAGES_FILENAME "texput.chapters"
+
+/*! Line that marks the start of a chapter of a project,
+ *  followed by its name and the number of pages shipped out before.
+ */
+#define PROJECT_BEGIN "texcaller: begin chapter "
+
+/*! Line that marks the end of a chapter of a project,
+ *  followed by its name and the number of pages shipped out before.
+ */
+#define PROJECT_END "texcaller: end chapter "
+
+/*! Check whether a chapter name is valid, see texcaller_chapter::name.
+ *
+ *  \return
+ *      1 if valid, 0 otherwise
+ */
+static int valid_chapter_name(const char *name)
+{
+    const size_t length = strlen(name);
+    return length > 0
+        && length <= 64
+        && strncmp(name, "texput", 6) != 0
+        && strspn(name, "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                        "abcdefghijklmnopqrstuvwxyz"
+                        "0123456789-_") == length;
+}
+
+/*! Assemble the TeX code that prepares a project build.
+ *
+ *  The start and end of every chapter are written to
+ *  \ref PROJECT_PAGES_FILENAME,
+ *  whether the chapter is included or not.
+ *
+ *  \return
+ *      the newly allocated TeX code, or \c NULL if out of memory
+ *
+ *  \param chapters
+ *      the chapters of the project
+ *
+ *  \param chapters_count
+ *      number of chapters
+ *
+ *  \param changed
+ *      array of \c chapters_count flags
+ *      that tell which chapters to include,
+ *      or \c NULL to include all chapters
+ */
+static char *project_prologue(const texcaller_chapter *chapters, size_t chapters_count, const char *changed)
+{
+    struct buffer prologue = { NULL, 0, 0 };
+    size_t included = 0;
+    size_t i;
+    const char open_pages[] =
+        "\\newwrite\\texcallerchapters"
+        "\\immediate\\openout\\texcallerchapters=" PROJECT_PAGES_FILENAME " ";
+    if (   buffer_append(&prologue, PAGE_RANGES_PROLOGUE, strlen(PAGE_RANGES_PROLOGUE)) != 0
+        || buffer_append(&prologue, open_pages, sizeof(open_pages) - 1) != 0) {
+        free(prologue.data);
+        return NULL;
+    }
+    for (i = 0; i < chapters_count; i++) {
+        const char *name = chapters[i].name;
+        char *hooks = sprintf_alloc(
+            "\\AddToHook{include/before/%s}"
+            "{\\immediate\\write\\texcallerchapters{" PROJECT_BEGIN "%s \\the\\texcallershippedpages}}"
+            "\\AddToHook{include/after/%s}"
+            "{\\immediate\\write\\texcallerchapters{" PROJECT_END "%s \\the\\texcallershippedpages}}"
+            "\\AddToHook{include/excluded/%s}"
+            "{\\immediate\\write\\texcallerchapters{" PROJECT_BEGIN "%s \\the\\texcallershippedpages}"
+            "\\immediate\\write\\texcallerchapters{" PROJECT_END "%s \\the\\texcallershippedpages}}",
+            name, name, name, name, name, name, name);
+        if (   hooks == NULL
+            || buffer_append(&prologue, hooks, strlen(hooks)) != 0) {
+            free(hooks);
+            free(prologue.data);
+            return NULL;
+        }
+        free(hooks);
+    }
+    if (changed != NULL) {
+        if (buffer_append(&prologue, "\\includeonly{", 13) != 0) {
+            free(prologue.data);
+            return NULL;
+        }
+        for (i = 0; i < chapters_count; i++) {
+            if (changed[i]) {
+                if (   (included++ > 0 && buffer_append(&prologue, ",", 1) != 0)
+                    || buffer_append(&prologue, chapters[i].name, strlen(chapters[i].name)) != 0) {
+                    free(prologue.data);
+                    return NULL;
+                }
+            }
+        }
+        if (buffer_append(&prologue, "}", 1) != 0) {
+            free(prologue.data);
+            return NULL;
+        }
+    }
+    return prologue.data;
+}
+
+/*! Determine the page range of every chapter of a project build
+ *  from \ref PROJECT_PAGES_FILENAME.
+ *
+ *  \return
+ *      0 on success, -1 if the file doesn't contain all chapters,
+ *      or if out of memory
+ *
+ *  \param begins
+ *      array of \c chapters_count elements, which will be set to
+ *      the index of the first page of every chapter
+ *
+ *  \param ends
+ *      array of \c chapters_count elements, which will be set to
+ *      the index after the last page of every chapter
+ *
+ *  \param dir
+ *      the directory of the project build
+ *
+ *  \param chapters
+ *      the chapters of the project
+ *
+ *  \param chapters_count
+ *      number of chapters
+ */
+static int project_page_ranges(size_t *begins, size_t *ends, const char *dir, const texcaller_chapter *chapters, size_t chapters_count)
+{
+    char *filename;
+    char *pages;
+    size_t pages_size;
+    char *error;
+    size_t i;
+    int status = -1;
+    filename = sprintf_alloc("%s/" PROJECT_PAGES_FILENAME, dir);
+    if (filename == NULL) {
+        return -1;
+    }
+    read_file(&pages, &pages_size, &error, filename);
+    free(filename);
+    free(error);
+    if (pages == NULL) {
+        return -1;
+    }
+    for (i = 0; i < chapters_count; i++) {
+        char *begin_marker = sprintf_alloc(PROJECT_BEGIN "%s ", chapters[i].name);
+        char *end_marker = sprintf_alloc(PROJECT_END "%s ", chapters[i].name);
+        const char *begin = NULL;
+        const char *end = NULL;
+        if (begin_marker != NULL && end_marker != NULL) {
+            begin = strstr(pages, begin_marker);
+            end = strstr(pages, end_marker);
+        }
+        if (begin != NULL && end != NULL) {
+            begins[i] = strtoul(begin + strlen(begin_marker), NULL, 10);
+            ends[i] = strtoul(end + strlen(end_marker), NULL, 10);
+        }
+        free(begin_marker);
+        free(end_marker);
+        if (   begin == NULL || end == NULL
+            || begins[i] > ends[i]
+            || (i > 0 && begins[i] < ends[i - 1])) {
+            goto cleanup;
+        }
+    }
+    status = 0;
+cleanup:
+    free(pages);
+    return status;
+}
+
+/*! Discard the last project build of a session,
+ *  so the next project build is a full one.
+ *
+ *  \param session
+ *      the session
+ */
+static void project_reset(texcaller_session *session)
+{
+    size_t i;
+    for (i = 0; i < session->chapters_count; i++) {
+        free(session->chapters[i].name);
+        free(session->chapters[i].aux);
+    }
+    free(session->chapters);
+    session->chapters = NULL;
+    session->chapters_count = 0;
+    free(session->pdf);
+    session->pdf = NULL;
+    session->pdf_size = 0;
+}
+
+/*! Keep the state of a full project build in its session.
+ *
+ *  If out of memory, the session is left without a valid project build.
+ *
+ *  \param session
+ *      the session, whose previous project build has been discarded
+ *
+ *  \param chapters
+ *      the chapters of the project
+ *
+ *  \param chapters_count
+ *      number of chapters
+ *
+ *  \param hashes
+ *      the hashes of the contents of \c chapters
+ *
+ *  \param begins
+ *      the indices of the first pages of \c chapters,
+ *      see project_page_ranges()
+ *
+ *  \param ends
+ *      the indices after the last pages of \c chapters,
+ *      see project_page_ranges()
+ *
+ *  \param source_hash
+ *      the hash of the main source
+ *
+ *  \param pdf
+ *      the PDF of the build
+ *
+ *  \param pdf_size
+ *      size of \c pdf
+ */
+static void project_store(texcaller_session *session, const texcaller_chapter *chapters, size_t chapters_count, const unsigned long (*hashes)[2], const size_t *begins, const size_t *ends, const unsigned long source_hash[2], const char *pdf, size_t pdf_size)
+{
+    char *error;
+    size_t i;
+    session->chapters = (struct project_chapter *)calloc(chapters_count + 1, sizeof(struct project_chapter));
+    session->pdf = (char *)malloc(pdf_size + 1);
+    if (session->chapters == NULL || session->pdf == NULL) {
+        project_reset(session);
+        return;
+    }
+    session->chapters_count = chapters_count;
+    for (i = 0; i < chapters_count; i++) {
+        struct project_chapter *chapter = &session->chapters[i];
+        char *filename = sprintf_alloc("%s/%s.aux", session->dir, chapters[i].name);
+        if (filename == NULL) {
+            project_reset(session);
+            return;
+        }
+        read_file(&chapter->aux, &chapter->aux_size, &error, filename);
+        free(error);
+        free(filename);
+        chapter->name = sprintf_alloc("%s", chapters[i].name);
+        if (chapter->aux == NULL || chapter->name == NULL) {
+            project_reset(session);
+            return;
+        }
+        memcpy(chapter->hash, hashes[i], sizeof(chapter->hash));
+        chapter->first_page = begins[i];
+        chapter->pages = ends[i] - begins[i];
+    }
+    memcpy(session->pdf, pdf, pdf_size);
+    session->pdf_size = pdf_size;
+    memcpy(session->source_hash, source_hash, sizeof(session->source_hash));
+}
+
+/*! States of a conversion of a pool.
+ */
+enum pool_job_state {
+    /*! the conversion waits for a worker */
+    POOL_JOB_QUEUED,
+    /*! the conversion is being run by a worker */
+    POOL_JOB_RUNNING,
+    /*! texcaller_pool_cancel() is killing the running TeX process */
+    POOL_JOB_CANCELLING,
+    /*! the conversion has finished */
+    POOL_JOB_DONE
+};
+
+/*! A conversion waiting for or being run by a worker of a pool.
+ */
+struct texcaller_pool_job {
+    /*! see texcaller_pool_convert() */
+    const char *source;
+    /*! see texcaller_pool_convert() */
+    size_t source_size;
+    /*! see texcaller_pool_convert() */
+    const char *source_format;
+    /*! see texcaller_pool_convert() */
+    const char *result_format;
+    /*! see texcaller_pool_convert() */
+    int max_runs;
+    /*! see texcaller_pool_convert() */
+    const texcaller_options *options;
+    /*! the result of the conversion */
+    char *result;
+    /*! size of \c result */
+    size_t result_size;
+    /*! the info message of the conversion */
+    char *info;
+    /*! posted when the conversion has finished,
+     *  unless it has a \c callback */
+    sem_t done;
+    /*! see texcaller_pool_submit(), or \c NULL for texcaller_pool_convert() */
+    texcaller_pool_callback callback;
+    /*! see texcaller_pool_submit() */
+    void *data;
+    /*! number of owners of a submitted conversion, the worker and its submitter,
+     *  accessed atomically, see texcaller_pool_release() */
+    int references;
+    /*! state of the conversion, accessed atomically */
+    enum pool_job_state state;
+    /*! whether texcaller_pool_cancel() was called, accessed atomically */
+    int cancelled;
+    /*! session whose TeX process texcaller_pool_cancel() kills,
+     *  or \c NULL if the conversion can't be interrupted */
+    texcaller_session *session;
+    /*! time when the conversion was queued, see current_time() */
+    double queued_time;
+    /*! fingerprint of the template, see pool_fingerprint() */
+    unsigned long fingerprint;
+    /*! index of the worker the conversion is routed to,
+     *  or -1 if it isn't routed */
+    int worker;
+};
+
+/*! Size of a cache line, to keep fields written by different threads apart.
+ */
+#define POOL_CACHE_LINE 64
+
+/*! A slot of a job queue of a pool.
+ */
+struct pool_slot {
+    /*! Position the slot is ready for: equal to the position to push
+     *  when empty, and one more than the position to pop when full.
+     *  Accessed atomically. */
+    unsigned long sequence;
+    /*! the queued conversion */
+    struct texcaller_pool_job *job;
+    /*! \c queued_time of \c job, accessed atomically,
+     *  see pool_queue_oldest() */
+    double queued_time;
+};
+
+/*! A bounded lock-free job queue of a pool,
+ *  which any thread may push to and pop from.
+ *
+ *  Each slot carries a sequence number,
+ *  so pushing and popping only claim a position
+ *  via compare-and-swap and then publish the slot,
+ *  without any lock.
+ *
+ *  \see pool_queue_push(), pool_queue_pop()
+ */
+struct pool_queue {
+    /*! the slots, whose number is a power of 2 */
+    struct pool_slot *slots;
+    /*! number of elements of \c slots minus 1 */
+    unsigned long mask;
+    /*! keeps \c push_position off the cache line of the fields above */
+    char padding_push[POOL_CACHE_LINE];
+    /*! next position to push to, accessed atomically */
+    unsigned long push_position;
+    /*! keeps \c pop_position off the cache line of \c push_position */
+    char padding_pop[POOL_CACHE_LINE];
+    /*! next position to pop from, accessed atomically */
+    unsigned long pop_position;
+    /*! keeps the next queue off the cache line of \c pop_position */
+    char padding_end[POOL_CACHE_LINE];
+};
+
+/*! States of a worker of a pool.
+ */
+enum pool_worker_state {
+    /*! the worker doesn't exist */
+    POOL_WORKER_UNUSED,
+    /*! the worker runs or waits for conversions */
+    POOL_WORKER_ACTIVE,
+    /*! the worker is asked to exit by scaling down */
+    POOL_WORKER_RETIRING,
+    /*! the thread of the worker has exited and has yet to be joined */
+    POOL_WORKER_FINISHED
+};
+
+/*! A worker thread of a pool.
+ */
+struct pool_worker {
+    /*! conversions routed to the worker */
+    struct pool_queue queue;
+    /*! the pool of the worker */
+    texcaller_pool *pool;
+    /*! the thread of the worker */
+    pthread_t thread;
+    /*! signalled to wake up the worker while \c sleeping */
+    pthread_cond_t wakeup;
+    /*! the state of the worker, changed with the mutex of the pool held,
+     *  and read atomically without it */
+    enum pool_worker_state state;
+    /*! whether the worker waits for \c wakeup,
+     *  protected by the mutex of the pool */
+    int sleeping;
+    /*! whether the worker runs a conversion, accessed atomically */
+    int busy;
+    /*! time when the worker finished its last conversion,
+     *  accessed atomically */
+    double idle_since;
+    /*! number of queued or running conversions routed to the worker,
+     *  accessed atomically */
+    int load;
+    /*! index of the worker to steal from first */
+    int victim;
+    /*! index of the NUMA node of the worker in the nodes of the pool */
+    int node;
+#ifdef __linux__
+    /*! CPUs the worker is pinned to, if the pool pins its workers */
+    cpu_set_t cpus;
+#endif
+    /*! number of conversions finished by the worker,
+     *  written by the worker only, and read atomically */
+    unsigned long finished;
+    /*! total wall clock time in seconds of these conversions,
+     *  written by the worker only, and read atomically */
+    double run_time;
+    /*! total CPU time in seconds of the TeX runs of these conversions,
+     *  written by the worker only, and read atomically */
+    double cpu_time;
+    /*! the session that provides the working directory */
+    texcaller_session *session;
+    /*! number of conversions run in the working directory */
+    int jobs;
+    /*! whether the working directory is due to be recycled */
+    int recycle;
+    /*! whether the last conversion in the working directory failed */
+    int suspect;
+};
+
+/*! A point of a worker on the consistent hashing ring of a pool.
+ */
+struct pool_point {
+    /*! position of the point on the ring */
+    unsigned long hash;
+    /*! index of the worker */
+    int worker;
+};
+
+/*! Statistics of a pool that are updated on every conversion,
+ *  and are therefore counted atomically rather than under the mutex,
+ *  see texcaller_pool_stats.
+ */
+struct pool_counters {
+    /*! see texcaller_pool_stats::queued */
+    unsigned long queued;
+    /*! see texcaller_pool_stats::jobs */
+    unsigned long jobs;
+    /*! see texcaller_pool_stats::busy */
+    int busy;
+    /*! see texcaller_pool_stats::affinity_hits */
+    unsigned long affinity_hits;
+    /*! see texcaller_pool_stats::affinity_misses */
+    unsigned long affinity_misses;
+    /*! see texcaller_pool_stats::steals */
+    unsigned long steals;
+    /*! see texcaller_pool_stats::injected */
+    unsigned long injected;
+    /*! see texcaller_pool_stats::cas_failures */
+    unsigned long cas_failures;
+};
+
+/*! A pool of worker threads that run conversions.
+ *
+ *  Conversions pass through lock-free queues,
+ *  one per worker plus a shared injection queue,
+ *  so submitting and taking conversions never waits for the mutex.
+ *  The mutex protects the working directories, the scaling
+ *  and the sleeping of idle workers.
+ *  Fields documented as atomic are accessed by atomic builtins only,
+ *  all other fields except \c options and \c ring
+ *  are protected by \c mutex.
+ *
+ *  The sessions of the pool are used for their working directories only,
+ *  so their formats and options don't matter.
+ */
+struct texcaller_pool {
+    /*! the options of the pool */
+    texcaller_pool_options options;
+    /*! mutex protecting the pool */
+    pthread_mutex_t mutex;
+    /*! signalled when the maintenance thread has work to do */
+    pthread_cond_t maintenance_needed;
+    /*! conversions that aren't routed to a worker,
+     *  or whose worker has a full queue */
+    struct pool_queue injection;
+    /*! the workers, including unused ones */
+    struct pool_worker *workers;
+    /*! number of elements of \c workers,
+     *  which is the maximum number of workers */
+    int workers_capacity;
+    /*! number of active workers, changed with the mutex held,
+     *  and read atomically without it */
+    int workers_count;
+    /*! minimum number of active workers */
+    int min_workers;
+    /*! the NUMA nodes the workers are placed on,
+     *  see pool_place_workers() */
+    struct numa_node *nodes;
+    /*! number of elements of \c nodes */
+    int nodes_count;
+    /*! whether the workers are pinned to their CPUs */
+    int pinned;
+    /*! number of sleeping workers, accessed atomically */
+    int sleepers;
+    /*! number of queued or running routed conversions,
+     *  accessed atomically */
+    int load;
+    /*! time of the last scaling up */
+    double scaled_up_time;
+    /*! consistent hashing ring of all workers including unused ones,
+     *  sorted by hash, see pool_build_ring() */
+    struct pool_point *ring;
+    /*! number of elements of \c ring */
+    size_t ring_count;
+    /*! capacity of \c spares, \c retired and \c suspects */
+    size_t capacity;
+    /*! sessions ready to be used by recycled workers */
+    texcaller_session **spares;
+    /*! number of elements of \c spares */
+    size_t spares_count;
+    /*! sessions of recycled workers, to be freed */
+    texcaller_session **retired;
+    /*! number of elements of \c retired */
+    size_t retired_count;
+    /*! sessions of workers whose conversion failed, to be checked */
+    texcaller_session **suspects;
+    /*! number of elements of \c suspects */
+    size_t suspects_count;
+    /*! whether creating a spare session failed since the last request */
+    int spare_failed;
+    /*! the maintenance thread */
+    pthread_t maintainer;
+    /*! whether \c maintainer has been started */
+    int maintainer_started;
+    /*! number of threads submitting a conversion, accessed atomically */
+    int submitting;
+    /*! whether the pool is being freed, accessed atomically */
+    int stopping;
+    /*! whether no more conversions can be submitted,
+     *  so workers exit once the queues are empty,
+     *  accessed atomically */
+    int draining;
+    /*! statistics of the pool, except for \c counters */
+    texcaller_pool_stats stats;
+    /*! frequently updated statistics of the pool */
+    struct pool_counters counters;
+};
+
+/*!  @} */
+
+/*! Initialize conversion options with their default values.
+ */
+void texcaller_options_init(texcaller_options *options)
+{
+    options->languages = NULL;
+    options->assets = NULL;
+    options->assets_count = 0;
+    options->externalize = 0;
+    options->image_dpi = 0;
+    options->preview_pages = 0;
+    options->preview_verify = 0;
+    options->classic_xref = 0;
+    options->outputs = NULL;
+    options->outputs_count = 0;
+    options->profile = NULL;
+    options->priority = NULL;
+    options->stats = NULL;
+}
+
+/*! Convert a TeX or LaTeX source to DVI or PDF.
+ */
+void texcaller_convert(char **result, size_t *result_size, char **info, const char *source, size_t source_size, const char *source_format, const char *result_format, int max_runs)
+{
+    texcaller_convert_with_options(result, result_size, info,
+                                   source, source_size, source_format, result_format, max_runs,
+                                   NULL);
+}
+
+/*! Where convert_source() puts the generated document instead of memory.
+ */
+struct result_target {
+    /*! path to move the document to, or \c NULL */
+    const char *path;
+    /*! file descriptor to copy the document to, if \c path is \c NULL */
+    int fd;
+};
+
+/*! Convert a TeX or LaTeX source to DVI or PDF.
+ *
+ *  This implements texcaller_convert_with_options(),
+ *  with additional parameters for internal use.
+ *
+ *  \param log
+ *      On success, if not \c NULL,
+ *      \c log will be set to a newly allocated string
+ *      that contains the log of the last TeX run,
+ *      or to \c NULL if out of memory.
+ *
+ *  \param extra_prologue
+ *      TeX code to run before the document, or \c NULL
+ *
+ *  \param session
+ *      the session whose directory to run TeX in,
+ *      or \c NULL to use a new temporary directory
+ *
+ *  \param target
+ *      where to put the generated document instead of \c result,
+ *      which then stays \c NULL while \c result_size is set,
+ *      or \c NULL to read it into \c result.
+ *      The document is put there only after all other steps succeeded,
+ *      so a failed conversion never replaces an existing file.
+ *
+ *  \return
+ *      0 on success, -1 on failure
+ *
+ *  See texcaller_convert_with_options() for the other parameters.
+ */
+static int convert_source(char **result, size_t *result_size, char **info, char **log, const char *source, size_t source_size, const char *source_format, const char *result_format, int max_runs, const texcaller_options *options, const char *extra_prologue, texcaller_session *session, const struct result_target *target)
+{
+    char *error;
+    const char *cmd;
+    const char *cache_dir;
+    const char *args[10];
+    size_t args_count;
+    struct buffer prologue = { NULL, 0, 0 };
+    char *input_arg = NULL;
+    char *figure_salt_key = NULL;
+    struct string_list figures_ready = { NULL, 0, 0 };
+    texcaller_options default_options;
+    texcaller_stats stats;
+    struct child_priority priority;
+    char *dir = NULL;
+    char *source_filename = NULL;
+    char *aux_filename = NULL;
+    char *log_filename = NULL;
+    char *result_filename = NULL;
+    char *staged_filename = NULL;
+    int result_fd = -1;
+    int discard_result = 0;
+    char *fmt_filename = NULL;
+    char *fmt_arg = NULL;
+    char *cache_key = NULL;
+    char *files_cache_filename = NULL;
+    char *fontmap_filename = NULL;
+    char *fontmap_cache_filename = NULL;
+    char *fontmap = NULL;
+    size_t fontmap_size = 0;
+    int fontmap_in_use = 0;
+    char *aux = NULL;
+    size_t aux_size = 0;
+    char *aux_old = NULL;
+    size_t aux_old_size = 0;
+    int profile_failed = 0;
+    char *profile_error = NULL;
+    int succeeded = 0;
+    int runs;
+    int run_limit;
+    size_t i;
+    *result = NULL;
+    *result_size = 0;
+    *info = NULL;
+    if (log != NULL) {
+        *log = NULL;
+    }
+    if (options == NULL) {
+        texcaller_options_init(&default_options);
+        options = &default_options;
+    }
+    if (options->profile != NULL) {
+        *options->profile = NULL;
+    }
+    init_stats(&stats);
+    for (i = 0; i < options->outputs_count; i++) {
+        options->outputs[i].result = NULL;
+        options->outputs[i].result_size = 0;
+        options->outputs[i].time = 0;
+    }
+    /* check arguments */
+    cmd = convert_command(source_format, result_format);
+    if (cmd == NULL) {
+        *info = sprintf_alloc("Unable to convert from \"%s\" to \"%s\".",
+                              source_format, result_format);
+        goto cleanup;
+    }
+    if (max_runs < 2) {
+        *info = sprintf_alloc("Argument max_runs is %i, but must be >= 2.",
+                              max_runs);
+        goto cleanup;
+    }
+    if (parse_priority(info, &priority, options->priority, &stats) != 0) {
+        goto cleanup;
+    }
+    cache_dir = cache_directory();
+    if (options->externalize && strcmp(cmd, "pdflatex") != 0) {
+        *info = sprintf_alloc("Option externalize requires conversion from \"LaTeX\" to \"PDF\".");
+        goto cleanup;
+    }
+    if (options->preview_pages > 0 && strcmp(source_format, "LaTeX") != 0) {
+        *info = sprintf_alloc("Option preview_pages requires source format \"LaTeX\".");
+        goto cleanup;
+    }
+    if (options->outputs_count > 0 && strcmp(result_format, "DVI") != 0) {
+        *info = sprintf_alloc("Option outputs requires result format \"DVI\".");
+        goto cleanup;
+    }
+    /* look up custom format, building it if necessary */
+    if (options->languages != NULL) {
+        if (cache_dir == NULL) {
+            *info = sprintf_alloc("Option languages requires TEXCALLER_CACHE_DIR to be set.");
+            goto cleanup;
+        }
+        fmt_filename = format_cache_filename(cache_dir, cmd, options->languages);
+        if (fmt_filename == NULL) {
+            goto cleanup;
+        }
+        if (access(fmt_filename, R_OK) != 0) {
+            if (build_format(&error, cmd, options->languages, fmt_filename) != 0) {
+                *info = error;
+                goto cleanup;
+            }
+            free(error);
+        }
+        fmt_arg = sprintf_alloc("-fmt=%s", fmt_filename);
+        if (fmt_arg == NULL) {
+            goto cleanup;
+        }
+    }
+    /* create temporary directory, unless reusing the session's one */
+    if (session != NULL) {
+        dir = sprintf_alloc("%s", session->dir);
+    } else {
+        dir = create_temporary_directory(info);
+    }
+    if (dir == NULL) {
+        goto cleanup;
+    }
+    source_filename = sprintf_alloc("%s/texput.tex", dir);
+    if (source_filename == NULL) {
+        goto cleanup;
+    }
+    aux_filename = sprintf_alloc("%s/texput.aux", dir);
+    if (aux_filename == NULL) {
+        goto cleanup;
+    }
+    log_filename = sprintf_alloc("%s/texput.log", dir);
+    if (log_filename == NULL) {
+        goto cleanup;
+    }
+    if (strcmp(result_format, "DVI") == 0) {
+        result_filename = sprintf_alloc("%s/texput.dvi", dir);
+    } else {
+        result_filename = sprintf_alloc("%s/texput.pdf", dir);
+    }
+    if (result_filename == NULL) {
+        goto cleanup;
+    }
+    /* create source file and assets */
+    if (write_file(&error, source_filename, source, source_size) != 0) {
+        *info = error;
+        goto cleanup;
+    }
+    if (session == NULL && write_assets(info, dir, options, result_format, cache_dir, &priority) != 0) {
+        goto cleanup;
+    }
+    /* determine cache key of the template */
+    if (cache_dir != NULL) {
+        unsigned long hash[2] = HASH_INIT;
+        hash_update(hash, cmd, strlen(cmd) + 1);
+        hash_update(hash, source, preamble_size(source, source_size, source_format));
+        cache_key = hash_key(hash);
+        if (cache_key == NULL) {
+            goto cleanup;
+        }
+        files_cache_filename = sprintf_alloc("%s/files-%s.fls", cache_dir, cache_key);
+        if (files_cache_filename == NULL) {
+            goto cleanup;
+        }
+    }
+    /* use trimmed font map from cache, if any,
+       which is found by TeX in the current directory before the full one */
+    if (cache_dir != NULL && strcmp(result_format, "PDF") == 0) {
+        fontmap_cache_filename = sprintf_alloc("%s/fontmap-%s.map", cache_dir, cache_key);
+        if (fontmap_cache_filename == NULL) {
+            goto cleanup;
+        }
+        fontmap_filename = sprintf_alloc("%s/pdftex.map", dir);
+        if (fontmap_filename == NULL) {
+            goto cleanup;
+        }
+        read_file(&fontmap, &fontmap_size, &error, fontmap_cache_filename);
+        /* tolerate missing cache entry */
+        free(error);
+        if (fontmap != NULL) {
+            if (write_file(&error, fontmap_filename, fontmap, fontmap_size) != 0) {
+                *info = error;
+                goto cleanup;
+            }
+            fontmap_in_use = 1;
+        } else {
+            /* remove trimmed font map of a previous session build */
+            unlink(fontmap_filename);
+        }
+    }
+    if (   extra_prologue != NULL
+        && buffer_append(&prologue, extra_prologue, strlen(extra_prologue)) != 0) {
+        goto cleanup;
+    }
+    if (   options->classic_xref
+        && strcmp(result_format, "PDF") == 0
+        && buffer_append(&prologue, CLASSIC_XREF_PROLOGUE, strlen(CLASSIC_XREF_PROLOGUE)) != 0) {
+        goto cleanup;
+    }
+    /* prepare TikZ externalization, using cached figures if possible */
+    if (options->externalize) {
+        figure_salt_key = figure_salt(cmd, source, preamble_size(source, source_size, source_format));
+        if (figure_salt_key == NULL || remove_figures(dir) != 0) {
+            goto cleanup;
+        }
+        if (buffer_append(&prologue, EXTERNALIZE_PROLOGUE, strlen(EXTERNALIZE_PROLOGUE)) != 0) {
+            goto cleanup;
+        }
+    }
+    /* stop typesetting after the preview pages */
+    if (options->preview_pages > 0) {
+        char *preview_prologue = sprintf_alloc(PREVIEW_PROLOGUE,
+                                               options->preview_pages, options->preview_pages);
+        if (   preview_prologue == NULL
+            || buffer_append(&prologue, preview_prologue, strlen(preview_prologue)) != 0) {
+            free(preview_prologue);
+            goto cleanup;
+        }
+        free(preview_prologue);
+    }
+    /* assemble command line */
+    args_count = 0;
+    args[args_count++] = cmd;
+    args[args_count++] = "-interaction=batchmode";
+    args[args_count++] = "-halt-on-error";
+    args[args_count++] = "-file-line-error";
+    args[args_count++] = "-no-shell-escape";
+    if (fmt_arg != NULL) {
+        args[args_count++] = fmt_arg;
+    }
+    if (cache_dir != NULL) {
+        args[args_count++] = "-recorder";
+    }
+    if (prologue.size > 0) {
+        /* run the prologue, then the document */
+        input_arg = sprintf_alloc("%s\\input texput.tex ", prologue.data);
+        if (input_arg == NULL) {
+            goto cleanup;
+        }
+        args[args_count++] = "-jobname=texput";
+        args[args_count++] = input_arg;
+    } else {
+        args[args_count++] = "texput.tex";
+    }
+    args[args_count++] = NULL;
+    /* start with the aux file of the previous session build, if any,
+       so an unchanged aux file is stable after a single run */
+    if (session != NULL) {
+        read_aux(&aux, &aux_size, dir, aux_filename, session);
+    }
+    /* run command as often as necessary */
+    run_limit = max_runs;
+    for (runs = 1; runs <= run_limit; runs++) {
+        int figures_added = 0;
+        stats.runs = runs;
+        if (run_tex(info, dir, args, &priority, &stats, session) != 0) {
+            goto cleanup;
+        }
+        /* place or build missing TikZ figures, which requires another run
+           that doesn't count against max_runs */
+        if (options->externalize) {
+            if (build_figures(info, &figures_added, &figures_ready, dir, cmd, fmt_arg, cache_dir, figure_salt_key, &priority) != 0) {
+                goto cleanup;
+            }
+            if (figures_added > 0) {
+                run_limit++;
+            }
+        }
+        /* read new aux file, saving old one */
+        free(aux_old);
+        aux_old      = aux;
+        aux_old_size = aux_size;
+        read_aux(&aux, &aux_size, dir, aux_filename, session);
+        /* check whether aux file stabilized,
+           which is also true if there isn't and wasn't any aux file,
+           unless a preview doesn't need to */
+        if (figures_added == 0
+            && (   (options->preview_pages > 0 && !options->preview_verify)
+                || (aux_size == aux_old_size && memcmp(aux, aux_old, aux_size) == 0))) {
+            /* check trimmed font map, falling back to the full one on a miss */
+            if (   fontmap_cache_filename != NULL
+                && fontmap_update(dir, fontmap, fontmap_in_use, fontmap_cache_filename) != 0) {
+                unlink(fontmap_filename);
+                fontmap_in_use = 0;
+                run_limit++;
+                continue;
+            }
+            if (target == NULL) {
+                read_file(result, result_size, &error, result_filename);
+                if (*result == NULL) {
+                    *info = error;
+                    goto cleanup;
+                }
+            } else {
+                struct stat result_stat;
+                if (stat(result_filename, &result_stat) != 0) {
+                    *info = sprintf_alloc("Unable to obtain size of file \"%s\": %s.",
+                                          result_filename, strerror(errno));
+                    goto cleanup;
+                }
+                /* keep the document next to the target,
+                   or open so it survives removing the directory */
+                if (target->path != NULL) {
+                    const int staged_fd = create_temporary_file(&error, &staged_filename, target->path);
+                    if (staged_fd == -1) {
+                        *info = error;
+                        goto cleanup;
+                    }
+                    close(staged_fd);
+                    if (move_file(&error, result_filename, staged_filename) != 0) {
+                        *info = error;
+                        goto cleanup;
+                    }
+                } else {
+                    result_fd = open(result_filename, O_RDONLY | O_CLOEXEC);
+                    if (result_fd == -1) {
+                        *info = sprintf_alloc("Unable to open file \"%s\" for reading: %s.",
+                                              result_filename, strerror(errno));
+                        goto cleanup;
+                    }
+                }
+                *result_size = result_stat.st_size;
+            }
+            succeeded = 1;
+            if (files_cache_filename != NULL) {
+                cache_recorded_files(dir, files_cache_filename);
+            }
+            if (options->preview_pages > 0) {
+                stats.truncated = preview_truncated(log_filename);
+            }
+            if (log != NULL) {
+                size_t log_size;
+                read_file(log, &log_size, &error, log_filename);
+                free(error);
+            }
+            if (options->outputs_count > 0
+                && produce_outputs(info, dir, options->outputs, options->outputs_count, &priority) != 0) {
+                free(*result);
+                *result = NULL;
+                *result_size = 0;
+                succeeded = 0;
+                goto cleanup;
+            }
+            /* profiling is optional, so its failure is only reported */
+            if (   options->profile != NULL
+                && profile_document(options->profile, &error, dir, source_format, &priority) != 0) {
+                profile_failed = 1;
+                profile_error = error;
+            }
+            *info = sprintf_alloc("Generated %s (%lu bytes)"
+                                  " from %s (%lu bytes) after %i runs.%s%s",
+                                  result_format, (unsigned long)*result_size,
+                                  source_format, (unsigned long)source_size, runs,
+                                  profile_failed ? "\nProfiling failed: " : "",
+                                  profile_failed ? (profile_error != NULL ? profile_error : "Out of memory.") : "");
+            goto cleanup;
+        }
+    }
+    /* aux file didn't stabilize */
+    *info = sprintf_alloc("Output didn't stabilize after %i runs.",
+                          max_runs);
+    goto cleanup;
+    /* cleanup all used resources */
+cleanup:
+    if (log_filename != NULL) {
+        append_log(info, log_filename);
+    }
+    if (session != NULL && !succeeded && dir != NULL) {
+        reset_session(dir);
+    }
+    if (session == NULL && dir != NULL && remove_directory_recursively(&error, dir) != 0) {
+        discard_result = 1;
+    } else if (succeeded && target != NULL) {
+        /* publish the document, now that nothing else can fail */
+        if (target->path != NULL) {
+            if (rename(staged_filename, target->path) != 0) {
+                error = sprintf_alloc("Unable to rename file \"%s\" to \"%s\": %s.",
+                                      staged_filename, target->path, strerror(errno));
+                discard_result = 1;
+            }
+        } else if (copy_data(&error, result_fd, result_filename, target->fd) != 0) {
+            discard_result = 1;
+        }
+    }
+    if (discard_result) {
+        free(*result);
+        *result = NULL;
+        *result_size = 0;
+        succeeded = 0;
+        for (i = 0; i < options->outputs_count; i++) {
+            free(options->outputs[i].result);
+            options->outputs[i].result = NULL;
+            options->outputs[i].result_size = 0;
+        }
+        free(*info);
+        *info = error;
+    }
+    if (staged_filename != NULL && !succeeded) {
+        unlink(staged_filename);
+    }
+    if (result_fd != -1) {
+        close(result_fd);
+    }
+    if (log != NULL && !succeeded) {
+        free(*log);
+        *log = NULL;
+    }
+    if (options->stats != NULL) {
+        *options->stats = stats;
+    }
+    free(dir);
+    free(source_filename);
+    free(aux_filename);
+    free(log_filename);
+    free(result_filename);
+    free(staged_filename);
+    free(fmt_filename);
+    free(fmt_arg);
+    free(prologue.data);
+    free(input_arg);
+    free(figure_salt_key);
+    string_list_free(&figures_ready);
+    free(cache_key);
+    free(files_cache_filename);
+    free(fontmap_filename);
+    free(fontmap_cache_filename);
+    free(fontmap);
+    free(aux);
+    free(aux_old);
+    free(profile_error);
+    return succeeded ? 0 : -1;
+}
+
+/*! Convert a TeX or LaTeX source to DVI or PDF, with additional options.
+ */
+void texcaller_convert_with_options(char **result, size_t *result_size, char **info, const char *source, size_t source_size, const char *source_format, const char *result_format, int max_runs, const texcaller_options *options)
+{
+    convert_source(result, result_size, info, NULL,
+                   source, source_size, source_format, result_format, max_runs,
+                   options, NULL, NULL, NULL);
+}
+
+/*! Convert a TeX or LaTeX source to DVI or PDF, moving the result to a file.
+ */
+int texcaller_convert_to_path(char **info, const char *path, const char *source, size_t source_size, const char *source_format, const char *result_format, int max_runs, const texcaller_options *options)
+{
+    struct result_target target;
+    char *result;
+    size_t result_size;
+    target.path = path;
+    target.fd = -1;
+    return convert_source(&result, &result_size, info, NULL,
+                          source, source_size, source_format, result_format, max_runs,
+                          options, NULL, NULL, &target);
+}
+
+/*! Convert a TeX or LaTeX source to DVI or PDF, copying the result to a file descriptor.
+ */
+int texcaller_convert_to_fd(char **info, int fd, const char *source, size_t source_size, const char *source_format, const char *result_format, int max_runs, const texcaller_options *options)
+{
+    struct result_target target;
+    char *result;
+    size_t result_size;
+    target.path = NULL;
+    target.fd = fd;
+    return convert_source(&result, &result_size, info, NULL,
+                          source, source_size, source_format, result_format, max_runs,
+                          options, NULL, NULL, &target);
+}
+
+/*! Convert a LaTeX template with many records to one PDF per record.
+ */
+void texcaller_convert_merge(char **results, size_t *result_sizes, char **info, const char *source, size_t source_size, const char *const *records, const size_t *record_sizes, size_t records_count, size_t chunk_size, int max_runs, const texcaller_options *options)
+{
+    const char end_document[] = "\\end{document}";
+    const size_t end_document_length = sizeof(end_document) - 1;
+    texcaller_options default_options;
+    texcaller_options chunk_options;
+    texcaller_stats chunk_stats;
+    texcaller_stats stats;
+    struct buffer document = { NULL, 0, 0 };
+    size_t *first_pages = NULL;
+    char *prologue = NULL;
+    char *pdf = NULL;
+    char *log = NULL;
+    size_t body_start;
+    size_t body_end;
+    size_t chunks = 0;
+    size_t i;
+    int status = -1;
+    *info = NULL;
+    for (i = 0; i < records_count; i++) {
+        results[i] = NULL;
+        result_sizes[i] = 0;
+    }
+    if (options == NULL) {
+        texcaller_options_init(&default_options);
+        options = &default_options;
+    }
+    init_stats(&stats);
+    /* check arguments */
+    if (options->preview_pages > 0 || options->outputs_count > 0) {
+        *info = sprintf_alloc("Options preview_pages and outputs are not supported for mail merge.");
+        goto cleanup;
+    }
+    body_start = preamble_size(source, source_size, "LaTeX");
+    if (body_start == source_size) {
+        *info = sprintf_alloc("Template doesn't contain \\begin{document}.");
+        goto cleanup;
+    }
+    body_start += strlen("\\begin{document}");
+    for (body_end = body_start; body_end + end_document_length <= source_size; body_end++) {
+        if (memcmp(source + body_end, end_document, end_document_length) == 0) {
+            break;
+        }
+    }
+    if (body_end + end_document_length > source_size) {
+        *info = sprintf_alloc("Template doesn't contain \\end{document}.");
+        goto cleanup;
+    }
+    if (chunk_size == 0 || chunk_size > records_count) {
+        chunk_size = records_count;
+    }
+    first_pages = (size_t *)malloc((chunk_size + 1) * sizeof(size_t));
+    prologue = merge_prologue();
+    if (first_pages == NULL || prologue == NULL) {
+        goto cleanup;
+    }
+    chunk_options = *options;
+    chunk_options.stats = &chunk_stats;
+    /* convert all chunks */
+    for (i = 0; i < records_count; i += chunk_size) {
+        const size_t count = records_count - i < chunk_size ? records_count - i : chunk_size;
+        size_t pdf_size;
+        document.size = 0;
+        if (merge_document(&document, source, body_start, body_end,
+                           records + i, record_sizes + i, count) != 0) {
+            goto cleanup;
+        }
+        convert_source(&pdf, &pdf_size, info, &log,
+                       document.data, document.size, "LaTeX", "PDF", max_runs,
+                       &chunk_options, prologue, NULL, NULL);
+        add_stats(&stats, &chunk_stats);
+        if (pdf == NULL) {
+            goto cleanup;
+        }
+        free(*info);
+        *info = NULL;
+        if (log == NULL) {
+            goto cleanup;
+        }
+        if (merge_first_pages(first_pages, log, count) != 0) {
+            *info = sprintf_alloc("Unable to find the page boundaries of records %lu to %lu in the log.",
+                                  (unsigned long)i + 1, (unsigned long)(i + count));
+            goto cleanup;
+        }
+        if (pdf_split(info, results + i, result_sizes + i, pdf, pdf_size, first_pages, count) != 0) {
+            goto cleanup;
+        }
+        free(pdf);
+        pdf = NULL;
+        free(log);
+        log = NULL;
+        chunks++;
+    }
+    status = 0;
+    *info = sprintf_alloc("Generated %lu PDFs in %lu chunks after %i runs.",
+                          (unsigned long)records_count, (unsigned long)chunks, stats.runs);
+    goto cleanup;
+    /* cleanup all used resources */
+cleanup:
+    if (status != 0) {
+        for (i = 0; i < records_count; i++) {
+            free(results[i]);
+            results[i] = NULL;
+            result_sizes[i] = 0;
+        }
+    }
+    if (options->stats != NULL) {
+        *options->stats = stats;
+    }
+    free(document.data);
+    free(first_pages);
+    free(prologue);
+    free(pdf);
+    free(log);
+}
+
+/*! Create a session for converting a document repeatedly.
+ */
+texcaller_session *texcaller_session_create(char **info, const char *source_format, const char *result_format, const texcaller_options *options)
+{
+    texcaller_session *session;
+    texcaller_options default_options;
+    struct child_priority priority;
+    *info = NULL;
+    if (options == NULL) {
+        texcaller_options_init(&default_options);
+        options = &default_options;
+    }
+    if (convert_command(source_format, result_format) == NULL) {
+        *info = sprintf_alloc("Unable to convert from \"%s\" to \"%s\".",
+                              source_format, result_format);
+        return NULL;
+    }
+    if (parse_priority(info, &priority, options->priority, NULL) != 0) {
+        return NULL;
+    }
+    session = (texcaller_session *)malloc(sizeof(texcaller_session));
+    if (session == NULL) {
+        return NULL;
+    }
+    session->options = *options;
+    session->options.assets = NULL;
+    session->options.assets_count = 0;
+    session->pid = 0;
+    session->cancelled = 0;
+    session->building = NULL;
+    session->building_count = 0;
+    session->chapters = NULL;
+    session->chapters_count = 0;
+    session->pdf = NULL;
+    session->pdf_size = 0;
+    session->source_format = sprintf_alloc("%s", source_format);
+    session->result_format = sprintf_alloc("%s", result_format);
+    session->dir = create_temporary_directory(info);
+    if (session->source_format == NULL || session->result_format == NULL || session->dir == NULL) {
+        texcaller_session_free(session);
+        return NULL;
+    }
+    /* write and convert assets only once */
+    if (write_assets(info, session->dir, options, result_format, cache_directory(), &priority) != 0) {
+        texcaller_session_free(session);
+        return NULL;
+    }
+    return session;
+}
+
+/*! Convert the document of a session.
+ */
+void texcaller_session_convert(char **result, size_t *result_size, char **info, texcaller_session *session, const char *source, size_t source_size, int max_runs)
+{
+    __sync_fetch_and_and(&session->cancelled, 0);
+    convert_source(result, result_size, info, NULL,
+                   source, source_size, session->source_format, session->result_format, max_runs,
+                   &session->options, NULL, session, NULL);
+}
+
+/*! Convert a LaTeX project of a session, rebuilding only changed chapters.
+ */
+void texcaller_session_convert_project(char **result, size_t *result_size, char **info, texcaller_session *session, const char *source, size_t source_size, const texcaller_chapter *chapters, size_t chapters_count, int max_runs)
+{
+    char *error;
+    texcaller_options build_options;
+    texcaller_stats build_stats;
+    texcaller_stats stats;
+    unsigned long source_hash[2] = HASH_INIT;
+    unsigned long (*hashes)[2] = NULL;
+    char *changed = NULL;
+    size_t *begins = NULL;
+    size_t *ends = NULL;
+    struct pdf_range *ranges = NULL;
+    char *prologue = NULL;
+    char *pdf = NULL;
+    size_t pdf_size;
+    char *aux_filename = NULL;
+    char *aux = NULL;
+    size_t aux_size = 0;
+    char *aux_new = NULL;
+    size_t aux_new_size = 0;
+    size_t changed_count = 0;
+    int full;
+    size_t i;
+    size_t j;
+    *result = NULL;
+    *result_size = 0;
+    *info = NULL;
+    __sync_fetch_and_and(&session->cancelled, 0);
+    init_stats(&stats);
+    build_options = session->options;
+    build_options.stats = &build_stats;
+    /* check arguments */
+    if (   strcmp(session->source_format, "LaTeX") != 0
+        || strcmp(session->result_format, "PDF") != 0) {
+        *info = sprintf_alloc("Projects require a session converting from \"LaTeX\" to \"PDF\".");
+        goto cleanup;
+    }
+    for (i = 0; i < chapters_count; i++) {
+        if (!valid_chapter_name(chapters[i].name)) {
+            *info = sprintf_alloc("Invalid chapter name \"%s\".", chapters[i].name);
+            goto cleanup;
+        }
+        for (j = 0; j < i; j++) {
+            if (strcmp(chapters[i].name, chapters[j].name) == 0) {
+                *info = sprintf_alloc("Duplicate chapter name \"%s\".", chapters[i].name);
+                goto cleanup;
+            }
+        }
+    }
+    hashes = (unsigned long (*)[2])malloc((chapters_count + 1) * sizeof(*hashes));
+    changed = (char *)calloc(chapters_count + 1, 1);
+    begins = (size_t *)malloc((chapters_count + 1) * sizeof(size_t));
+    ends = (size_t *)malloc((chapters_count + 1) * sizeof(size_t));
+    ranges = (struct pdf_range *)malloc((2 * chapters_count + 1) * sizeof(struct pdf_range));
+    if (hashes == NULL || changed == NULL || begins == NULL || ends == NULL || ranges == NULL) {
+        goto cleanup;
+    }
+    /* determine changed chapters, if a partial build is possible */
+    hash_update(source_hash, source, source_size);
+    full = session->pdf == NULL
+        || session->chapters_count != chapters_count
+        || memcmp(session->source_hash, source_hash, sizeof(source_hash)) != 0;
+    for (i = 0; i < chapters_count; i++) {
+        const unsigned long hash_init[2] = HASH_INIT;
+        memcpy(hashes[i], hash_init, sizeof(hash_init));
+        hash_update(hashes[i], chapters[i].data, chapters[i].size);
+        if (full || strcmp(session->chapters[i].name, chapters[i].name) != 0) {
+            full = 1;
+        } else if (memcmp(session->chapters[i].hash, hashes[i], sizeof(hashes[i])) != 0) {
+            changed[i] = 1;
+            changed_count++;
+        }
+    }
+    if (!full && changed_count == 0) {
+        *result = (char *)malloc(session->pdf_size + 1);
+        if (*result == NULL) {
+            goto cleanup;
+        }
+        memcpy(*result, session->pdf, session->pdf_size);
+        *result_size = session->pdf_size;
+        *info = sprintf_alloc("Reused PDF (%lu bytes) of the unchanged project.",
+                              (unsigned long)*result_size);
+        goto cleanup;
+    }
+    /* write the chapters that changed */
+    for (i = 0; i < chapters_count; i++) {
+        if (full || changed[i]) {
+            char *filename = sprintf_alloc("%s/%s.tex", session->dir, chapters[i].name);
+            if (filename == NULL) {
+                goto cleanup;
+            }
+            if (write_file(&error, filename, chapters[i].data, chapters[i].size) != 0) {
+                free(filename);
+                *info = error;
+                goto cleanup;
+            }
+            free(filename);
+        }
+    }
+    session->building = chapters;
+    session->building_count = chapters_count;
+    /* typeset only the changed chapters,
+       splicing their pages into the previous PDF
+       if nothing else can be affected by them */
+    if (!full) {
+        prologue = project_prologue(chapters, chapters_count, changed);
+        aux_filename = sprintf_alloc("%s/texput.aux", session->dir);
+        if (prologue == NULL || aux_filename == NULL) {
+            goto cleanup;
+        }
+        read_file(&aux, &aux_size, &error, aux_filename);
+        free(error);
+        convert_source(&pdf, &pdf_size, info, NULL,
+                       source, source_size, session->source_format, session->result_format, max_runs,
+                       &build_options, prologue, session, NULL);
+        add_stats(&stats, &build_stats);
+        if (pdf == NULL) {
+            goto cleanup;
+        }
+        free(*info);
+        *info = NULL;
+        /* the main aux file has to be unchanged as well */
+        read_file(&aux_new, &aux_new_size, &error, aux_filename);
+        free(error);
+        full = aux == NULL
+            || aux_new == NULL
+            || aux_new_size != aux_size
+            || memcmp(aux_new, aux, aux_size) != 0
+            || project_page_ranges(begins, ends, session->dir, chapters, chapters_count) != 0;
+        for (i = 0; i < chapters_count && !full; i++) {
+            if (changed[i]) {
+                char *filename = sprintf_alloc("%s/%s.aux", session->dir, chapters[i].name);
+                if (filename == NULL) {
+                    goto cleanup;
+                }
+                free(aux_new);
+                read_file(&aux_new, &aux_new_size, &error, filename);
+                free(error);
+                free(filename);
+                full = ends[i] - begins[i] != session->chapters[i].pages
+                    || aux_new == NULL
+                    || aux_new_size != session->chapters[i].aux_size
+                    || memcmp(aux_new, session->chapters[i].aux, aux_new_size) != 0;
+            }
+        }
+        if (!full) {
+            const char *pdfs[2];
+            size_t pdf_sizes[2];
+            size_t ranges_count = 0;
+            size_t page = 0;
+            pdfs[0] = pdf;
+            pdf_sizes[0] = pdf_size;
+            pdfs[1] = session->pdf;
+            pdf_sizes[1] = session->pdf_size;
+            /* take everything from the partial PDF,
+               except for the pages of unchanged chapters */
+            for (i = 0; i < chapters_count; i++) {
+                if (!changed[i]) {
+                    ranges[ranges_count].pdf = 0;
+                    ranges[ranges_count].first = page;
+                    ranges[ranges_count].count = begins[i] - page;
+                    ranges_count++;
+                    ranges[ranges_count].pdf = 1;
+                    ranges[ranges_count].first = session->chapters[i].first_page;
+                    ranges[ranges_count].count = session->chapters[i].pages;
+                    ranges_count++;
+                    page = ends[i];
+                }
+            }
+            ranges[ranges_count].pdf = 0;
+            ranges[ranges_count].first = page;
+            ranges[ranges_count].count = PDF_REMAINING_PAGES;
+            ranges_count++;
+            if (pdf_splice(&error, result, result_size, pdfs, pdf_sizes, 2, ranges, ranges_count) != 0) {
+                /* fall back to a full build */
+                free(error);
+                full = 1;
+            }
+        }
+        free(prologue);
+        prologue = NULL;
+    }
+    if (!full) {
+        /* keep the spliced PDF, whose page ranges are unchanged */
+        free(pdf);
+        pdf = (char *)malloc(*result_size + 1);
+        if (pdf == NULL) {
+            free(*result);
+            *result = NULL;
+            *result_size = 0;
+            goto cleanup;
+        }
+        memcpy(pdf, *result, *result_size);
+        free(session->pdf);
+        session->pdf = pdf;
+        session->pdf_size = *result_size;
+        pdf = NULL;
+        for (i = 0; i < chapters_count; i++) {
+            memcpy(session->chapters[i].hash, hashes[i], sizeof(hashes[i]));
+        }
+    } else {
+        /* typeset all chapters, keeping their aux files and pages */
+        project_reset(session);
+        changed_count = chapters_count;
+        prologue = project_prologue(chapters, chapters_count, NULL);
+        if (prologue == NULL) {
+            goto cleanup;
+        }
+        convert_source(result, result_size, info, NULL,
+                       source, source_size, session->source_format, session->result_format, max_runs,
+                       &build_options, prologue, session, NULL);
+        add_stats(&stats, &build_stats);
+        if (*result == NULL) {
+            goto cleanup;
+        }
+        free(*info);
+        *info = NULL;
+        /* without page ranges, such as for a chapter that isn't included,
+           the next project build is a full one as well */
+        if (project_page_ranges(begins, ends, session->dir, chapters, chapters_count) == 0) {
+            project_store(session, chapters, chapters_count, (const unsigned long (*)[2])hashes,
+                          begins, ends, source_hash, *result, *result_size);
+        }
+    }
+    *info = sprintf_alloc("Generated PDF (%lu bytes) from LaTeX project"
+                          " with %lu of %lu chapters rebuilt after %i runs.",
+                          (unsigned long)*result_size,
+                          (unsigned long)changed_count, (unsigned long)chapters_count,
+                          stats.runs);
+    /* cleanup all used resources */
+cleanup:
+    if (*result == NULL && session->building != NULL) {
+        /* discard aux files a failed run may have broken */
+        project_reset(session);
+        for (i = 0; i < chapters_count; i++) {
+            char *filename = sprintf_alloc("%s/%s.aux", session->dir, chapters[i].name);
+            if (filename != NULL) {
+                unlink(filename);
+                free(filename);
+            }
+        }
+    }
+    session->building = NULL;
+    session->building_count = 0;
+    if (session->options.stats != NULL) {
+        *session->options.stats = stats;
+    }
+    free(hashes);
+    free(changed);
+    free(begins);
+    free(ends);
+    free(ranges);
+    free(prologue);
+    free(pdf);
+    free(aux_filename);
+    free(aux);
+    free(aux_new);
+}
+
+/*! Cancel the running conversion of a session.
+ */
+void texcaller_session_cancel(texcaller_session *session)
+{
+    pid_t pid;
+    __sync_fetch_and_or(&session->cancelled, 1);
+    pid = __sync_fetch_and_add(&session->pid, 0);
+    if (pid > 0) {
+        kill(pid, SIGKILL);
+    }
+}
+
+/*! Free a session, removing its directory.
+ */
+void texcaller_session_free(texcaller_session *session)
+{
+    char *error;
+    if (session->dir != NULL) {
+        remove_directory_recursively(&error, session->dir);
+        free(error);
+    }
+    project_reset(session);
+    free(session->dir);
+    free(session->source_format);
+    free(session->result_format);
+    free(session);
+}
+
+/*! Check a working directory of a pool by a canary conversion.
+ *
+ *  The directory is reset afterwards, see reset_session().
+ *
+ *  \return
+ *      0 if the canary conversion succeeded, -1 otherwise
+ *
+ *  \param info
+ *      will be set to a newly allocated string that contains
+ *      additional information such as an error message,
+ *      or \c NULL when out of memory.
+ *
+ *  \param pool
+ *      the pool
+ *
+ *  \param session
+ *      the session whose directory to check
+ */
+static int pool_canary(char **info, texcaller_pool *pool, texcaller_session *session)
+{
+    const char source[] = "\\shipout\\hbox{}\\end";
+    char *result;
+    size_t result_size;
+    __sync_fetch_and_and(&session->cancelled, 0);
+    convert_source(&result, &result_size, info, NULL,
+                   source, sizeof(source) - 1, "TeX", "DVI", 2,
+                   NULL, NULL, session, NULL);
+    reset_session(session->dir);
+    pthread_mutex_lock(&pool->mutex);
+    pool->stats.canaries++;
+    pthread_mutex_unlock(&pool->mutex);
+    if (result == NULL) {
+        return -1;
+    }
+    free(result);
+    return 0;
+}
+
+/*! Create a working directory for a pool,
+ *  checked by a canary conversion.
+ *
+ *  \return
+ *      the session of the new working directory, or \c NULL on failure
+ *
+ *  \param info
+ *      On failure, \c info will be set to a newly allocated string
+ *      that contains the error message.
+ *      On success, or when out of memory,
+ *      \c info will be set to \c NULL.
+ *
+ *  \param pool
+ *      the pool
+ */
+static texcaller_session *pool_create_session(char **info, texcaller_pool *pool)
+{
+    texcaller_session *session = texcaller_session_create(info, "TeX", "DVI", NULL);
+    char *error;
+    if (session == NULL) {
+        return NULL;
+    }
+    if (pool_canary(&error, pool, session) != 0) {
+        *info = sprintf_alloc("Canary conversion failed: %s",
+                              error == NULL ? "Out of memory." : error);
+        free(error);
+        texcaller_session_free(session);
+        return NULL;
+    }
+    free(error);
+    return session;
+}
+
+/*! Number of points of every worker on the consistent hashing ring.
+ */
+#define POOL_RING_POINTS 16
+
+/*! Compute the fingerprint of the template of a conversion,
+ *  which determines the worker the conversion is routed to.
+ *
+ *  \return
+ *      the fingerprint
+ *
+ *  See texcaller_pool_convert() for the parameters.
+ */
+static unsigned long pool_fingerprint(const char *source, size_t source_size, const char *source_format, const char *result_format, const texcaller_options *options)
+{
+    unsigned long hash[2] = HASH_INIT;
+    hash_update(hash, source_format, strlen(source_format) + 1);
+    hash_update(hash, result_format, strlen(result_format) + 1);
+    if (options != NULL && options->languages != NULL) {
+        hash_update(hash, options->languages, strlen(options->languages) + 1);
+    }
+    hash_update(hash, source, preamble_size(source, source_size, source_format));
+    return hash[0];
+}
+
+/*! Compare two points of a consistent hashing ring, for qsort().
+ */
+static int pool_point_compare(const void *a, const void *b)
+{
+    const unsigned long hash_a = ((const struct pool_point *)a)->hash;
+    const unsigned long hash_b = ((const struct pool_point *)b)->hash;
+    return hash_a < hash_b ? -1 : hash_a > hash_b ? 1 : 0;
+}
+
+/*! Number of slots of the job queue of every worker, a power of 2.
+ */
+#define POOL_QUEUE_SIZE 64
+
+/*! Number of slots of the injection queue of a pool, a power of 2.
+ *  Submitters wait for a free slot when it is full.
+ */
+#define POOL_INJECTION_SIZE 1024
+
+/*! Initialize an empty job queue.
+ *
+ *  \return
+ *      0 on success, -1 when out of memory
+ *
+ *  \param queue
+ *      the queue, to be freed by free() of its \c slots
+ *
+ *  \param size
+ *      number of slots, a power of 2
+ */
+static int pool_queue_init(struct pool_queue *queue, unsigned long size)
+{
+    unsigned long i;
+    queue->slots = (struct pool_slot *)malloc(size * sizeof(struct pool_slot));
+    if (queue->slots == NULL) {
+        return -1;
+    }
+    for (i = 0; i < size; i++) {
+        queue->slots[i].sequence = i;
+        queue->slots[i].job = NULL;
+        queue->slots[i].queued_time = 0;
+    }
+    queue->mask = size - 1;
+    queue->push_position = 0;
+    queue->pop_position = 0;
+    return 0;
+}
+
+/*! Push a conversion to a job queue, without any lock.
+ *
+ *  \return
+ *      0 on success, -1 if the queue is full
+ *
+ *  \param queue
+ *      the queue
+ *
+ *  \param job
+ *      the conversion
+ *
+ *  \param cas_failures
+ *      will be increased by the number of failed compare-and-swap attempts
+ */
+static int pool_queue_push(struct pool_queue *queue, struct texcaller_pool_job *job, unsigned long *cas_failures)
+{
+    unsigned long position = __atomic_load_n(&queue->push_position, __ATOMIC_RELAXED);
+    for (;;) {
+        struct pool_slot *slot = &queue->slots[position & queue->mask];
+        const long difference = (long)(__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) - position);
+        if (difference == 0) {
+            if (__atomic_compare_exchange_n(&queue->push_position, &position, position + 1, 0,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                slot->job = job;
+                __atomic_store(&slot->queued_time, &job->queued_time, __ATOMIC_RELAXED);
+                __atomic_store_n(&slot->sequence, position + 1, __ATOMIC_RELEASE);
+                return 0;
+            }
+            (*cas_failures)++;
+        } else if (difference < 0) {
+            return -1;
+        } else {
+            position = __atomic_load_n(&queue->push_position, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+/*! Pop the oldest conversion from a job queue, without any lock.
+ *
+ *  \return
+ *      the conversion, or \c NULL if the queue is empty
+ *
+ *  \param queue
+ *      the queue
+ *
+ *  \param cas_failures
+ *      will be increased by the number of failed compare-and-swap attempts
+ */
+static struct texcaller_pool_job *pool_queue_pop(struct pool_queue *queue, unsigned long *cas_failures)
+{
+    unsigned long position = __atomic_load_n(&queue->pop_position, __ATOMIC_RELAXED);
+    for (;;) {
+        struct pool_slot *slot = &queue->slots[position & queue->mask];
+        const long difference = (long)(__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) - (position + 1));
+        if (difference == 0) {
+            if (__atomic_compare_exchange_n(&queue->pop_position, &position, position + 1, 0,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                struct texcaller_pool_job *job = slot->job;
+                __atomic_store_n(&slot->sequence, position + queue->mask + 1, __ATOMIC_RELEASE);
+                return job;
+            }
+            (*cas_failures)++;
+        } else if (difference < 0) {
+            return NULL;
+        } else {
+            position = __atomic_load_n(&queue->pop_position, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+/*! Determine when the oldest conversion of a job queue was queued.
+ *
+ *  This doesn't pop the conversion and may miss it
+ *  while other threads push or pop at the same time,
+ *  which is fine for scaling decisions.
+ *
+ *  \return
+ *      the \c queued_time of the oldest conversion,
+ *      or 0 if the queue is empty
+ *
+ *  \param queue
+ *      the queue
+ */
+static double pool_queue_oldest(struct pool_queue *queue)
+{
+    const unsigned long position = __atomic_load_n(&queue->pop_position, __ATOMIC_ACQUIRE);
+    struct pool_slot *slot = &queue->slots[position & queue->mask];
+    double queued_time;
+    if (__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) != position + 1) {
+        return 0;
+    }
+    __atomic_load(&slot->queued_time, &queued_time, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&slot->sequence, __ATOMIC_RELAXED) != position + 1) {
+        return 0;
+    }
+    return queued_time;
+}
+
+/*! Determine how long the oldest queued conversion of a pool has waited.
+ *
+ *  \return
+ *      the time in seconds, or 0 if no conversion is queued
+ *
+ *  \param pool
+ *      the pool
+ *
+ *  \param now
+ *      the current time, see current_time()
+ */
+static double pool_wait_time(texcaller_pool *pool, double now)
+{
+    double oldest = pool_queue_oldest(&pool->injection);
+    int w;
+    for (w = 0; w < pool->workers_capacity; w++) {
+        const double queued_time = pool_queue_oldest(&pool->workers[w].queue);
+        if (queued_time > 0 && (oldest == 0 || queued_time < oldest)) {
+            oldest = queued_time;
+        }
+    }
+    return oldest > 0 ? now - oldest : 0;
+}
+
+/*! Assign the workers of a pool to NUMA nodes and CPUs,
+ *  see texcaller_pool_options::placement.
+ *
+ *  Workers are assigned in the order of their index,
+ *  so the workers added by scaling are spread as well.
+ *  Only Linux supports placements other than \c "none".
+ *
+ *  \return
+ *      0 on success, -1 on failure
+ *
+ *  \param info
+ *      On failure, \c info will be set to a newly allocated string
+ *      that contains the error message,
+ *      or \c NULL when out of memory.
+ *
+ *  \param pool
+ *      the pool
+ */
+static int pool_place_workers(char **info, texcaller_pool *pool)
+{
+    const char *placement = pool->options.placement;
+    int w;
+#ifdef __linux__
+    int cpus = 0;
+    int n;
+    pool->nodes_count = read_numa_nodes(pool->nodes);
+#else
+    pool->nodes_count = 1;
+#endif
+    if (placement == NULL) {
+        placement = pool->nodes_count > 1 ? "node" : "none";
+    }
+    if (strcmp(placement, "none") == 0) {
+        /* a single pseudo node with all CPUs */
+#ifdef __linux__
+        for (n = 1; n < pool->nodes_count; n++) {
+            CPU_OR(&pool->nodes[0].cpus, &pool->nodes[0].cpus, &pool->nodes[n].cpus);
+        }
+#endif
+        pool->nodes[0].id = -1;
+        pool->nodes_count = 1;
+        pool->pinned = 0;
+        for (w = 0; w < pool->workers_capacity; w++) {
+            pool->workers[w].node = 0;
+        }
+#ifdef __linux__
+    } else if (strcmp(placement, "node") == 0) {
+        pool->pinned = 1;
+        for (w = 0; w < pool->workers_capacity; w++) {
+            pool->workers[w].node = w % pool->nodes_count;
+            pool->workers[w].cpus = pool->nodes[w % pool->nodes_count].cpus;
+        }
+    } else if (strcmp(placement, "cpu") == 0) {
+        pool->pinned = 1;
+        for (n = 0; n < pool->nodes_count; n++) {
+            cpus += CPU_COUNT(&pool->nodes[n].cpus);
+        }
+        for (w = 0; w < pool->workers_capacity; w++) {
+            /* find the CPU of the worker among the CPUs of all nodes */
+            int skip = w % cpus;
+            int cpu = 0;
+            for (n = 0; skip >= CPU_COUNT(&pool->nodes[n].cpus); n++) {
+                skip -= CPU_COUNT(&pool->nodes[n].cpus);
+            }
+            for (;; cpu++) {
+                if (CPU_ISSET(cpu, &pool->nodes[n].cpus) && skip-- == 0) {
+                    break;
+                }
+            }
+            pool->workers[w].node = n;
+            CPU_ZERO(&pool->workers[w].cpus);
+            CPU_SET(cpu, &pool->workers[w].cpus);
+        }
+#else
+    } else if (strcmp(placement, "node") == 0 || strcmp(placement, "cpu") == 0) {
+        *info = sprintf_alloc("Placement \"%s\" is only supported on Linux.", placement);
+        return -1;
+#endif
+    } else {
+        *info = sprintf_alloc("Unknown placement \"%s\".", placement);
+        return -1;
+    }
+    return 0;
+}
+
+/*! Build the consistent hashing ring of a pool from all its workers,
+ *  including unused ones, which are skipped by pool_route().
+ *
+ *  Every worker has its own points on the ring,
+ *  which don't depend on the other workers,
+ *  so adding or removing a worker only moves the templates
+ *  that are routed to that worker,
+ *  and the ring never changes while the pool runs.
+ *
+ *  \param pool
+ *      the pool
+ */
+static void pool_build_ring(texcaller_pool *pool)
+{
+    int w;
+    int i;
+    pool->ring_count = 0;
+    for (w = 0; w < pool->workers_capacity; w++) {
+        for (i = 0; i < POOL_RING_POINTS; i++) {
+            unsigned long hash[2] = HASH_INIT;
+            hash_update(hash, (const char *)&w, sizeof(w));
+            hash_update(hash, (const char *)&i, sizeof(i));
+            pool->ring[pool->ring_count].hash = hash[0];
+            pool->ring[pool->ring_count].worker = w;
+            pool->ring_count++;
+        }
+    }
+    qsort(pool->ring, pool->ring_count, sizeof(struct pool_point), pool_point_compare);
+}
+
+/*! Choose the worker to route a conversion to,
+ *  via consistent hashing with bounded loads.
+ *
+ *  The worker is the first active one on the ring after the fingerprint
+ *  whose load stays within 125% of the average load,
+ *  where the load of a worker is its queued and running conversions.
+ *  So conversions of the same template go to the same worker,
+ *  which has the matching working directory,
+ *  unless that worker is overloaded.
+ *
+ *  This reads the loads without any lock,
+ *  so concurrent submitters may both choose the same worker.
+ *
+ *  \return
+ *      index of the worker, or -1 if there are no active workers
+ *
+ *  \param pool
+ *      the pool
+ *
+ *  \param fingerprint
+ *      the fingerprint of the template, see pool_fingerprint()
+ */
+static int pool_route(texcaller_pool *pool, unsigned long fingerprint)
+{
+    const int workers = __atomic_load_n(&pool->workers_count, __ATOMIC_RELAXED);
+    const unsigned long load = __atomic_load_n(&pool->load, __ATOMIC_RELAXED) + 1;
+    unsigned long bound;
+    size_t low = 0;
+    size_t high = pool->ring_count;
+    size_t i;
+    int fallback = -1;
+    if (workers <= 0) {
+        return -1;
+    }
+    bound = (load * 5 + 4 * workers - 1) / (4 * workers);
+    /* find the first point at or after the fingerprint */
+    while (low < high) {
+        const size_t middle = low + (high - low) / 2;
+        if (pool->ring[middle].hash < fingerprint) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    for (i = 0; i < pool->ring_count; i++) {
+        const int w = pool->ring[(low + i) % pool->ring_count].worker;
+        struct pool_worker *worker = &pool->workers[w];
+        if (__atomic_load_n(&worker->state, __ATOMIC_RELAXED) != POOL_WORKER_ACTIVE) {
+            continue;
+        }
+        if ((unsigned long)__atomic_load_n(&worker->load, __ATOMIC_RELAXED) < bound) {
+            return w;
+        }
+        if (fallback == -1) {
+            fallback = w;
+        }
+    }
+    return fallback;
+}
+
+/*! Determine whether a worker of a pool should exit
+ *  once it finds no more conversions.
+ *
+ *  \return
+ *      nonzero if the worker is retiring or the pool is being freed
+ *
+ *  \param pool
+ *      the pool
+ *
+ *  \param worker
+ *      the worker
+ */
+static int pool_worker_done(texcaller_pool *pool, struct pool_worker *worker)
+{
+    return    __atomic_load_n(&pool->draining, __ATOMIC_ACQUIRE)
+           || __atomic_load_n(&worker->state, __ATOMIC_ACQUIRE) != POOL_WORKER_ACTIVE;
+}
+
+/*! Take the next conversion a worker of a pool should run,
+ *  without any lock.
+ *
+ *  That is the oldest conversion of the queue of the worker,
+ *  or else the oldest one of the injection queue,
+ *  or else one stolen from the queue of a worker
+ *  that is busy or gone, which would otherwise wait
+ *  while this worker is idle.
+ *  Retiring workers only take conversions of their own queue,
+ *  and workers of a pool being freed steal from any worker.
+ *
+ *  \return
+ *      the conversion, or \c NULL if there is none
+ *
+ *  \param pool
+ *      the pool
+ *
+ *  \param worker
+ *      the idle worker
+ */
+static struct texcaller_pool_job *pool_take_job(texcaller_pool *pool, struct pool_worker *worker)
+{
+    const int self = (int)(worker - pool->workers);
+    const int draining = __atomic_load_n(&pool->draining, __ATOMIC_ACQUIRE);
+    unsigned long cas_failures = 0;
+    struct texcaller_pool_job *job;
+    int i;
+    job = pool_queue_pop(&worker->queue, &cas_failures);
+    if (   job == NULL
+        && (draining || __atomic_load_n(&worker->state, __ATOMIC_ACQUIRE) == POOL_WORKER_ACTIVE)) {
+        job = pool_queue_pop(&pool->injection, &cas_failures);
+        for (i = 0; job == NULL && i < pool->workers_capacity; i++) {
+            const int v = (worker->victim + i) % pool->workers_capacity;
+            struct pool_worker *victim = &pool->workers[v];
+            if (   v != self
+                && (   draining
+                    || __atomic_load_n(&victim->busy, __ATOMIC_RELAXED)
+                    || __atomic_load_n(&victim->state, __ATOMIC_RELAXED) != POOL_WORKER_ACTIVE)) {
+                job = pool_queue_pop(&victim->queue, &cas_failures);
+                if (job != NULL) {
+                    /* a busy worker likely has more, so start there next time */
+                    worker->victim = v;
+                    __atomic_fetch_add(&pool->counters.steals, 1, __ATOMIC_RELAXED);
+                }
+            }
+        }
+    }
+    if (cas_failures > 0) {
+        __atomic_fetch_add(&pool->counters.cas_failures, cas_failures, __ATOMIC_RELAXED);
+    }
+    if (job == NULL) {
+        return NULL;
+    }
+    __atomic_fetch_sub(&pool->counters.queued, 1, __ATOMIC_RELAXED);
+    if (job->worker == self) {
+        __atomic_fetch_add(&pool->counters.affinity_hits, 1, __ATOMIC_RELAXED);
+    } else if (job->worker != -1) {
+        __atomic_fetch_add(&pool->counters.affinity_misses, 1, __ATOMIC_RELAXED);
+    }
+    return job;
+}
+
+/*! Wait until a worker of a pool is woken up by pool_wake().
+ *
+ *  The worker announces that it sleeps
+ *  before looking for a conversion once more,
+ *  while submitters look for sleeping workers
+ *  after queueing their conversion,
+ *  so no conversion is missed.
+ *
+ *  \return
+ *      a conversion found before sleeping,
+ *      or \c NULL after being woken up
+ *
+ *  \param pool
+ *      the pool
+ *
+ *  \param worker
+ *      the idle worker
+ */
+static struct texcaller_pool_job *pool_sleep(texcaller_pool *pool, struct pool_worker *worker)
+{
+    struct texcaller_pool_job *job;
+    pthread_mutex_lock(&pool->mutex);
+    worker->sleeping = 1;
+    __atomic_fetch_add(&pool->sleepers, 1, __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    job = pool_take_job(pool, worker);
+    if (job == NULL && !pool_worker_done(pool, worker)) {
+        pool->stats.sleeps++;
+        pthread_cond_wait(&worker->wakeup, &pool->mutex);
+    }
+    worker->sleeping = 0;
+    __atomic_fetch_sub(&pool->sleepers, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&pool->mutex);
+    return job;
+}
+
+/*! Wake up a sleeping worker of a pool for a queued conversion.
+ *
+ *  This is the routed worker if it sleeps,
+ *  or else any sleeping worker, which may steal the conversion.
+ *  The mutex of the pool is only taken if some worker sleeps,
+ *  so busy pools don't contend for it.
+ *
+ *  \param pool
+ *      the pool
+ *
+ *  \param w
+ *      index of the routed worker, or -1
+ */
+static void pool_wake(texcaller_pool *pool, int w)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&pool->sleepers, __ATOMIC_SEQ_CST) == 0) {
+        return;
+    }
+    pthread_mutex_lock(&pool->mutex);
+    if (w == -1 || !pool->workers[w].sleeping) {
+        for (w = 0; w < pool->workers_capacity; w++) {
+            if (pool->workers[w].sleeping) {
+                break;
+            }
+        }
+    }
+    if (w < pool->workers_capacity) {
+        /* let the next submitter wake up another worker */
+        pool->workers[w].sleeping = 0;
+        pthread_cond_signal(&pool->workers[w].wakeup);
+        pool->stats.wakeups++;
+    }
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+/*! Queue a conversion to a worker of a pool.
+ *
+ *  \return
+ *      0 on success, -1 if the pool is being freed
+ *
+ *  \param pool
+ *      the pool
+ *
+ *  \param job
+ *      the conversion, whose parameters are set
+ */
+static int pool_submit_job(texcaller_pool *pool, struct texcaller_pool_job *job)
+{
+    unsigned long cas_failures = 0;
+    job->result = NULL;
+    job->result_size = 0;
+    job->info = NULL;
+    job->state = POOL_JOB_QUEUED;
+    job->cancelled = 0;
+    job->session = NULL;
+    job->queued_time = current_time();
+    job->fingerprint = pool_fingerprint(job->source, job->source_size, job->source_format, job->result_format, job->options);
+    job->worker = -1;
+    __atomic_fetch_add(&pool->submitting, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&pool->stopping, __ATOMIC_SEQ_CST)) {
+        __atomic_fetch_sub(&pool->submitting, 1, __ATOMIC_SEQ_CST);
+        return -1;
+    }
+    /* conversions with assets don't use the working directory */
+    if (job->options == NULL || job->options->assets_count == 0) {
+        job->worker = pool_route(pool, job->fingerprint);
+    }
+    if (job->worker != -1) {
+        __atomic_fetch_add(&pool->workers[job->worker].load, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&pool->load, 1, __ATOMIC_RELAXED);
+    }
+    __atomic_fetch_add(&pool->counters.queued, 1, __ATOMIC_RELAXED);
+    if (job->worker == -1 || pool_queue_push(&pool->workers[job->worker].queue, job, &cas_failures) != 0) {
+        while (pool_queue_push(&pool->injection, job, &cas_failures) != 0) {
+            sched_yield();
+        }
+        __atomic_fetch_add(&pool->counters.injected, 1, __ATOMIC_RELAXED);
+    }
+    pool_wake(pool, job->worker);
+    if (cas_failures > 0) {
+        __atomic_fetch_add(&pool->counters.cas_failures, cas_failures, __ATOMIC_RELAXED);
+    }
+    __atomic_fetch_sub(&pool->submitting, 1, __ATOMIC_SEQ_CST);
+    return 0;
+}
+
+/*! Run a conversion by a worker of a pool,
+ *  and switch to a spare working directory if due.
+ *
+ *  The working directory is reset before the conversion,
+ *  see reset_session().
+ *
+ *  \param pool
+ *      the pool
+ *
+ *  \param worker
+ *      the worker
+ *
+ *  \param job
+ *      the conversion, which is handed back to its submitter
+ */
+static void pool_run_job(texcaller_pool *pool, struct pool_worker *worker, struct texcaller_pool_job *job)
+{
+    const double job_start_time = current_time();
+    texcaller_options options;
+    texcaller_stats stats;
+    texcaller_session *session;
+    enum pool_job_state expected;
+    double total;
+    double now;
+    __atomic_store_n(&worker->busy, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&pool->counters.busy, 1, __ATOMIC_RELAXED);
+    /* run the job, in a temporary directory if it has assets */
+    if (job->options != NULL) {
+        options = *job->options;
+    } else {
+        texcaller_options_init(&options);
+    }
+    options.stats = &stats;
+    init_stats(&stats);
+    session = options.assets_count > 0 ? NULL : worker->session;
+    __sync_fetch_and_and(&worker->session->cancelled, 0);
+    /* jobs are unrelated documents, so neither aux files
+     * nor other files of the previous job must be seen */
+    if (session != NULL) {
+        reset_session(session->dir);
+    }
+    /* a cancellation either sees the running state or is seen here */
+    job->session = session;
+    __atomic_store_n(&job->state, POOL_JOB_RUNNING, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&job->cancelled, __ATOMIC_SEQ_CST)) {
+        job->info = sprintf_alloc("Conversion was cancelled.");
+    } else {
+        convert_source(&job->result, &job->result_size, &job->info, NULL,
+                       job->source, job->source_size, job->source_format, job->result_format,
+                       job->max_runs, &options, NULL, session, NULL);
+        worker->suspect = job->result == NULL;
+    }
+    /* don't reuse the session while a cancellation may still kill its process */
+    expected = POOL_JOB_RUNNING;
+    while (!__atomic_compare_exchange_n(&job->state, &expected, POOL_JOB_DONE, 0,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        expected = POOL_JOB_RUNNING;
+        sched_yield();
+    }
+    if (job->options != NULL && job->options->stats != NULL) {
+        *job->options->stats = stats;
+    }
+    /* only this worker writes its totals, so no atomic addition is needed */
+    total = worker->run_time + (current_time() - job_start_time);
+    __atomic_store(&worker->run_time, &total, __ATOMIC_RELAXED);
+    total = worker->cpu_time + stats.cpu_time;
+    __atomic_store(&worker->cpu_time, &total, __ATOMIC_RELAXED);
+    __atomic_store_n(&worker->finished, worker->finished + 1, __ATOMIC_RELAXED);
+    if (job->worker != -1) {
+        __atomic_fetch_sub(&pool->workers[job->worker].load, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_sub(&pool->load, 1, __ATOMIC_RELAXED);
+    }
+    __atomic_fetch_add(&pool->counters.jobs, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_sub(&pool->counters.busy, 1, __ATOMIC_RELAXED);
+    if (job->callback != NULL) {
+        job->callback(job->data, job->result, job->result_size, job->info);
+        texcaller_pool_release(job);
+    } else {
+        /* the job belongs to its submitter from now on */
+        sem_post(&job->done);
+    }
+    now = current_time();
+    __atomic_store(&worker->idle_since, &now, __ATOMIC_RELAXED);
+    __atomic_store_n(&worker->busy, 0, __ATOMIC_RELAXED);
+    /* switch to a spare working directory if due */
+    worker->jobs++;
+    if (   (pool->options.recycle_jobs > 0 && worker->jobs >= pool->options.recycle_jobs)
+        || (pool->options.recycle_rss > 0 && stats.max_rss > pool->options.recycle_rss)) {
+        worker->recycle = 1;
+    }
+    if (worker->recycle || worker->suspect) {
+        pthread_mutex_lock(&pool->mutex);
+        if (pool->spares_count > 0) {
+            if (worker->recycle) {
+                pool->retired[pool->retired_count++] = worker->session;
+            } else {
+                pool->suspects[pool->suspects_count++] = worker->session;
+            }
+            worker->session = pool->spares[--pool->spares_count];
+            worker->jobs = 0;
+            worker->recycle = 0;
+            worker->suspect = 0;
+            pool->stats.recycled++;
+            pool->spare_failed = 0;
+            pthread_cond_signal(&pool->maintenance_needed);
+        }
+        pthread_mutex_unlock(&pool->mutex);
+    }
+}
+
+/*! Run the jobs of a pool, as the thread of a worker.
+ *
+ *  \return
+ *      \c NULL
+ *
+ *  \param arg
+ *      the worker
+ */
+static void *pool_work(void *arg)
+{
+    struct pool_worker *worker = (struct pool_worker *)arg;
+    texcaller_pool *pool = worker->pool;
+#ifdef __linux__
+    if (pool->pinned) {
+        pin_thread(&worker->cpus, pool->nodes[worker->node].id);
+    }
+#endif
+    for (;;) {
+        struct texcaller_pool_job *job = pool_take_job(pool, worker);
+        if (job == NULL && !pool_worker_done(pool, worker)) {
+            job = pool_sleep(pool, worker);
+        }
+        if (job != NULL) {
+            pool_run_job(pool, worker, job);
+        } else if (pool_worker_done(pool, worker)) {
+            break;
+        }
+    }
+    /* hand over the working directory when scaled down */
+    pthread_mutex_lock(&pool->mutex);
+    if (worker->state == POOL_WORKER_RETIRING) {
+        pool->retired[pool->retired_count++] = worker->session;
+        worker->session = NULL;
+        __atomic_store_n(&worker->state, POOL_WORKER_FINISHED, __ATOMIC_RELEASE);
+        pthread_cond_signal(&pool->maintenance_needed);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    return NULL;
+}
+
+/*! Interval of scaling decisions of a pool, in seconds.
+ */
+#define POOL_SCALE_INTERVAL 0.25
+
+/*! Read a pressure stall information file, such as \c /proc/pressure/cpu.
+ *
+ *  \return
+ *      the share of the last 10 seconds in percent
+ *      during which some tasks were stalled,
+ *      or -1 if not available
+ *
+ *  \param path
+ *      path of the file
+ */
+static double read_pressure(const char *path)
+{
+    FILE *file = fopen(path, "r");
+    double pressure = -1;
+    if (file == NULL) {
+        return -1;
+    }
+    if (fscanf(file, "some avg10=%lf", &pressure) != 1) {
+        pressure = -1;
+    }
+    fclose(file);
+    return pressure;
+}
+
+/*! Determine the CPU and memory pressure of the host.
+ *
+ *  Without pressure stall information,
+ *  the CPU pressure is estimated from the load average
+ *  as the share of runnable tasks exceeding the number of CPUs,
+ *  and the memory pressure is assumed to be 0.
+ *
+ *  \param cpu
+ *      will be set to the CPU pressure in percent
+ *
+ *  \param memory
+ *      will be set to the memory pressure in percent
+ */
+static void host_pressure(double *cpu, double *memory)
+{
+    *cpu = read_pressure("/proc/pressure/cpu");
+    *memory = read_pressure("/proc/pressure/memory");
+    if (*cpu < 0) {
+        double load;
+        const int cpus = cpu_count();
+        *cpu = 0;
+        if (getloadavg(&load, 1) == 1 && load > cpus) {
+            *cpu = 100 * (load - cpus) / load;
+        }
+    }
+    if (*memory < 0) {
+        *memory = 0;
+    }
+}
+
+/*! Decide whether to scale a pool up or down.
+ *
+ *  A worker is added while the oldest queued conversion
+ *  has waited for texcaller_pool_options::scale_up_wait,
+ *  unless the host is under pressure.
+ *  An idle worker is removed once it has been idle
+ *  for texcaller_pool_options::scale_down_idle,
+ *  and the pool hasn't grown for as long,
+ *  so the pool doesn't oscillate.
+ *
+ *  \return
+ *      1 to add a worker, -1 to remove a worker, 0 otherwise
+ *
+ *  \param pool
+ *      the pool, whose mutex is held
+ *
+ *  \param idle_worker
+ *      will be set to the index of the worker to remove
+ *
+ *  \param now
+ *      the current time, see current_time()
+ */
+static int pool_scaling(texcaller_pool *pool, int *idle_worker, double now)
+{
+    const texcaller_pool_options *options = &pool->options;
+    double idle_since = 0;
+    int w;
+    *idle_worker = -1;
+    if (   pool->stats.wait_time >= options->scale_up_wait
+        && pool->workers_count < pool->workers_capacity
+        && pool->stats.cpu_pressure <= options->max_cpu_pressure
+        && pool->stats.memory_pressure <= options->max_memory_pressure) {
+        return 1;
+    }
+    for (w = 0; w < pool->workers_capacity; w++) {
+        struct pool_worker *worker = &pool->workers[w];
+        double worker_idle_since;
+        __atomic_load(&worker->idle_since, &worker_idle_since, __ATOMIC_RELAXED);
+        if (   worker->state == POOL_WORKER_ACTIVE
+            && !__atomic_load_n(&worker->busy, __ATOMIC_RELAXED)
+            && (*idle_worker == -1 || worker_idle_since < idle_since)) {
+            *idle_worker = w;
+            idle_since = worker_idle_since;
+        }
+    }
+    if (   *idle_worker != -1
+        && pool->workers_count > pool->min_workers
+        && now - idle_since >= options->scale_down_idle
+        && now - pool->scaled_up_time >= options->scale_down_idle) {
+        return -1;
+    }
+    return 0;
+}
+
+/*! Start a worker of a pool.
+ *
+ *  \return
+ *      0 on success, -1 on failure
+ *
+ *  \param pool
+ *      the pool, whose mutex is held
+ *
+ *  \param w
+ *      index of an unused worker
+ *
+ *  \param session
+ *      the session that provides the working directory of the worker,
+ *      which is taken over on success
+ */
+static int pool_start_worker(texcaller_pool *pool, int w, texcaller_session *session)
+{
+    struct pool_worker *worker = &pool->workers[w];
+    const double now = current_time();
+    worker->pool = pool;
+    worker->session = session;
+    worker->sleeping = 0;
+    __atomic_store_n(&worker->busy, 0, __ATOMIC_RELAXED);
+    __atomic_store(&worker->idle_since, &now, __ATOMIC_RELAXED);
+    worker->victim = (w + 1) % pool->workers_capacity;
+    worker->jobs = 0;
+    worker->recycle = 0;
+    worker->suspect = 0;
+    __atomic_store_n(&worker->state, POOL_WORKER_ACTIVE, __ATOMIC_RELEASE);
+    if (pthread_create(&worker->thread, NULL, pool_work, worker) != 0) {
+        worker->session = NULL;
+        __atomic_store_n(&worker->state, POOL_WORKER_UNUSED, __ATOMIC_RELEASE);
+        return -1;
+    }
+    __atomic_store_n(&pool->workers_count, pool->workers_count + 1, __ATOMIC_RELAXED);
+    return 0;
+}
+
+/*! Maintain the working directories and workers of a pool,
+ *  as its maintenance thread.
+ *
+ *  Sessions of recycled workers are freed,
+ *  sessions of workers whose conversion failed are checked,
+ *  new spare sessions are created,
+ *  and the pool is scaled up or down,
+ *  all without holding the mutex of the pool
+ *  while TeX runs or directories are removed.
+ *  New workers start with a spare session if available,
+ *  or else with a new one that has passed a canary conversion,
+ *  so they are warm before they take conversions.
+ *
+ *  \return
+ *      \c NULL
+ *
+ *  \param arg
+ *      the pool
+ */
+static void *pool_maintain(void *arg)
+{
+    texcaller_pool *pool = (texcaller_pool *)arg;
+    const int scaling = pool->workers_capacity > pool->min_workers;
+    double next_scaling = current_time();
+    pthread_mutex_lock(&pool->mutex);
+    for (;;) {
+        texcaller_session *session;
+        char *error;
+        double now;
+        int w;
+        /* join workers that were scaled down */
+        for (w = 0; w < pool->workers_capacity; w++) {
+            if (pool->workers[w].state == POOL_WORKER_FINISHED) {
+                pthread_join(pool->workers[w].thread, NULL);
+                __atomic_store_n(&pool->workers[w].state, POOL_WORKER_UNUSED, __ATOMIC_RELEASE);
+            }
+        }
+        now = current_time();
+        if (pool->retired_count > 0) {
+            session = pool->retired[--pool->retired_count];
+            pthread_mutex_unlock(&pool->mutex);
+            texcaller_session_free(session);
+            pthread_mutex_lock(&pool->mutex);
+        } else if (pool->suspects_count > 0) {
+            int healthy;
+            session = pool->suspects[--pool->suspects_count];
+            pthread_mutex_unlock(&pool->mutex);
+            healthy = pool_canary(&error, pool, session) == 0;
+            free(error);
+            pthread_mutex_lock(&pool->mutex);
+            if (!healthy) {
+                pool->stats.unhealthy++;
+            }
+            if (healthy && pool->spares_count < pool->capacity) {
+                pool->spares[pool->spares_count++] = session;
+            } else {
+                pthread_mutex_unlock(&pool->mutex);
+                texcaller_session_free(session);
+                pthread_mutex_lock(&pool->mutex);
+            }
+        } else if (   !pool->stopping
+                   && !pool->spare_failed
+                   && pool->spares_count < (size_t)pool->options.spares) {
+            pthread_mutex_unlock(&pool->mutex);
+            session = pool_create_session(&error, pool);
+            free(error);
+            pthread_mutex_lock(&pool->mutex);
+            if (session == NULL) {
+                pool->stats.unhealthy++;
+                pool->spare_failed = 1;
+            } else if (pool->spares_count < pool->capacity) {
+                pool->spares[pool->spares_count++] = session;
+            } else {
+                pthread_mutex_unlock(&pool->mutex);
+                texcaller_session_free(session);
+                pthread_mutex_lock(&pool->mutex);
+            }
+        } else if (!pool->stopping && scaling && now >= next_scaling) {
+            double cpu_pressure;
+            double memory_pressure;
+            int idle_worker;
+            int direction;
+            next_scaling = now + POOL_SCALE_INTERVAL;
+            pthread_mutex_unlock(&pool->mutex);
+            host_pressure(&cpu_pressure, &memory_pressure);
+            pthread_mutex_lock(&pool->mutex);
+            pool->stats.cpu_pressure = cpu_pressure;
+            pool->stats.memory_pressure = memory_pressure;
+            pool->stats.wait_time = pool_wait_time(pool, now);
+            direction = pool_scaling(pool, &idle_worker, now);
+            if (direction > 0) {
+                /* warm up the new worker before it takes conversions */
+                if (pool->spares_count > 0) {
+                    session = pool->spares[--pool->spares_count];
+                    pool->spare_failed = 0;
+                } else {
+                    pthread_mutex_unlock(&pool->mutex);
+                    session = pool_create_session(&error, pool);
+                    free(error);
+                    pthread_mutex_lock(&pool->mutex);
+                }
+                for (w = 0; w < pool->workers_capacity; w++) {
+                    if (pool->workers[w].state == POOL_WORKER_UNUSED) {
+                        break;
+                    }
+                }
+                if (session == NULL) {
+                    pool->stats.unhealthy++;
+                } else if (pool->stopping || w == pool->workers_capacity
+                           || pool_start_worker(pool, w, session) != 0) {
+                    pthread_mutex_unlock(&pool->mutex);
+                    texcaller_session_free(session);
+                    pthread_mutex_lock(&pool->mutex);
+                } else {
+                    pool->stats.scale_ups++;
+                    pool->scaled_up_time = current_time();
+                }
+            } else if (direction < 0) {
+                __atomic_store_n(&pool->workers[idle_worker].state, POOL_WORKER_RETIRING, __ATOMIC_SEQ_CST);
+                __atomic_store_n(&pool->workers_count, pool->workers_count - 1, __ATOMIC_RELAXED);
+                pool->stats.scale_downs++;
+                pthread_cond_signal(&pool->workers[idle_worker].wakeup);
+            }
+        } else if (pool->stopping) {
+            break;
+        } else if (scaling) {
+            struct timespec deadline;
+            struct timeval tv;
+            gettimeofday(&tv, NULL);
+            deadline.tv_sec = tv.tv_sec;
+            deadline.tv_nsec = tv.tv_usec * 1000 + (long)(POOL_SCALE_INTERVAL * 1e9);
+            if (deadline.tv_nsec >= 1000000000L) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000L;
+            }
+            pthread_cond_timedwait(&pool->maintenance_needed, &pool->mutex, &deadline);
+        } else {
+            pthread_cond_wait(&pool->maintenance_needed, &pool->mutex);
+        }
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    return NULL;
+}
+
+/*! Stop all threads of a pool and free it.
+ *
+ *  This also frees partially created pools,
+ *  see texcaller_pool_create().
+ *
+ *  \param pool
+ *      the pool
+ */
+static void pool_destroy(texcaller_pool *pool)
+{
+    size_t i;
+    int w;
+    /* let submitters finish queueing before workers drain the queues */
+    __atomic_store_n(&pool->stopping, 1, __ATOMIC_SEQ_CST);
+    while (__atomic_load_n(&pool->submitting, __ATOMIC_SEQ_CST) > 0) {
+        sched_yield();
+    }
+    pthread_mutex_lock(&pool->mutex);
+    __atomic_store_n(&pool->draining, 1, __ATOMIC_RELEASE);
+    for (w = 0; w < pool->workers_capacity; w++) {
+        pthread_cond_signal(&pool->workers[w].wakeup);
+    }
+    pthread_cond_signal(&pool->maintenance_needed);
+    pthread_mutex_unlock(&pool->mutex);
+    if (pool->maintainer_started) {
+        pthread_join(pool->maintainer, NULL);
+    }
+    for (w = 0; w < pool->workers_capacity; w++) {
+        if (pool->workers[w].state != POOL_WORKER_UNUSED) {
+            pthread_join(pool->workers[w].thread, NULL);
+        }
+    }
+    for (w = 0; w < pool->workers_capacity; w++) {
+        if (pool->workers[w].session != NULL) {
+            texcaller_session_free(pool->workers[w].session);
+        }
+    }
+    for (i = 0; i < pool->spares_count; i++) {
+        texcaller_session_free(pool->spares[i]);
+    }
+    for (i = 0; i < pool->retired_count; i++) {
+        texcaller_session_free(pool->retired[i]);
+    }
+    for (i = 0; i < pool->suspects_count; i++) {
+        texcaller_session_free(pool->suspects[i]);
+    }
+    for (w = 0; w < pool->workers_capacity; w++) {
+        pthread_cond_destroy(&pool->workers[w].wakeup);
+        free(pool->workers[w].queue.slots);
+    }
+    pthread_mutex_destroy(&pool->mutex);
+    pthread_cond_destroy(&pool->maintenance_needed);
+    free(pool->injection.slots);
+    free(pool->workers);
+    free(pool->spares);
+    free(pool->retired);
+    free(pool->suspects);
+    free(pool->ring);
+    free(pool->nodes);
+    free(pool);
+}
+
+/*! Initialize pool options with their default values.
+ */
+void texcaller_pool_options_init(texcaller_pool_options *options)
+{
+    options->workers = 0;
+    options->recycle_jobs = 1000;
+    options->recycle_rss = 0;
+    options->spares = 1;
+    options->max_workers = 0;
+    options->scale_up_wait = 0.5;
+    options->scale_down_idle = 30;
+    options->max_cpu_pressure = 50;
+    options->max_memory_pressure = 10;
+    options->placement = NULL;
+}
+
+/*! Create a pool of worker threads that run conversions.
+ */
+texcaller_pool *texcaller_pool_create(char **info, const texcaller_pool_options *options)
+{
+    texcaller_pool *pool;
+    texcaller_pool_options default_options;
+    int queues_failed = 0;
+    int error;
+    int w;
+    *info = NULL;
+    if (options == NULL) {
+        texcaller_pool_options_init(&default_options);
+        options = &default_options;
+    }
+    pool = (texcaller_pool *)calloc(1, sizeof(texcaller_pool));
+    if (pool == NULL) {
+        return NULL;
+    }
+    pool->options = *options;
+    if (pool->options.spares < 0) {
+        pool->options.spares = 0;
+    }
+    pool->min_workers = options->workers > 0 ? options->workers : cpu_count();
+    pool->workers_capacity = options->max_workers > pool->min_workers ? options->max_workers : pool->min_workers;
+    pool->capacity = pool->workers_capacity + pool->options.spares + 1;
+    pool->workers = (struct pool_worker *)calloc(pool->workers_capacity, sizeof(struct pool_worker));
+    pool->spares = (texcaller_session **)malloc(pool->capacity * sizeof(texcaller_session *));
+    pool->retired = (texcaller_session **)malloc(pool->capacity * sizeof(texcaller_session *));
+    pool->suspects = (texcaller_session **)malloc(pool->capacity * sizeof(texcaller_session *));
+    pool->ring = (struct pool_point *)malloc(pool->workers_capacity * POOL_RING_POINTS * sizeof(struct pool_point));
+    pool->nodes = (struct numa_node *)malloc(MAX_NUMA_NODES * sizeof(struct numa_node));
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->maintenance_needed, NULL);
+    if (pool->workers == NULL) {
+        pool->workers_capacity = 0;
+    }
+    for (w = 0; w < pool->workers_capacity; w++) {
+        pthread_cond_init(&pool->workers[w].wakeup, NULL);
+        if (pool_queue_init(&pool->workers[w].queue, POOL_QUEUE_SIZE) != 0) {
+            queues_failed = 1;
+        }
+    }
+    if (   pool->workers == NULL || pool->spares == NULL
+        || pool->retired == NULL || pool->suspects == NULL || pool->ring == NULL
+        || pool->nodes == NULL
+        || pool_queue_init(&pool->injection, POOL_INJECTION_SIZE) != 0 || queues_failed) {
+        pool_destroy(pool);
+        return NULL;
+    }
+    if (pool_place_workers(info, pool) != 0) {
+        pool_destroy(pool);
+        return NULL;
+    }
+    pool_build_ring(pool);
+    /* create the working directories of the initial workers and spares */
+    while (pool->spares_count < (size_t)(pool->min_workers + pool->options.spares)) {
+        texcaller_session *session = pool_create_session(info, pool);
+        if (session == NULL) {
+            pool_destroy(pool);
+            return NULL;
+        }
+        pool->spares[pool->spares_count++] = session;
+    }
+    /* start all threads */
+    pthread_mutex_lock(&pool->mutex);
+    for (w = 0; w < pool->min_workers; w++) {
+        if (pool_start_worker(pool, w, pool->spares[pool->spares_count - 1]) != 0) {
+            pthread_mutex_unlock(&pool->mutex);
+            *info = sprintf_alloc("Unable to create thread.");
+            pool_destroy(pool);
+            return NULL;
+        }
+        pool->spares_count--;
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    error = pthread_create(&pool->maintainer, NULL, pool_maintain, pool);
+    if (error != 0) {
+        *info = sprintf_alloc("Unable to create thread: %s.", strerror(error));
+        pool_destroy(pool);
+        return NULL;
+    }
+    pool->maintainer_started = 1;
+    return pool;
+}
+
+/*! Convert a TeX or LaTeX source by a worker of a pool.
+ */
+void texcaller_pool_convert(char **result, size_t *result_size, char **info, texcaller_pool *pool, const char *source, size_t source_size, const char *source_format, const char *result_format, int max_runs, const texcaller_options *options)
+{
+    struct texcaller_pool_job job;
+    job.source = source;
+    job.source_size = source_size;
+    job.source_format = source_format;
+    job.result_format = result_format;
+    job.max_runs = max_runs;
+    job.options = options;
+    job.callback = NULL;
+    job.data = NULL;
+    job.references = 1;
+    *result = NULL;
+    *result_size = 0;
+    if (sem_init(&job.done, 0, 0) != 0) {
+        *info = sprintf_alloc("Unable to create semaphore: %s.", strerror(errno));
+        return;
+    }
+    if (pool_submit_job(pool, &job) != 0) {
+        sem_destroy(&job.done);
+        *info = sprintf_alloc("Pool is being freed.");
+        return;
+    }
+    while (sem_wait(&job.done) != 0) {
+        /* interrupted by a signal */
+    }
+    sem_destroy(&job.done);
+    *result = job.result;
+    *result_size = job.result_size;
+    *info = job.info;
+}
+
+/*! Submit a conversion to a worker of a pool without waiting for it.
+ */
+texcaller_pool_job *texcaller_pool_submit(char **info, texcaller_pool *pool, const char *source, size_t source_size, const char *source_format, const char *result_format, int max_runs, const texcaller_options *options, texcaller_pool_callback callback, void *data)
+{
+    struct texcaller_pool_job *job;
+    *info = NULL;
+    job = (struct texcaller_pool_job *)malloc(sizeof(struct texcaller_pool_job));
+    if (job == NULL) {
+        return NULL;
+    }
+    job->source = source;
+    job->source_size = source_size;
+    job->source_format = source_format;
+    job->result_format = result_format;
+    job->max_runs = max_runs;
+    job->options = options;
+    job->callback = callback;
+    job->data = data;
+    job->references = 2;
+    if (pool_submit_job(pool, job) != 0) {
+        free(job);
+        *info = sprintf_alloc("Pool is being freed.");
+        return NULL;
+    }
+    return job;
+}
+
+/*! Cancel a submitted conversion.
+ */
+void texcaller_pool_cancel(texcaller_pool_job *job)
+{
+    enum pool_job_state expected = POOL_JOB_RUNNING;
+    __atomic_store_n(&job->cancelled, 1, __ATOMIC_SEQ_CST);
+    /* keep the worker from reusing the session until its process is killed */
+    if (__atomic_compare_exchange_n(&job->state, &expected, POOL_JOB_CANCELLING, 0,
+                                    __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+        if (job->session != NULL) {
+            texcaller_session_cancel(job->session);
+        }
+        __atomic_store_n(&job->state, POOL_JOB_RUNNING, __ATOMIC_RELEASE);
+    }
+}
+
+/*! Release a submitted conversion.
+ */
+void texcaller_pool_release(texcaller_pool_job *job)
+{
+    if (__atomic_sub_fetch(&job->references, 1, __ATOMIC_ACQ_REL) == 0) {
+        free(job);
+    }
+}
+
+/*! Get the statistics of a worker pool.
+ */
+void texcaller_pool_get_stats(texcaller_pool *pool, texcaller_pool_stats *stats)
+{
+    pthread_mutex_lock(&pool->mutex);
+    *stats = pool->stats;
+    stats->workers = pool->workers_count;
+    pthread_mutex_unlock(&pool->mutex);
+    stats->nodes = pool->nodes_count;
+    stats->wait_time = pool_wait_time(pool, current_time());
+    stats->queued = __atomic_load_n(&pool->counters.queued, __ATOMIC_RELAXED);
+    stats->jobs = __atomic_load_n(&pool->counters.jobs, __ATOMIC_RELAXED);
+    stats->busy = __atomic_load_n(&pool->counters.busy, __ATOMIC_RELAXED);
+    stats->affinity_hits = __atomic_load_n(&pool->counters.affinity_hits, __ATOMIC_RELAXED);
+    stats->affinity_misses = __atomic_load_n(&pool->counters.affinity_misses, __ATOMIC_RELAXED);
+    stats->steals = __atomic_load_n(&pool->counters.steals, __ATOMIC_RELAXED);
+    stats->injected = __atomic_load_n(&pool->counters.injected, __ATOMIC_RELAXED);
+    stats->cas_failures = __atomic_load_n(&pool->counters.cas_failures, __ATOMIC_RELAXED);
+}
+
+/*! Get the statistics of the workers of a pool placed on a NUMA node.
+ */
+int texcaller_pool_get_node_stats(texcaller_pool *pool, int index, texcaller_pool_node_stats *stats)
+{
+    int w;
+    if (index < 0 || index >= pool->nodes_count) {
+        return -1;
+    }
+    stats->node = pool->nodes[index].id;
+    stats->workers = 0;
+    stats->jobs = 0;
+    stats->run_time = 0;
+    stats->cpu_time = 0;
+    for (w = 0; w < pool->workers_capacity; w++) {
+        struct pool_worker *worker = &pool->workers[w];
+        double time;
+        if (worker->node != index) {
+            continue;
+        }
+        if (__atomic_load_n(&worker->state, __ATOMIC_RELAXED) == POOL_WORKER_ACTIVE) {
+            stats->workers++;
+        }
+        stats->jobs += __atomic_load_n(&worker->finished, __ATOMIC_RELAXED);
+        __atomic_load(&worker->run_time, &time, __ATOMIC_RELAXED);
+        stats->run_time += time;
+        __atomic_load(&worker->cpu_time, &time, __ATOMIC_RELAXED);
+        stats->cpu_time += time;
+    }
+    return 0;
+}
+
+/*! Free a worker pool.
+ */
+void texcaller_pool_free(texcaller_pool *pool)
+{
+    pool_destroy(pool);
+}
+
+/*! Start concatenating PDF files.
+ */
+texcaller_concat *texcaller_concat_begin(char **info, int fd)
+{
+    texcaller_concat *concat;
+    *info = NULL;
+    concat = (texcaller_concat *)malloc(sizeof(texcaller_concat));
+    if (concat == NULL) {
+        return NULL;
+    }
+    pdf_writer_init(&concat->writer, fd, 1);
+    concat->documents = 0;
+    concat->failed = 0;
+    return concat;
+}
+
+/*! Append all pages of a PDF file to a concatenated PDF file.
+ */
+int texcaller_concat_add(char **info, texcaller_concat *concat, const char *pdf, size_t pdf_size)
+{
+    struct pdf_document doc;
+    struct pdf_pages pages;
+    int status = -1;
+    *info = NULL;
+    if (concat->failed) {
+        *info = sprintf_alloc("Unable to add PDF after a previous failure.");
+        return -1;
+    }
+    concat->failed = 1;
+    if (pdf_parse(info, &doc, pdf, pdf_size) != 0) {
+        return -1;
+    }
+    if (pdf_pages_init(&pages, &doc) != 0) {
+        *info = sprintf_alloc("Unable to read the page tree of PDF %lu.",
+                              (unsigned long)concat->documents + 1);
+        goto cleanup;
+    }
+    if (   (concat->documents == 0 && pdf_writer_begin(&concat->writer, &doc) != 0)
+        || pdf_copy_pages(&concat->writer, &doc, &pages, 0, pages.count) != 0) {
+        if (concat->writer.write_errno != 0) {
+            *info = sprintf_alloc("Unable to write PDF: %s.",
+                                  strerror(concat->writer.write_errno));
+        } else {
+            *info = sprintf_alloc("Unable to copy the pages of PDF %lu.",
+                                  (unsigned long)concat->documents + 1);
+        }
+        goto cleanup;
+    }
+    concat->documents++;
+    concat->failed = 0;
+    status = 0;
+cleanup:
+    pdf_pages_free(&pages);
+    free(doc.offsets);
+    return status;
+}
+
+/*! Finish concatenating PDF files.
+ */
+int texcaller_concat_finish(char **info, texcaller_concat *concat)
+{
+    int status = -1;
+    *info = NULL;
+    if (concat->failed) {
+        *info = sprintf_alloc("Unable to finish PDF after a previous failure.");
+        goto cleanup;
+    }
+    if (   (concat->documents == 0 && pdf_writer_begin(&concat->writer, NULL) != 0)
+        || pdf_writer_finish(&concat->writer) != 0) {
+        if (concat->writer.write_errno != 0) {
+            *info = sprintf_alloc("Unable to write PDF: %s.",
+                                  strerror(concat->writer.write_errno));
+        }
+        goto cleanup;
+    }
+    status = 0;
+cleanup:
+    pdf_writer_free(&concat->writer);
+    free(concat);
+    return status;
+}
+
+/*! Build a slim format with only the given hyphenation languages.
+ */
+int texcaller_build_format(char **info, const char *source_format, const char *result_format, const char *languages)
+{
+    const char *cmd;
+    const char *cache_dir;
+    char *fmt_filename;
+    int status;
+    *info = NULL;
+    cmd = convert_command(source_format, result_format);
+    if (cmd == NULL) {
+        *info = sprintf_alloc("Unable to convert from \"%s\" to \"%s\".",
+                              source_format, result_format);
+        return -1;
+    }
+    cache_dir = cache_directory();
+    if (cache_dir == NULL) {
+        *info = sprintf_alloc("Building formats requires TEXCALLER_CACHE_DIR to be set.");
+        return -1;
+    }
+    fmt_filename = format_cache_filename(cache_dir, cmd, languages);
+    if (fmt_filename == NULL) {
+        return -1;
+    }
+    status = build_format(info, cmd, languages, fmt_filename);
+    free(fmt_filename);
+    return status;
+}
+
+/*! Warm up the page cache with all files needed by the cached templates.
+ */
+int texcaller_warmup(char **info, int processes, int convert)
+{
+    const char *cache_dir;
+    struct string_list files = { NULL, 0, 0 };
+    size_t templates;
+    int status = -1;
+    *info = NULL;
+    cache_dir = cache_directory();
+    if (cache_dir == NULL) {
+        *info = sprintf_alloc("Warming up requires TEXCALLER_CACHE_DIR to be set.");
+        return -1;
+    }
+    if (processes <= 0) {
+        processes = cpu_count();
+    }
+    /* read all recorded files */
+    if (collect_warmup_files(info, &files, &templates, cache_dir) != 0) {
+        goto cleanup;
+    }
+    if (prefault_files(info, &files, processes) != 0) {
+        goto cleanup;
+    }
+    /* run throwaway conversions */
+    if (convert) {
+        const char *tex_source = "\\shipout\\hbox{Hello world!}\\end";
+        const char *latex_source =
+            "\\documentclass{article}"
+            "\\begin{document}"
+            "Hello world!"
+            "\\end{document}";
+        const char *formats[4][2] = {
+            { "TeX",   "DVI" },
+            { "TeX",   "PDF" },
+            { "LaTeX", "DVI" },
+            { "LaTeX", "PDF" }
+        };
+        size_t i;
+        for (i = 0; i < sizeof(formats) / sizeof(formats[0]); i++) {
+            const char *source = strcmp(formats[i][0], "TeX") == 0 ? tex_source : latex_source;
+            char *result;
+            size_t result_size;
+            texcaller_convert(&result, &result_size, info,
+                              source, strlen(source), formats[i][0], formats[i][1], 2);
+            if (result == NULL) {
+                goto cleanup;
+            }
+            free(result);
+            free(*info);
+            *info = NULL;
+        }
+    }
+    *info = sprintf_alloc("Warmed up %lu files of %lu templates using %i processes%s.",
+                          (unsigned long)files.count, (unsigned long)templates, processes,
+                          convert ? " and 4 throwaway conversions" : "");
+    status = 0;
+    goto cleanup;
+    /* cleanup all used resources */
+cleanup:
+    string_list_free(&files);
+    return status;
+}
+
+/*! Escape a string for direct use in LaTeX.
+ */
+char *texcaller_escape_latex(const char *s)
+{
+    const size_t size = strlen(s);
+    char *escaped_string;
+    size_t pos;
+    /* allocate memory for result */
+    escaped_string = (char *)malloc(escaped_latex_size(s, size) + 1);
+    if (escaped_string == NULL) {
+        return NULL;
     }
+    /* calculate result */
+    pos = escape_latex_into(escaped_string, s, size);
     escaped_string[pos] = '\0';
     return escaped_string;
 }
 
+/*! Escape many strings at once for direct use in LaTeX.
+ */
+int texcaller_escape_latex_batch(char **result, size_t **result_offsets, const char *strings, const size_t *offsets, size_t count)
+{
+    size_t length;
+    size_t i;
+    *result = NULL;
+    *result_offsets = NULL;
+    /* calculate result length */
+    length = escaped_latex_size(strings + offsets[0], offsets[count] - offsets[0]);
+    /* allocate memory for result */
+    *result = (char *)malloc(length + 1);
+    *result_offsets = (size_t *)malloc((count + 1) * sizeof(size_t));
+    if (*result == NULL || *result_offsets == NULL) {
+        free(*result);
+        free(*result_offsets);
+        *result = NULL;
+        *result_offsets = NULL;
+        return -1;
+    }
+    /* calculate result */
+    (*result_offsets)[0] = 0;
+    for (i = 0; i < count; i++) {
+        (*result_offsets)[i + 1] = (*result_offsets)[i]
+            + escape_latex_into(*result + (*result_offsets)[i],
+                                strings + offsets[i], offsets[i + 1] - offsets[i]);
+    }
+    (*result)[length] = '\0';
+    return 0;
+}
+
+/*! Size of a number in a table assumed in advance, see texcaller_render_table().
+ */
+#define TABLE_NUMBER_SIZE 12
+
+/*! Maximum size of a number in a table, see texcaller_render_table(),
+ *  reached by <tt>printf("%.17f", -DBL_MAX)</tt>.
+ */
+#define TABLE_NUMBER_MAX_SIZE 400
+
+/*! Render columns of values as the body of a LaTeX table.
+ */
+void texcaller_render_table(char **result, size_t *result_size, char **info, const texcaller_column *columns, size_t columns_count, size_t rows)
+{
+    struct buffer table = { NULL, 0, 0 };
+    size_t estimate;
+    size_t row;
+    size_t c;
+    *result = NULL;
+    *result_size = 0;
+    *info = NULL;
+    /* check the columns and calculate the size of the table,
+       assuming that numbers are short */
+    estimate = rows * (columns_count * 3 + 4);
+    for (c = 0; c < columns_count; c++) {
+        const texcaller_column *column = &columns[c];
+        if (column->type == NULL) {
+            *info = sprintf_alloc("Column %lu has no type.", (unsigned long)c);
+            goto cleanup;
+        } else if (strcmp(column->type, "text") == 0) {
+            if (column->strings == NULL || column->offsets == NULL) {
+                *info = sprintf_alloc("Text column %lu has no strings.", (unsigned long)c);
+                goto cleanup;
+            }
+            estimate += escaped_latex_size(column->strings + column->offsets[0],
+                                           column->offsets[rows] - column->offsets[0]);
+        } else if (strcmp(column->type, "integer") == 0) {
+            if (column->integers == NULL) {
+                *info = sprintf_alloc("Integer column %lu has no values.", (unsigned long)c);
+                goto cleanup;
+            }
+            estimate += rows * TABLE_NUMBER_SIZE;
+        } else if (strcmp(column->type, "number") == 0) {
+            if (column->numbers == NULL) {
+                *info = sprintf_alloc("Number column %lu has no values.", (unsigned long)c);
+                goto cleanup;
+            }
+            if (column->precision < -1 || column->precision > 17) {
+                *info = sprintf_alloc("Precision %i of column %lu is not between -1 and 17.",
+                                      column->precision, (unsigned long)c);
+                goto cleanup;
+            }
+            estimate += rows * TABLE_NUMBER_SIZE;
+        } else {
+            *info = sprintf_alloc("Unknown type \"%s\" of column %lu.", column->type, (unsigned long)c);
+            goto cleanup;
+        }
+    }
+    table.data = (char *)malloc(estimate + 1);
+    if (table.data == NULL) {
+        goto cleanup;
+    }
+    table.capacity = estimate + 1;
+    table.data[0] = '\0';
+    /* render the rows */
+    for (row = 0; row < rows; row++) {
+        for (c = 0; c < columns_count; c++) {
+            const texcaller_column *column = &columns[c];
+            char number[TABLE_NUMBER_MAX_SIZE];
+            int number_size = 0;
+            if (c > 0 && buffer_append(&table, " & ", 3) != 0) {
+                goto cleanup;
+            }
+            if (column->nulls != NULL && column->nulls[row]) {
+                /* empty cell */
+            } else if (column->type[0] == 't') {
+                /* the types were checked above */
+                const char *s = column->strings + column->offsets[row];
+                const size_t size = column->offsets[row + 1] - column->offsets[row];
+                if (buffer_reserve(&table, escaped_latex_size(s, size)) != 0) {
+                    goto cleanup;
+                }
+                table.size += escape_latex_into(table.data + table.size, s, size);
+                table.data[table.size] = '\0';
+            } else if (column->type[0] == 'i') {
+                number_size = sprintf(number, "%ld", column->integers[row]);
+            } else if (column->precision == -1) {
+                number_size = sprintf(number, "%g", column->numbers[row]);
+            } else {
+                number_size = sprintf(number, "%.*f", column->precision, column->numbers[row]);
+            }
+            if (number_size > 0 && buffer_append(&table, number, number_size) != 0) {
+                goto cleanup;
+            }
+        }
+        if (buffer_append(&table, " \\\\\n", 4) != 0) {
+            goto cleanup;
+        }
+    }
+    *info = sprintf_alloc("Rendered %lu rows of %lu columns.", (unsigned long)rows, (unsigned long)columns_count);
+    if (*info == NULL) {
+        goto cleanup;
+    }
+    *result = table.data;
+    *result_size = table.size;
+    table.data = NULL;
+cleanup:
+    free(table.data);
+}
+
 /*!  @} */
 
 #ifdef __cplusplus
@@ -42,6 +42,10 @@
  *  \dontinclude example.php
  *  \skipline texcaller_convert
  *
+ *  - \ref nodejs
+ *  \dontinclude example.js
+ *  \skipline texcaller.convert
+ *
  *  \page download Download
  *
  *  \section development Development version
@@ -225,6 +229,17 @@ cc -o example example.c -ltexcaller
  *  Instead, all important information is simply collected
  *  in the \c info string.
  *
+ *  If the environment variable \c TEXCALLER_CACHE_DIR
+ *  is set to an existing, writable directory,
+ *  Texcaller remembers there which fonts the documents use,
+ *  per document preamble.
+ *  PDF conversions of later documents with the same preamble
+ *  then load a trimmed font map with only those fonts,
+ *  rather than parsing the full \c pdftex.map on every TeX run.
+ *  If a document uses a font that is missing in the trimmed font map,
+ *  the TeX run is repeated with the full font map,
+ *  and the trimmed font map is extended accordingly.
+ *
  *  \param result
  *      will be set to a newly allocated buffer that contains
  *      the generated document,
@@ -265,6 +280,1058 @@ cc -o example example.c -ltexcaller
  */
 void texcaller_convert(char **result, size_t *result_size, char **info, const char *source, size_t source_size, const char *source_format, const char *result_format, int max_runs);
 
+/*! Statistics about a conversion.
+ *
+ *  \see texcaller_options
+ */
+typedef struct texcaller_stats {
+    /*! number of TeX runs */
+    int runs;
+    /*! total wall-clock time of all TeX runs, in seconds */
+    double run_time;
+    /*! total CPU time of all TeX runs, in seconds */
+    double cpu_time;
+    /*! peak resident memory of a single TeX run, in kilobytes */
+    long max_rss;
+    /*! non-zero if texcaller_options::preview_pages
+     *  omitted some pages of the document */
+    int truncated;
+    /*! niceness added to the processes of the conversion,
+     *  see texcaller_priority::nice */
+    int nice;
+    /*! I/O scheduling class of the processes of the conversion,
+     *  see texcaller_priority::io_class,
+     *  or \c NULL if inherited */
+    const char *io_class;
+    /*! I/O priority level of the processes of the conversion,
+     *  see texcaller_priority::io_level,
+     *  or -1 if not applicable */
+    int io_level;
+    /*! CPU scheduling policy of the processes of the conversion,
+     *  see texcaller_priority::cpu_policy,
+     *  or \c NULL if inherited */
+    const char *cpu_policy;
+} texcaller_stats;
+
+/*! CPU and I/O priority of the processes of a conversion.
+ *
+ *  Only settings that lower the priority are supported,
+ *  as they don't need any privileges.
+ *
+ *  \see texcaller_options::priority
+ */
+typedef struct texcaller_priority {
+    /*! Niceness to add, from 0 to 19.
+     *  Higher values leave more CPU time to other processes. */
+    int nice;
+    /*! I/O scheduling class, or \c NULL to inherit it:
+     *
+     *  - \c "best-effort" with the priority level \c io_level
+     *  - \c "idle" to only access the disk when nobody else does
+     *
+     *  I/O scheduling classes are only supported on Linux,
+     *  so this has to be \c NULL on other systems.
+     */
+    const char *io_class;
+    /*! I/O priority level within the \c "best-effort" class,
+     *  from 0 (highest) to 7 (lowest). */
+    int io_level;
+    /*! CPU scheduling policy, or \c NULL to inherit it:
+     *
+     *  - \c "batch" for CPU-intensive processes,
+     *    which are preempted less often but woken up later
+     *  - \c "idle" to only run when no other process wants to
+     */
+    const char *cpu_policy;
+} texcaller_priority;
+
+/*! An additional file needed by a document, such as an image.
+ *
+ *  \see texcaller_options::assets
+ */
+typedef struct texcaller_asset {
+    /*! file name, such as \c "logo.eps",
+     *  which must not contain any directory part */
+    const char *name;
+    /*! content of the file */
+    const char *data;
+    /*! size of \c data */
+    size_t size;
+} texcaller_asset;
+
+/*! An additional output derived from the DVI result of a conversion.
+ *
+ *  \see texcaller_options::outputs
+ */
+typedef struct texcaller_output {
+    /*! Requested output format, which is one of:
+     *
+     *  - \c "PDF": the whole document, via \c dvipdfmx
+     *  - \c "SVG": the first page, via \c dvisvgm,
+     *    with all glyphs converted to paths
+     *  - \c "PNG": the first page, via \c dvipng,
+     *    such as for thumbnails
+     */
+    const char *format;
+    /*! resolution of \c "PNG" outputs, in dots per inch,
+     *  or 0 for 96 dpi */
+    int resolution;
+    /*! Will be set to a newly allocated buffer
+     *  that contains the output,
+     *  or to \c NULL if the conversion failed.
+     *  The caller is responsible to free() it.
+     */
+    char *result;
+    /*! will be set to the size of \c result */
+    size_t result_size;
+    /*! will be set to the CPU time spent producing this output,
+     *  in seconds */
+    double time;
+} texcaller_output;
+
+/*! Additional options for texcaller_convert_with_options().
+ *
+ *  Always initialize this structure via texcaller_options_init()
+ *  before setting any of its members,
+ *  so your code keeps working when new options are added.
+ */
+typedef struct texcaller_options {
+    /*! Comma separated list of hyphenation languages,
+     *  such as \c "ngerman,french",
+     *  or \c NULL to use the stock format.
+     *
+     *  If set, the document is typeset with a slim format
+     *  that contains only the hyphenation patterns of these languages
+     *  (plus English, which is always included as TeX's default language).
+     *  Such a format loads faster and needs less memory
+     *  than the stock format with patterns of dozens of languages.
+     *  The format is built on first use via texcaller_build_format()
+     *  and kept in the \c TEXCALLER_CACHE_DIR,
+     *  which therefore must be set.
+     *  Clear the cache after upgrading TeX,
+     *  because formats are specific to the TeX binaries.
+     *
+     *  Not supported for plain TeX to DVI conversions,
+     *  since Knuth's \c tex has no language configuration.
+     */
+    const char *languages;
+    /*! Additional files to place next to the document,
+     *  or \c NULL.
+     *
+     *  For PDF output,
+     *  EPS and SVG graphics are converted to PDF
+     *  via \c epstopdf and \c inkscape, respectively,
+     *  because TeX itself is not allowed to call these tools.
+     *  The converted graphic of \c "logo.eps" or \c "logo.svg"
+     *  is provided as \c "logo.pdf",
+     *  so <tt>\\includegraphics{logo}</tt> picks it up.
+     *  EPS graphics are also provided as \c "logo-eps-converted-to.pdf",
+     *  which is where the \c epstopdf package looks for them.
+     *  If \c TEXCALLER_CACHE_DIR is set,
+     *  converted graphics are cached by content,
+     *  so every graphic is converted only once
+     *  no matter how many documents use it.
+     */
+    const texcaller_asset *assets;
+    /*! number of elements in \c assets */
+    size_t assets_count;
+    /*! Target resolution of bitmap images, in dots per inch,
+     *  or 0 to leave images as they are.
+     *
+     *  If set, all PNG and JPEG assets (\c .png, \c .jpg, \c .jpeg)
+     *  of PDF conversions are preprocessed before the first TeX run:
+     *  Their metadata is stripped,
+     *  and they are downsampled so that
+     *  they don't exceed the target resolution
+     *  even when printed across a full A4 page (11.7 inches).
+     *  Their stored resolution is adjusted accordingly,
+     *  so their natural size in the document doesn't change.
+     *  This keeps 20 MB camera images from bloating the PDF
+     *  and from slowing down pdfTeX.
+     *  The images are processed in parallel via ImageMagick.
+     *  If \c TEXCALLER_CACHE_DIR is set,
+     *  results are cached by image content and resolution.
+     */
+    int image_dpi;
+    /*! If non-zero, externalize all TikZ pictures.
+     *
+     *  Each <tt>tikzpicture</tt> is typeset once as separate PDF,
+     *  in parallel processes,
+     *  and then simply included in all TeX runs of the document.
+     *  If \c TEXCALLER_CACHE_DIR is set,
+     *  figures are cached by the checksum TikZ computes
+     *  of the code of the picture, and by the preamble,
+     *  so unchanged pictures are reused by all later documents.
+     *  The TeX run that discovers missing figures
+     *  doesn't count against \c max_runs.
+     *
+     *  This requires conversion from \c "LaTeX" to \c "PDF",
+     *  a LaTeX release of 2020 or later,
+     *  and a document that loads the \c tikz package.
+     */
+    int externalize;
+    /*! Number of pages to typeset,
+     *  or 0 to typeset the whole document.
+     *
+     *  If set, TeX stops after shipping out that many pages,
+     *  and the partial result is returned.
+     *  The TeX run is also not repeated to stabilize the output
+     *  unless \c preview_verify is set,
+     *  so references may be shown as "??".
+     *  This makes the time of a preview depend on its size
+     *  rather than on the size of the document.
+     *  Whether any pages were omitted is reported via
+     *  texcaller_stats::truncated.
+     *
+     *  This requires the source format \c "LaTeX"
+     *  and a LaTeX release of 2020 or later.
+     */
+    int preview_pages;
+    /*! If non-zero, repeat preview runs until the output stabilizes,
+     *  as for normal conversions.
+     */
+    int preview_verify;
+    /*! If non-zero, write PDF results without object streams,
+     *  using a classic cross-reference table instead.
+     *
+     *  This is required for concatenating the results
+     *  via texcaller_concat_add().
+     *  Results grow slightly,
+     *  because only content streams are compressed.
+     */
+    int classic_xref;
+    /*! Additional outputs to derive from the DVI result,
+     *  or \c NULL.
+     *
+     *  This allows for, say, a PDF for download and a PNG thumbnail
+     *  from a single conversion.
+     *  The TeX runs happen only once,
+     *  and when they have stabilized,
+     *  all outputs are produced concurrently from the DVI file.
+     *  If any output fails, the whole conversion fails.
+     *
+     *  This requires the result format \c "DVI".
+     */
+    texcaller_output *outputs;
+    /*! number of elements in \c outputs */
+    size_t outputs_count;
+    /*! If not \c NULL, profile the document,
+     *  to find the constructs that make it slow.
+     *
+     *  After a successful conversion,
+     *  the document is typeset once more by LuaTeX,
+     *  which measures the CPU time spent on every source line,
+     *  within the LaTeX environments the line is in.
+     *  \c profile will be set to a newly allocated string
+     *  in the folded stack format of flame graph tools,
+     *  with one line per stack and times in microseconds, such as:
+     *
+     *      document;itemize;texput.tex:12 1834
+     *
+     *  If profiling fails, \c profile will be set to \c NULL,
+     *  and the reason is appended to the info message
+     *  of the otherwise successful conversion.
+     *  The profiling run isn't counted in the statistics.
+     *
+     *  This requires \c lualatex or \c luatex,
+     *  and a document that can be typeset by LuaTeX.
+     */
+    char **profile;
+    /*! Priority of the TeX runs and other processes of the conversion,
+     *  or \c NULL to inherit the priority of the calling process.
+     *
+     *  Lowering the priority of batch conversions lets them use
+     *  idle capacity without slowing down interactive conversions.
+     *  The priority is set in each process before running the command,
+     *  and doesn't apply to building formats via texcaller_build_format().
+     *  Settings the host doesn't permit are skipped.
+     */
+    const texcaller_priority *priority;
+    /*! If not \c NULL, will be filled with statistics about the conversion. */
+    texcaller_stats *stats;
+} texcaller_options;
+
+/*! Initialize conversion options with their default values.
+ *
+ *  \param options
+ *      the options to initialize
+ */
+void texcaller_options_init(texcaller_options *options);
+
+/*! Convert a TeX or LaTeX source to DVI or PDF, with additional options.
+ *
+ *  This works exactly like texcaller_convert(),
+ *  but allows for additional options.
+ *
+ *  \param options
+ *      additional options, or \c NULL for the defaults.
+ *      See texcaller_options for details.
+ */
+void texcaller_convert_with_options(char **result, size_t *result_size, char **info, const char *source, size_t source_size, const char *source_format, const char *result_format, int max_runs, const texcaller_options *options);
+
+/*! Convert a TeX or LaTeX source to DVI or PDF, moving the result to a file.
+ *
+ *  This works like texcaller_convert_with_options(),
+ *  but the generated document is never read into memory.
+ *  It is renamed from the temporary directory to \c path,
+ *  which atomically replaces an existing file.
+ *  Across file systems, it is copied within the kernel
+ *  into a temporary file next to \c path, which is renamed instead.
+ *  The file is replaced only if the conversion succeeded,
+ *  and is never left partially written.
+ *
+ *  \return
+ *      0 on success, -1 on failure
+ *
+ *  \param path
+ *      path of the file to create or replace
+ *
+ *  See texcaller_convert_with_options() for the other parameters.
+ */
+int texcaller_convert_to_path(char **info, const char *path, const char *source, size_t source_size, const char *source_format, const char *result_format, int max_runs, const texcaller_options *options);
+
+/*! Convert a TeX or LaTeX source to DVI or PDF, copying the result to a file descriptor.
+ *
+ *  This works like texcaller_convert_with_options(),
+ *  but the generated document is never read into memory.
+ *  It is copied to \c fd, such as to a file, pipe or socket,
+ *  at the current offset of \c fd,
+ *  on Linux within the kernel via \c copy_file_range() or \c sendfile().
+ *  Nothing is written if the conversion fails.
+ *
+ *  \return
+ *      0 on success, -1 on failure
+ *
+ *  \param fd
+ *      the file descriptor to write to, which is left open
+ *
+ *  See texcaller_convert_with_options() for the other parameters.
+ */
+int texcaller_convert_to_fd(char **info, int fd, const char *source, size_t source_size, const char *source_format, const char *result_format, int max_runs, const texcaller_options *options);
+
+/*! Convert a LaTeX template with many records to one PDF per record.
+ *
+ *  This is a mail merge:
+ *  The body of the template,
+ *  which is everything between <tt>\\begin{document}</tt>
+ *  and <tt>\\end{document}</tt>,
+ *  is repeated for every record,
+ *  preceded by the record itself.
+ *  So records typically consist of macro definitions
+ *  such as <tt>\\def\\name{Alice}</tt>
+ *  that the body makes use of.
+ *  Every record starts on a fresh page with page number 1,
+ *  and its definitions are local to the record.
+ *  All LaTeX counters are reset at the start of every record,
+ *  and labels are local to the record that defines them.
+ *
+ *  Rather than running TeX separately for every record,
+ *  chunks of records are combined into a single document,
+ *  which is converted like texcaller_convert_with_options() does.
+ *  The resulting PDF is then split at the page boundaries
+ *  of the records.
+ *  This saves most of the startup time of TeX and its packages.
+ *  Note that other state is still shared by all records of a chunk,
+ *  such as registers that aren't LaTeX counters, citations,
+ *  and labels written at the end of the document,
+ *  so <tt>\\pageref</tt> to the last page
+ *  of a record won't work.
+ *  Templates must not rely on such state.
+ *
+ *  This requires a LaTeX release of 2020 or later.
+ *
+ *  This function is reentrant.
+ *
+ *  \param results
+ *      array of \c records_count elements.
+ *      On success, each element will be set to a newly allocated PDF
+ *      of the respective record.
+ *      On failure, all elements will be set to \c NULL.
+ *      The caller is responsible to free() them.
+ *
+ *  \param result_sizes
+ *      array of \c records_count elements,
+ *      which will be set to the sizes of \c results
+ *
+ *  \param info
+ *      will be set to a newly allocated string that contains
+ *      additional information such as an error message,
+ *      or \c NULL when out of memory.
+ *
+ *  \param source
+ *      the LaTeX template
+ *
+ *  \param source_size
+ *      size of \c source
+ *
+ *  \param records
+ *      array of \c records_count records, each of which is LaTeX code
+ *
+ *  \param record_sizes
+ *      array of \c records_count elements containing the sizes of \c records
+ *
+ *  \param records_count
+ *      number of records
+ *
+ *  \param chunk_size
+ *      maximum number of records to typeset by a single TeX run,
+ *      or 0 to typeset all of them at once
+ *
+ *  \param max_runs
+ *      maximum number of TeX runs per chunk, see texcaller_convert()
+ *
+ *  \param options
+ *      additional options, or \c NULL for the defaults.
+ *      The statistics cover all chunks.
+ *      Options \c preview_pages and \c outputs are not supported.
+ */
+void texcaller_convert_merge(char **results, size_t *result_sizes, char **info, const char *source, size_t source_size, const char *const *records, const size_t *record_sizes, size_t records_count, size_t chunk_size, int max_runs, const texcaller_options *options);
+
+/*! A document being converted repeatedly, such as in a live editor.
+ *
+ *  \see texcaller_session_create()
+ */
+typedef struct texcaller_session texcaller_session;
+
+/*! Create a session for converting a document repeatedly.
+ *
+ *  All conversions of a session run in the same directory,
+ *  which keeps the aux, toc and similar files of the previous build.
+ *  So if the aux file doesn't change by an edit,
+ *  a single TeX run suffices.
+ *  Assets are written and converted only once,
+ *  when the session is created.
+ *  The format, font maps and figures
+ *  are taken from the \c TEXCALLER_CACHE_DIR as usual,
+ *  see texcaller_warmup() for keeping them in memory.
+ *
+ *  This function is reentrant.
+ *  Different sessions may be used by different threads at once,
+ *  but only one conversion per session may run at a time.
+ *
+ *  \return
+ *      the new session, or \c NULL on failure
+ *
+ *  \param info
+ *      On failure, \c info will be set to a newly allocated string
+ *      that contains the error message.
+ *      On success, or when out of memory,
+ *      \c info will be set to \c NULL.
+ *
+ *  \param source_format
+ *      \c "TeX" or \c "LaTeX", see texcaller_convert()
+ *
+ *  \param result_format
+ *      \c "DVI" or \c "PDF", see texcaller_convert()
+ *
+ *  \param options
+ *      options of all conversions, or \c NULL for the defaults.
+ *      The assets are only needed during this call,
+ *      but all other pointers must stay valid for the whole session.
+ */
+texcaller_session *texcaller_session_create(char **info, const char *source_format, const char *result_format, const texcaller_options *options);
+
+/*! Convert the document of a session.
+ *
+ *  This works like texcaller_convert(),
+ *  with the formats and options of the session.
+ *  If the conversion fails or is cancelled,
+ *  all files of the previous build are discarded,
+ *  so the next conversion starts from scratch.
+ *
+ *  \param session
+ *      the session, see texcaller_session_create()
+ *
+ *  See texcaller_convert() for the other parameters.
+ */
+void texcaller_session_convert(char **result, size_t *result_size, char **info, texcaller_session *session, const char *source, size_t source_size, int max_runs);
+
+/*! A chapter of a multi-file LaTeX project.
+ *
+ *  \see texcaller_session_convert_project()
+ */
+typedef struct texcaller_chapter {
+    /*! Name of the chapter, such as \c "intro",
+     *  which is included by the main source via <tt>\\include{intro}</tt>.
+     *  It consists of at most 64 letters, digits, \c "-" and \c "_",
+     *  and must not start with \c "texput". */
+    const char *name;
+    /*! content of the chapter */
+    const char *data;
+    /*! size of \c data */
+    size_t size;
+} texcaller_chapter;
+
+/*! Convert a LaTeX project of several chapters to PDF,
+ *  rebuilding only the chapters that changed.
+ *
+ *  The session must convert from \c "LaTeX" to \c "PDF".
+ *  The aux file and the pages of every chapter are kept
+ *  from the previous project build of the session.
+ *  If only some chapters changed,
+ *  they are typeset alone via <tt>\\includeonly</tt>,
+ *  which reads the aux files of all other chapters,
+ *  and their pages are spliced into the previous PDF.
+ *  A full build is done instead
+ *  if the main source or the set of chapters changed,
+ *  or if a rebuilt chapter changed its number of pages
+ *  or its aux file, such as its labels,
+ *  which may affect other chapters.
+ *  If nothing changed, the previous PDF is returned.
+ *
+ *  The main source must not use <tt>\\includeonly</tt> itself.
+ *  Spliced PDFs contain the pages only,
+ *  without document-level data such as outlines.
+ *  The statistics cover all TeX runs of this call.
+ *
+ *  \param session
+ *      the session, see texcaller_session_create()
+ *
+ *  \param source
+ *      the main source, which includes the chapters
+ *
+ *  \param source_size
+ *      size of \c source
+ *
+ *  \param chapters
+ *      array of \c chapters_count chapters,
+ *      in the order in which they are included
+ *
+ *  \param chapters_count
+ *      number of chapters
+ *
+ *  See texcaller_convert() for the other parameters.
+ */
+void texcaller_session_convert_project(char **result, size_t *result_size, char **info, texcaller_session *session, const char *source, size_t source_size, const texcaller_chapter *chapters, size_t chapters_count, int max_runs);
+
+/*! Cancel the running conversion of a session,
+ *  such as one that was superseded by a newer edit.
+ *
+ *  The running TeX process is killed immediately,
+ *  and texcaller_session_convert() fails
+ *  with the message <tt>"Conversion was cancelled."</tt>.
+ *  If no conversion is running, nothing happens.
+ *
+ *  This function may be called from any thread.
+ *
+ *  \param session
+ *      the session, see texcaller_session_create()
+ */
+void texcaller_session_cancel(texcaller_session *session);
+
+/*! Free a session, removing its directory.
+ *
+ *  \param session
+ *      the session, see texcaller_session_create()
+ */
+void texcaller_session_free(texcaller_session *session);
+
+/*! A pool of worker threads that run conversions.
+ *
+ *  \see texcaller_pool_create()
+ */
+typedef struct texcaller_pool texcaller_pool;
+
+/*! Options of a worker pool.
+ *
+ *  \see texcaller_pool_options_init()
+ */
+typedef struct texcaller_pool_options {
+    /*! number of workers, or 0 for the number of CPUs */
+    int workers;
+    /*! Number of conversions after which a worker is recycled,
+     *  or 0 to never recycle workers because of their age.
+     *
+     *  Every worker runs its conversions in its own directory,
+     *  which keeps the aux and similar files of the previous conversion,
+     *  see texcaller_session_create().
+     *  Recycling replaces that directory by a fresh one,
+     *  dropping files that documents left behind.
+     */
+    int recycle_jobs;
+    /*! Peak memory of a TeX process in kilobytes,
+     *  such as texcaller_stats::max_rss,
+     *  beyond which the worker that ran it is recycled,
+     *  or 0 to never recycle workers because of memory usage. */
+    long recycle_rss;
+    /*! Number of spare working directories to keep ready,
+     *  which have passed a canary conversion.
+     *  Recycled workers switch to a spare one immediately,
+     *  so recycling never delays a conversion.
+     *  While there is no spare one, workers keep their directory.
+     */
+    int spares;
+    /*! Maximum number of workers,
+     *  or 0 to keep the number of workers fixed.
+     *
+     *  If greater than \c workers,
+     *  the pool grows while conversions wait for a worker
+     *  and shrinks again while workers are idle,
+     *  keeping at least \c workers workers.
+     *  Scaling is decided every quarter of a second.
+     *  New workers start with a spare working directory
+     *  or one that has passed a canary conversion.
+     */
+    int max_workers;
+    /*! Time in seconds the oldest queued conversion
+     *  has to wait before the pool grows by a worker. */
+    double scale_up_wait;
+    /*! Time in seconds a worker has to be idle,
+     *  and the pool must not have grown,
+     *  before the pool shrinks by that worker.
+     *  This being much longer than \c scale_up_wait
+     *  keeps the pool from oscillating. */
+    double scale_down_idle;
+    /*! CPU pressure in percent beyond which the pool doesn't grow,
+     *  see texcaller_pool_stats::cpu_pressure. */
+    double max_cpu_pressure;
+    /*! Memory pressure in percent beyond which the pool doesn't grow,
+     *  see texcaller_pool_stats::memory_pressure. */
+    double max_memory_pressure;
+    /*! Placement of the workers on the CPUs of the host,
+     *  which their TeX processes inherit:
+     *
+     *  - \c "none" lets the workers float across all CPUs.
+     *  - \c "node" pins each worker to the CPUs of a NUMA node,
+     *    spreading the workers evenly across nodes,
+     *    and prefers memory of that node.
+     *  - \c "cpu" pins each worker to a single CPU,
+     *    filling one node after the other,
+     *    and prefers memory of the node of that CPU.
+     *  - \c NULL chooses \c "node" on hosts with several NUMA nodes,
+     *    and \c "none" otherwise.
+     *
+     *  Only CPUs the process may run on are used.
+     *  Pinning is skipped where the host doesn't permit it.
+     *  On systems other than Linux, \c "none" is the only placement.
+     */
+    const char *placement;
+} texcaller_pool_options;
+
+/*! Statistics of a worker pool.
+ *
+ *  \see texcaller_pool_get_stats()
+ */
+typedef struct texcaller_pool_stats {
+    /*! number of active workers */
+    int workers;
+    /*! number of conversions waiting for a worker */
+    unsigned long queued;
+    /*! number of conversions finished so far */
+    unsigned long jobs;
+    /*! number of workers recycled so far */
+    unsigned long recycled;
+    /*! number of canary conversions run so far */
+    unsigned long canaries;
+    /*! number of working directories discarded
+     *  because their canary conversion failed */
+    unsigned long unhealthy;
+    /*! number of workers running a conversion */
+    int busy;
+    /*! time in seconds the oldest queued conversion has waited */
+    double wait_time;
+    /*! number of workers added by scaling so far */
+    unsigned long scale_ups;
+    /*! number of workers removed by scaling so far */
+    unsigned long scale_downs;
+    /*! number of conversions run by the worker they were routed to */
+    unsigned long affinity_hits;
+    /*! number of conversions run by another worker,
+     *  because the routed one was busy */
+    unsigned long affinity_misses;
+    /*! number of conversions an idle worker took
+     *  from the queue of another worker */
+    unsigned long steals;
+    /*! number of conversions queued in the shared injection queue,
+     *  because they have assets or the queue of their worker was full */
+    unsigned long injected;
+    /*! number of failed compare-and-swap attempts on the job queues,
+     *  which grows with the contention between threads */
+    unsigned long cas_failures;
+    /*! number of times an idle worker went to sleep */
+    unsigned long sleeps;
+    /*! number of times a submitted conversion woke up a sleeping worker */
+    unsigned long wakeups;
+    /*! number of NUMA nodes the workers are placed on,
+     *  or 1 if they aren't placed on nodes,
+     *  see texcaller_pool_get_node_stats() */
+    int nodes;
+    /*! Share of the last 10 seconds in percent
+     *  during which some tasks waited for a CPU,
+     *  from \c /proc/pressure/cpu if available,
+     *  otherwise estimated from the load average.
+     *  This is only sampled when scaling is enabled. */
+    double cpu_pressure;
+    /*! Share of the last 10 seconds in percent
+     *  during which some tasks waited for memory,
+     *  from \c /proc/pressure/memory if available, otherwise 0.
+     *  This is only sampled when scaling is enabled. */
+    double memory_pressure;
+} texcaller_pool_stats;
+
+/*! Statistics of the workers of a pool placed on a NUMA node.
+ *
+ *  \see texcaller_pool_get_node_stats()
+ */
+typedef struct texcaller_pool_node_stats {
+    /*! ID of the NUMA node,
+     *  or -1 if the workers aren't placed on nodes */
+    int node;
+    /*! number of active workers placed on the node */
+    int workers;
+    /*! number of conversions finished by workers on the node */
+    unsigned long jobs;
+    /*! total wall clock time in seconds of these conversions */
+    double run_time;
+    /*! total CPU time in seconds of the TeX runs of these conversions */
+    double cpu_time;
+} texcaller_pool_node_stats;
+
+/*! Initialize pool options with their default values.
+ *
+ *  \param options
+ *      the options to initialize
+ */
+void texcaller_pool_options_init(texcaller_pool_options *options);
+
+/*! Create a pool of worker threads that run conversions.
+ *
+ *  Conversions of a pool are limited to one per worker,
+ *  and each worker keeps its working directory between conversions,
+ *  so no directory has to be created per conversion.
+ *  The files of the previous conversion are removed beforehand,
+ *  so unrelated documents never see each other's aux files.
+ *  A background thread replaces recycled working directories
+ *  and checks the directories of workers whose conversion failed
+ *  by a canary conversion of a tiny plain TeX document,
+ *  discarding them if that fails as well.
+ *
+ *  The working directories of all workers and spares
+ *  are checked by a canary conversion before this function returns.
+ *
+ *  \return
+ *      the new pool, or \c NULL on failure
+ *
+ *  \param info
+ *      On failure, \c info will be set to a newly allocated string
+ *      that contains the error message.
+ *      On success, or when out of memory,
+ *      \c info will be set to \c NULL.
+ *
+ *  \param options
+ *      options of the pool, or \c NULL for the defaults
+ */
+texcaller_pool *texcaller_pool_create(char **info, const texcaller_pool_options *options);
+
+/*! Convert a TeX or LaTeX source by a worker of a pool.
+ *
+ *  This works like texcaller_convert_with_options(),
+ *  but waits for a free worker if all workers are busy.
+ *  Conversions are routed by their formats and preamble,
+ *  so conversions of the same template go to the same worker,
+ *  whose working directory matches the template.
+ *  Each template has a preferred order of workers
+ *  via consistent hashing, and the first worker
+ *  that isn't loaded beyond 125% of the average load is chosen.
+ *  If that worker is busy when another one is idle,
+ *  the idle worker steals the conversion from its queue.
+ *  Conversions with assets run in a temporary directory
+ *  rather than the working directory of the worker,
+ *  so they go to a shared queue taken from by any worker.
+ *
+ *  The queues are lock-free, so submitters and workers
+ *  don't contend for a lock while the pool is busy.
+ *  The statistics of the pool show the remaining contention,
+ *  see texcaller_pool_stats::cas_failures.
+ *
+ *  This function may be called by many threads at once.
+ *
+ *  \param pool
+ *      the pool, see texcaller_pool_create()
+ *
+ *  See texcaller_convert_with_options() for the other parameters.
+ */
+void texcaller_pool_convert(char **result, size_t *result_size, char **info, texcaller_pool *pool, const char *source, size_t source_size, const char *source_format, const char *result_format, int max_runs, const texcaller_options *options);
+
+/*! A conversion submitted to a pool.
+ *
+ *  \see texcaller_pool_submit()
+ */
+typedef struct texcaller_pool_job texcaller_pool_job;
+
+/*! Function called when a submitted conversion has finished.
+ *
+ *  It is called by the thread of a worker,
+ *  so it should hand the result over to another thread
+ *  rather than process it, and must not block.
+ *
+ *  \param data
+ *      see texcaller_pool_submit()
+ *
+ *  \param result
+ *      the result of the conversion, or \c NULL on failure,
+ *      which must be freed by the callee
+ *
+ *  \param result_size
+ *      size of \c result
+ *
+ *  \param info
+ *      the info message of the conversion, or \c NULL if out of memory,
+ *      which must be freed by the callee
+ */
+typedef void (*texcaller_pool_callback)(void *data, char *result, size_t result_size, char *info);
+
+/*! Submit a conversion to a worker of a pool without waiting for it.
+ *
+ *  This works like texcaller_pool_convert(),
+ *  but returns at once and calls \c callback
+ *  when the conversion has finished,
+ *  so few threads may keep many conversions in flight.
+ *  \c source, the format names and \c options
+ *  must stay valid until then.
+ *
+ *  \return
+ *      the submitted conversion, to be released by texcaller_pool_release(),
+ *      or \c NULL on failure, in which case \c callback isn't called
+ *
+ *  \param info
+ *      info message on failure, or \c NULL if out of memory,
+ *      which must be freed by the caller
+ *
+ *  \param pool
+ *      the pool, see texcaller_pool_create()
+ *
+ *  \param callback
+ *      function called when the conversion has finished
+ *
+ *  \param data
+ *      passed to \c callback
+ *
+ *  See texcaller_convert_with_options() for the other parameters.
+ */
+texcaller_pool_job *texcaller_pool_submit(char **info, texcaller_pool *pool, const char *source, size_t source_size, const char *source_format, const char *result_format, int max_runs, const texcaller_options *options, texcaller_pool_callback callback, void *data);
+
+/*! Cancel a submitted conversion.
+ *
+ *  A waiting conversion isn't run at all,
+ *  and the TeX process of a running one is killed immediately,
+ *  unless the conversion has assets, which then runs to completion.
+ *  The conversion fails
+ *  with the message <tt>"Conversion was cancelled."</tt>.
+ *  If it has finished already, nothing happens.
+ *  The callback is called in any case.
+ *
+ *  This function may be called from any thread,
+ *  until the conversion is released.
+ *
+ *  \param job
+ *      the conversion, see texcaller_pool_submit()
+ */
+void texcaller_pool_cancel(texcaller_pool_job *job);
+
+/*! Release a submitted conversion.
+ *
+ *  This may be done before or after it has finished,
+ *  but it can't be cancelled anymore afterwards.
+ *
+ *  \param job
+ *      the conversion, see texcaller_pool_submit()
+ */
+void texcaller_pool_release(texcaller_pool_job *job);
+
+/*! Get the statistics of a worker pool.
+ *
+ *  This function may be called from any thread.
+ *
+ *  \param pool
+ *      the pool, see texcaller_pool_create()
+ *
+ *  \param stats
+ *      will be filled with the statistics
+ */
+void texcaller_pool_get_stats(texcaller_pool *pool, texcaller_pool_stats *stats);
+
+/*! Get the statistics of the workers of a pool placed on a NUMA node.
+ *
+ *  This function may be called from any thread.
+ *
+ *  \return
+ *      0 on success, -1 if there is no such node
+ *
+ *  \param pool
+ *      the pool, see texcaller_pool_create()
+ *
+ *  \param index
+ *      index of the node, less than texcaller_pool_stats::nodes
+ *
+ *  \param stats
+ *      will be filled with the statistics
+ */
+int texcaller_pool_get_node_stats(texcaller_pool *pool, int index, texcaller_pool_node_stats *stats);
+
+/*! Free a worker pool.
+ *
+ *  Waiting conversions are finished first.
+ *  No conversion may be started once this function has been called.
+ *
+ *  \param pool
+ *      the pool, see texcaller_pool_create()
+ */
+void texcaller_pool_free(texcaller_pool *pool);
+
+/*! A PDF file being concatenated from several PDF files.
+ *
+ *  \see texcaller_concat_begin()
+ */
+typedef struct texcaller_concat texcaller_concat;
+
+/*! Start concatenating PDF files,
+ *  such as many conversion results for a print shop.
+ *
+ *  The concatenated PDF is streamed to a file descriptor
+ *  while PDF files are added via texcaller_concat_add(),
+ *  and completed by texcaller_concat_finish().
+ *  Memory usage doesn't depend on the size of the PDF files,
+ *  but only on their number of objects.
+ *
+ *  Objects are renumbered and copied without decompressing them.
+ *  Identical objects, such as fonts and images
+ *  shared by several documents, are written only once.
+ *  Document-level data such as outlines, links between documents
+ *  and metadata are dropped.
+ *
+ *  Only PDF files with a classic cross-reference table are supported,
+ *  such as results of texcaller_convert_merge(),
+ *  or of texcaller_convert_with_options()
+ *  with texcaller_options::classic_xref set.
+ *
+ *  This function is reentrant,
+ *  but a concatenation must not be used by several threads at once.
+ *
+ *  \return
+ *      the new concatenation, or \c NULL when out of memory
+ *
+ *  \param info
+ *      will be set to \c NULL
+ *
+ *  \param fd
+ *      the file descriptor to write the concatenated PDF to,
+ *      which is not closed
+ */
+texcaller_concat *texcaller_concat_begin(char **info, int fd);
+
+/*! Append all pages of a PDF file to a concatenated PDF file.
+ *
+ *  If this fails, the concatenation can't be continued,
+ *  but still has to be finished via texcaller_concat_finish().
+ *
+ *  \return
+ *      0 on success, -1 on failure
+ *
+ *  \param info
+ *      On failure, \c info will be set to a newly allocated string
+ *      that contains the error message.
+ *      On success, or when out of memory,
+ *      \c info will be set to \c NULL.
+ *
+ *  \param concat
+ *      the concatenation, see texcaller_concat_begin()
+ *
+ *  \param pdf
+ *      the PDF file to append
+ *
+ *  \param pdf_size
+ *      size of \c pdf
+ */
+int texcaller_concat_add(char **info, texcaller_concat *concat, const char *pdf, size_t pdf_size);
+
+/*! Finish concatenating PDF files.
+ *
+ *  This writes the remaining parts of the concatenated PDF,
+ *  and frees the concatenation in any case.
+ *
+ *  \return
+ *      0 on success, -1 on failure
+ *
+ *  \param info
+ *      On failure, \c info will be set to a newly allocated string
+ *      that contains the error message.
+ *      On success, or when out of memory,
+ *      \c info will be set to \c NULL.
+ *
+ *  \param concat
+ *      the concatenation, see texcaller_concat_begin()
+ */
+int texcaller_concat_finish(char **info, texcaller_concat *concat);
+
+/*! Build a slim format with only the given hyphenation languages.
+ *
+ *  The format is stored in the \c TEXCALLER_CACHE_DIR,
+ *  where it is picked up by all conversions
+ *  with the same \c source_format, \c result_format and \c languages.
+ *  Calling this function is optional,
+ *  because missing formats are built on demand,
+ *  but it allows for building all formats in advance.
+ *
+ *  This function is reentrant.
+ *
+ *  \return
+ *      0 on success, -1 on failure
+ *
+ *  \param info
+ *      will be set to a newly allocated string that contains
+ *      additional information such as an error message,
+ *      or \c NULL when out of memory.
+ *
+ *  \param source_format
+ *      \c "TeX" or \c "LaTeX", see texcaller_convert()
+ *
+ *  \param result_format
+ *      \c "DVI" or \c "PDF", see texcaller_convert()
+ *
+ *  \param languages
+ *      comma separated list of hyphenation languages,
+ *      see texcaller_options::languages
+ */
+int texcaller_build_format(char **info, const char *source_format, const char *result_format, const char *languages);
+
+/*! Warm up the page cache with all files needed by the cached templates.
+ *
+ *  After a reboot or deployment,
+ *  formats, fonts and packages are not yet in the page cache,
+ *  which makes the first conversions several times slower.
+ *  This function reads all files that have been used
+ *  by previous conversions,
+ *  so fresh machines are at full speed before their first real conversion.
+ *
+ *  The files are known from the \c TEXCALLER_CACHE_DIR,
+ *  where Texcaller records the files read by TeX
+ *  for each document preamble.
+ *  So this function requires the cache directory
+ *  to be populated, for example by copying it
+ *  from a machine that has been running for a while.
+ *
+ *  This function is reentrant.
+ *
+ *  \return
+ *      0 on success, -1 on failure
+ *
+ *  \param info
+ *      will be set to a newly allocated string that contains
+ *      additional information such as an error message,
+ *      or \c NULL when out of memory.
+ *
+ *  \param processes
+ *      number of processes that read files in parallel,
+ *      or 0 for the number of CPUs
+ *
+ *  \param convert
+ *      if non-zero, additionally run one throwaway conversion per
+ *      TeX command, which also warms up all data
+ *      TeX reads at startup, such as its file name databases
+ */
+int texcaller_warmup(char **info, int processes, int convert);
+
 /*! Escape a string for direct use in LaTeX.
  *
  *  That is, all LaTeX special characters are replaced
@@ -300,6 +1367,115 @@ Téxt → {''}with{''} \$peciäl \textless{}characters\textgreater{}
  */
 char *texcaller_escape_latex(const char *s);
 
+/*! Escape many strings at once for direct use in LaTeX.
+ *
+ *  This works like texcaller_escape_latex(),
+ *  but takes all strings in one buffer
+ *  and returns all escaped strings in one buffer,
+ *  such as for the cells of a large table.
+ *  So bindings cross into the library once
+ *  rather than once per string.
+ *
+ *  This function is reentrant.
+ *
+ *  \param result
+ *      will contain the escaped strings one after another,
+ *      followed by a null character,
+ *      or \c NULL when out of memory.
+ *      Must be freed by the caller.
+ *
+ *  \param result_offsets
+ *      will contain <tt>count + 1</tt> offsets into \c result,
+ *      so the escaped string \c i reaches
+ *      from <tt>result_offsets[i]</tt> to <tt>result_offsets[i + 1]</tt>,
+ *      or \c NULL when out of memory.
+ *      Must be freed by the caller.
+ *
+ *  \param strings
+ *      the strings to escape, one after another
+ *
+ *  \param offsets
+ *      <tt>count + 1</tt> ascending offsets into \c strings,
+ *      so the string \c i reaches
+ *      from <tt>offsets[i]</tt> to <tt>offsets[i + 1]</tt>
+ *
+ *  \param count
+ *      number of strings
+ *
+ *  \return
+ *      0 on success, -1 when out of memory
+ */
+int texcaller_escape_latex_batch(char **result, size_t **result_offsets, const char *strings, const size_t *offsets, size_t count);
+
+/*! A column of a table, with a value for each row.
+ *
+ *  Only the member matching \c type has to be set.
+ *
+ *  \see texcaller_render_table()
+ */
+typedef struct texcaller_column {
+    /*! Type of the values:
+     *  - \c "text" for strings, which are escaped for LaTeX
+     *  - \c "integer" for \c long values
+     *  - \c "number" for \c double values
+     */
+    const char *type;
+    /*! strings of a \c "text" column, one after another */
+    const char *strings;
+    /*! <tt>rows + 1</tt> ascending offsets into \c strings,
+     *  see texcaller_escape_latex_batch() */
+    const size_t *offsets;
+    /*! values of an \c "integer" column */
+    const long *integers;
+    /*! values of a \c "number" column */
+    const double *numbers;
+    /*! Digits after the decimal point of a \c "number" column, at most 17,
+     *  or -1 for six significant digits as by <tt>printf("%g")</tt>. */
+    int precision;
+    /*! nonzero for each row without a value, which gives an empty cell,
+     *  or \c NULL if all rows have values */
+    const unsigned char *nulls;
+} texcaller_column;
+
+/*! Render columns of values as the body of a LaTeX table.
+ *
+ *  Each row becomes a line of cells separated by <tt>&</tt>
+ *  and terminated by <tt>\\\\</tt>,
+ *  to be put into a \c tabular or \c longtable environment
+ *  whose column specification fits \c columns.
+ *  The output size is calculated beforehand,
+ *  so the table is written into a single allocation in one pass,
+ *  escaping text and formatting numbers on the way.
+ *  The columns may point into buffers of other languages,
+ *  such as NumPy arrays or Arrow string columns.
+ *
+ *  This function is reentrant.
+ *
+ *  \param result
+ *      will contain the table body, followed by a null character,
+ *      or \c NULL on failure.
+ *      Must be freed by the caller.
+ *
+ *  \param result_size
+ *      will contain the size of \c result,
+ *      without the null character
+ *
+ *  \param info
+ *      will contain the error message on failure,
+ *      or \c NULL if out of memory.
+ *      Must be freed by the caller.
+ *
+ *  \param columns
+ *      the columns, from left to right
+ *
+ *  \param columns_count
+ *      number of columns
+ *
+ *  \param rows
+ *      number of rows
+ */
+void texcaller_render_table(char **result, size_t *result_size, char **info, const texcaller_column *columns, size_t columns_count, size_t rows);
+
 /*! @} */
 
 #ifdef __cplusplus
@@ -310,6 +1486,33 @@ char *texcaller_escape_latex(const char *s);
 
 #include <string>
 #include <stdexcept>
+#include <vector>
+
+#if __cplusplus >= 201703L
+#include <cstddef>
+#include <cstdlib>
+#include <memory>
+#include <string_view>
+#if __cplusplus > 201703L && __has_include(<span>)
+#include <span>
+#endif
+#endif
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>) && __has_include(<stop_token>)
+#include <atomic>
+#include <cerrno>
+#include <coroutine>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <stop_token>
+#include <system_error>
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
+#endif
 
 namespace texcaller
 {
@@ -369,7 +1572,7 @@ c++ -o example example.cxx `pkg-config texcaller --cflags --libs`
  *      the TeX interpreter exited with an error,
  *      or the output didn't stabilize after \c max_runs runs.
  */
-inline void convert(std::string &result, std::string &info, const std::string &source, const std::string &source_format, const std::string &result_format, int max_runs) throw(std::domain_error, std::runtime_error)
+inline void convert(std::string &result, std::string &info, const std::string &source, const std::string &source_format, const std::string &result_format, int max_runs)
 {
     char *c_result;
     size_t c_result_size;
@@ -390,6 +1593,58 @@ inline void convert(std::string &result, std::string &info, const std::string &s
     free(c_result);
 }
 
+/*! Convert a TeX or LaTeX source to DVI or PDF, moving the result to a file.
+ *
+ *  This is a simple wrapper around \ref texcaller_convert_to_path,
+ *  which never reads the generated document into memory.
+ *
+ *  \param path
+ *      path of the file to create or replace
+ *
+ *  See texcaller::convert() for the other parameters and the exceptions.
+ */
+inline void convert_to_path(std::string &info, const std::string &path, const std::string &source, const std::string &source_format, const std::string &result_format, int max_runs)
+{
+    char *c_info;
+    const int status = ::texcaller_convert_to_path(&c_info, path.c_str(),
+                                                   source.data(), source.size(), source_format.c_str(), result_format.c_str(), max_runs,
+                                                   NULL);
+    if (c_info == NULL) {
+        throw std::runtime_error("Out of memory.");
+    }
+    info.assign(c_info);
+    free(c_info);
+    if (status != 0) {
+        throw std::domain_error(info);
+    }
+}
+
+/*! Convert a TeX or LaTeX source to DVI or PDF, copying the result to a file descriptor.
+ *
+ *  This is a simple wrapper around \ref texcaller_convert_to_fd,
+ *  which never reads the generated document into memory.
+ *
+ *  \param fd
+ *      the file descriptor to write to
+ *
+ *  See texcaller::convert() for the other parameters and the exceptions.
+ */
+inline void convert_to_fd(std::string &info, int fd, const std::string &source, const std::string &source_format, const std::string &result_format, int max_runs)
+{
+    char *c_info;
+    const int status = ::texcaller_convert_to_fd(&c_info, fd,
+                                                 source.data(), source.size(), source_format.c_str(), result_format.c_str(), max_runs,
+                                                 NULL);
+    if (c_info == NULL) {
+        throw std::runtime_error("Out of memory.");
+    }
+    info.assign(c_info);
+    free(c_info);
+    if (status != 0) {
+        throw std::domain_error(info);
+    }
+}
+
 /*! Escape a string for direct use in LaTeX.
  *
  *  This is a simple wrapper around \ref texcaller_escape_latex.
@@ -400,7 +1655,7 @@ inline void convert(std::string &result, std::string &info, const std::string &s
  *  \return
  *      the escaped value
  */
-inline std::string escape_latex(const std::string &s) throw(std::runtime_error)
+inline std::string escape_latex(const std::string &s)
 {
     char *c_result = ::texcaller_escape_latex(s.c_str());
     if (c_result == NULL) {
@@ -411,6 +1666,509 @@ inline std::string escape_latex(const std::string &s) throw(std::runtime_error)
     return result;
 }
 
+/*! Escape many strings at once for direct use in LaTeX.
+ *
+ *  This is a simple wrapper around \ref texcaller_escape_latex_batch.
+ *
+ *  \param strings
+ *      the strings to escape
+ *
+ *  \return
+ *      the escaped values, in the same order
+ */
+inline std::vector<std::string> escape_latex_batch(const std::vector<std::string> &strings)
+{
+    std::string c_strings;
+    std::vector<size_t> c_offsets(1, 0);
+    char *c_result;
+    size_t *c_result_offsets;
+    c_offsets.reserve(strings.size() + 1);
+    for (std::vector<std::string>::const_iterator s = strings.begin(); s != strings.end(); ++s) {
+        c_strings += *s;
+        c_offsets.push_back(c_strings.size());
+    }
+    if (::texcaller_escape_latex_batch(&c_result, &c_result_offsets,
+                                       c_strings.data(), &c_offsets[0], strings.size()) != 0) {
+        throw std::runtime_error("Out of memory.");
+    }
+    std::vector<std::string> result;
+    result.reserve(strings.size());
+    for (size_t i = 0; i < strings.size(); i++) {
+        result.push_back(std::string(c_result + c_result_offsets[i],
+                                     c_result_offsets[i + 1] - c_result_offsets[i]));
+    }
+    free(c_result);
+    free(c_result_offsets);
+    return result;
+}
+
+#if __cplusplus >= 201703L
+
+/*! The result of a conversion by texcaller::convert() with \c std::string_view arguments.
+ *
+ *  This owns the buffer allocated by the C interface,
+ *  so the generated document is never copied.
+ *  It can be moved, but not copied.
+ *  The info message stays a C string until it is used.
+ *
+ *  This requires C++17.
+ *  The bytes() member requires C++20.
+ */
+class result
+{
+public:
+    result(result &&) noexcept = default;
+    result &operator=(result &&) noexcept = default;
+    result(const result &) = delete;
+    result &operator=(const result &) = delete;
+
+    /*! The generated document. */
+    const std::byte *data() const noexcept
+    {
+        return reinterpret_cast<const std::byte *>(data_.get());
+    }
+
+    /*! Size of the generated document in bytes. */
+    std::size_t size() const noexcept
+    {
+        return size_;
+    }
+
+    /*! The generated document as characters,
+     *  such as for writing it to a stream. */
+    std::string_view view() const noexcept
+    {
+        return std::string_view(data_.get(), size_);
+    }
+
+#ifdef __cpp_lib_span
+    /*! The generated document as bytes. */
+    std::span<const std::byte> bytes() const noexcept
+    {
+        return std::span<const std::byte>(data(), size_);
+    }
+#endif
+
+    /*! Additional information such as TeX warnings. */
+    std::string_view info() const noexcept
+    {
+        return info_ ? std::string_view(info_.get()) : std::string_view();
+    }
+
+    /*! Statistics of the conversion. */
+    const texcaller_stats &stats() const noexcept
+    {
+        return stats_;
+    }
+
+    /*! Give up the ownership of the generated document.
+     *
+     *  \return
+     *      the document, which has to be freed via free()
+     */
+    char *release() noexcept
+    {
+        size_ = 0;
+        return data_.release();
+    }
+
+private:
+    struct free_deleter
+    {
+        void operator()(char *p) const noexcept
+        {
+            std::free(p);
+        }
+    };
+
+    result() noexcept = default;
+
+    std::unique_ptr<char, free_deleter> data_;
+    std::size_t size_ = 0;
+    std::unique_ptr<char, free_deleter> info_;
+    texcaller_stats stats_ = {};
+
+    friend result convert(std::string_view source, std::string_view source_format, std::string_view result_format, int max_runs, const texcaller_options *options);
+    friend class conversion;
+};
+
+/*! Convert a TeX or LaTeX source to DVI or PDF, without copying either.
+ *
+ *  This is a wrapper around \ref texcaller_convert_with_options
+ *  that hands over the generated document as it is.
+ *  Only the short format names are copied,
+ *  to terminate them by a null character.
+ *
+ *  This requires C++17.
+ *
+ *  \return
+ *      the generated document with its info message and statistics
+ *
+ *  \param source
+ *      the source to convert, which may contain null characters
+ *
+ *  \param options
+ *      additional options, or \c nullptr for the defaults.
+ *      If its \c stats member is set,
+ *      that is filled as well as result::stats().
+ *
+ *  See the texcaller::convert() with \c std::string arguments
+ *  for the other parameters and the exceptions.
+ */
+inline result convert(std::string_view source, std::string_view source_format, std::string_view result_format, int max_runs, const texcaller_options *options = nullptr)
+{
+    const std::string c_source_format(source_format);
+    const std::string c_result_format(result_format);
+    texcaller_options c_options;
+    char *c_result;
+    size_t c_result_size;
+    char *c_info;
+    result r;
+    if (options != nullptr) {
+        c_options = *options;
+    } else {
+        ::texcaller_options_init(&c_options);
+    }
+    c_options.stats = &r.stats_;
+    ::texcaller_convert_with_options(&c_result, &c_result_size, &c_info,
+                                     source.data(), source.size(),
+                                     c_source_format.c_str(), c_result_format.c_str(),
+                                     max_runs, &c_options);
+    r.data_.reset(c_result);
+    r.size_ = c_result_size;
+    r.info_.reset(c_info);
+    if (options != nullptr && options->stats != nullptr) {
+        *options->stats = r.stats_;
+    }
+    if (c_info == nullptr) {
+        throw std::runtime_error("Out of memory.");
+    }
+    if (c_result == nullptr) {
+        throw std::domain_error(c_info);
+    }
+    return r;
+}
+
+#endif
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>) && __has_include(<stop_token>)
+
+/*! Resumes coroutines whose conversions by a pool have finished.
+ *
+ *  The TeX processes are waited for by the workers of the pool,
+ *  so a reactor only hands each finished conversion
+ *  back to the threads that await conversions.
+ *  See epoll_reactor and post_reactor.
+ *
+ *  This requires C++20.
+ */
+class reactor
+{
+public:
+    virtual ~reactor() = default;
+
+    /*! Arrange for a coroutine to be resumed.
+     *
+     *  This is called by the thread of a pool worker,
+     *  so it must neither resume the coroutine itself nor block.
+     *
+     *  \param handle
+     *      the coroutine awaiting the finished conversion
+     */
+    virtual void schedule(std::coroutine_handle<> handle) noexcept = 0;
+};
+
+#ifdef __linux__
+
+/*! The default reactor, which resumes coroutines
+ *  in the threads calling run_once().
+ *
+ *  Finished conversions are signalled via an \c eventfd
+ *  registered with \c epoll.
+ *  So instead of calling run_once() in a dedicated thread,
+ *  fd() may be watched by another event loop,
+ *  which calls run_once(0) whenever it becomes readable.
+ *
+ *  This requires C++20 and Linux.
+ *  On other systems, use post_reactor.
+ */
+class epoll_reactor : public reactor
+{
+public:
+    epoll_reactor()
+    {
+        epoll_event event = {};
+        epoll_fd_ = ::epoll_create1(EPOLL_CLOEXEC);
+        if (epoll_fd_ == -1) {
+            throw std::system_error(errno, std::generic_category(), "Unable to create epoll instance");
+        }
+        event_fd_ = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        event.events = EPOLLIN;
+        if (event_fd_ == -1 || ::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, event_fd_, &event) == -1) {
+            const int error = errno;
+            if (event_fd_ != -1) {
+                ::close(event_fd_);
+            }
+            ::close(epoll_fd_);
+            throw std::system_error(error, std::generic_category(), "Unable to create eventfd");
+        }
+    }
+
+    ~epoll_reactor() override
+    {
+        ::close(event_fd_);
+        ::close(epoll_fd_);
+    }
+
+    epoll_reactor(const epoll_reactor &) = delete;
+    epoll_reactor &operator=(const epoll_reactor &) = delete;
+
+    /*! The \c epoll descriptor,
+     *  which becomes readable when conversions have finished. */
+    int fd() const noexcept
+    {
+        return epoll_fd_;
+    }
+
+    void schedule(std::coroutine_handle<> handle) noexcept override
+    {
+        const std::uint64_t one = 1;
+        {
+            const std::lock_guard<std::mutex> lock(mutex_);
+            ready_.push_back(handle);
+        }
+        while (::write(event_fd_, &one, sizeof(one)) == -1 && errno == EINTR) {
+            /* interrupted by a signal */
+        }
+    }
+
+    /*! Wait for finished conversions and resume their coroutines.
+     *
+     *  This may be called by several threads at once.
+     *
+     *  \return
+     *      the number of resumed coroutines
+     *
+     *  \param timeout
+     *      maximum time to wait in milliseconds,
+     *      or -1 to wait until a conversion has finished
+     */
+    std::size_t run_once(int timeout = -1)
+    {
+        epoll_event event;
+        std::uint64_t count;
+        std::vector<std::coroutine_handle<> > ready;
+        if (::epoll_wait(epoll_fd_, &event, 1, timeout) == -1 && errno != EINTR) {
+            throw std::system_error(errno, std::generic_category(), "Unable to wait for conversions");
+        }
+        if (::read(event_fd_, &count, sizeof(count)) == -1 && errno != EAGAIN) {
+            throw std::system_error(errno, std::generic_category(), "Unable to read eventfd");
+        }
+        {
+            const std::lock_guard<std::mutex> lock(mutex_);
+            ready.swap(ready_);
+        }
+        for (std::coroutine_handle<> handle : ready) {
+            handle.resume();
+        }
+        return ready.size();
+    }
+
+private:
+    int epoll_fd_;
+    int event_fd_;
+    std::mutex mutex_;
+    std::vector<std::coroutine_handle<> > ready_;
+};
+
+#endif
+
+/*! A reactor that hands coroutines over to an executor,
+ *  such as the one of a Boost.Asio \c io_context:
+ *
+ *  \code
+texcaller::post_reactor reactor([&io](auto f) { boost::asio::post(io, std::move(f)); });
+ *  \endcode
+ *
+ *  This requires C++20.
+ *
+ *  \tparam Post
+ *      function object that takes a nullary function object
+ *      and arranges for it to be called, without blocking
+ */
+template <class Post>
+class post_reactor : public reactor
+{
+public:
+    explicit post_reactor(Post post) : post_(std::move(post))
+    {
+    }
+
+    void schedule(std::coroutine_handle<> handle) noexcept override
+    {
+        post_([handle]() { handle.resume(); });
+    }
+
+private:
+    Post post_;
+};
+
+/*! A conversion by a pool that can be awaited via \c co_await,
+ *  see the texcaller::convert() with a pool and a reactor.
+ *
+ *  Awaiting it submits the conversion to the pool
+ *  and suspends the coroutine without blocking the thread,
+ *  until the reactor resumes the coroutine.
+ *  Awaiting yields a texcaller::result,
+ *  or throws the exceptions of the synchronous texcaller::convert().
+ *
+ *  The awaiting coroutine must not be destroyed while it is suspended.
+ *
+ *  This requires C++20.
+ */
+class conversion
+{
+public:
+    conversion(texcaller_pool *pool, texcaller::reactor &reactor, std::string_view source, std::string_view source_format, std::string_view result_format, int max_runs, const texcaller_options *options, std::stop_token stop)
+        : pool_(pool), reactor_(reactor), source_(source),
+          source_format_(source_format), result_format_(result_format),
+          max_runs_(max_runs), stop_(std::move(stop))
+    {
+        if (options != nullptr) {
+            options_ = *options;
+            stats_ = options->stats;
+        } else {
+            ::texcaller_options_init(&options_);
+        }
+        options_.stats = &result_.stats_;
+    }
+
+    ~conversion()
+    {
+        stop_callback_.reset();
+        if (job_ != nullptr) {
+            ::texcaller_pool_release(job_);
+        }
+    }
+
+    conversion(const conversion &) = delete;
+    conversion &operator=(const conversion &) = delete;
+
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    bool await_suspend(std::coroutine_handle<> handle)
+    {
+        char *c_info;
+        handle_ = handle;
+        job_ = ::texcaller_pool_submit(&c_info, pool_, source_.data(), source_.size(),
+                                       source_format_.c_str(), result_format_.c_str(),
+                                       max_runs_, &options_, &conversion::finished, this);
+        if (job_ == nullptr) {
+            result_.info_.reset(c_info);
+            return false;
+        }
+        stop_callback_.emplace(stop_, canceller{job_});
+        /* whoever comes second resumes the coroutine */
+        return state_.exchange(suspended) != done;
+    }
+
+    result await_resume()
+    {
+        stop_callback_.reset();
+        if (stats_ != nullptr) {
+            *stats_ = result_.stats_;
+        }
+        if (!result_.info_) {
+            throw std::runtime_error("Out of memory.");
+        }
+        if (!result_.data_) {
+            throw std::domain_error(result_.info_.get());
+        }
+        return std::move(result_);
+    }
+
+private:
+    enum state { submitting, suspended, done };
+
+    struct canceller
+    {
+        texcaller_pool_job *job;
+
+        void operator()() const noexcept
+        {
+            ::texcaller_pool_cancel(job);
+        }
+    };
+
+    static void finished(void *data, char *c_result, size_t c_result_size, char *c_info)
+    {
+        conversion *self = static_cast<conversion *>(data);
+        self->result_.data_.reset(c_result);
+        self->result_.size_ = c_result_size;
+        self->result_.info_.reset(c_info);
+        if (self->state_.exchange(done) == suspended) {
+            self->reactor_.schedule(self->handle_);
+        }
+    }
+
+    texcaller_pool *pool_;
+    texcaller::reactor &reactor_;
+    std::string_view source_;
+    const std::string source_format_;
+    const std::string result_format_;
+    int max_runs_;
+    texcaller_options options_;
+    texcaller_stats *stats_ = nullptr;
+    std::stop_token stop_;
+    result result_;
+    std::coroutine_handle<> handle_;
+    std::atomic<state> state_{submitting};
+    texcaller_pool_job *job_ = nullptr;
+    std::optional<std::stop_callback<canceller> > stop_callback_;
+};
+
+/*! Convert a TeX or LaTeX source by a worker of a pool,
+ *  awaited via \c co_await:
+ *
+ *  \code
+texcaller::result pdf = co_await texcaller::convert(pool, reactor, latex, "LaTeX", "PDF", 5);
+ *  \endcode
+ *
+ *  This is a wrapper around \ref texcaller_pool_submit,
+ *  so thousands of conversions may be in flight
+ *  while only the workers of the pool block on TeX processes.
+ *
+ *  This requires C++20.
+ *
+ *  \return
+ *      the conversion, which starts when it is awaited
+ *
+ *  \param pool
+ *      the pool, see texcaller_pool_create()
+ *
+ *  \param reactor
+ *      resumes the awaiting coroutine
+ *
+ *  \param source
+ *      the source to convert, which must stay valid until the conversion is done
+ *
+ *  \param stop
+ *      stop token which cancels the conversion via \ref texcaller_pool_cancel,
+ *      killing the running TeX process
+ *
+ *  See the texcaller::convert() with \c std::string_view arguments
+ *  for the other parameters and the exceptions.
+ */
+inline conversion convert(texcaller_pool *pool, reactor &reactor, std::string_view source, std::string_view source_format, std::string_view result_format, int max_runs, const texcaller_options *options = nullptr, std::stop_token stop = {})
+{
+    return conversion(pool, reactor, source, source_format, result_format, max_runs, options, std::move(stop));
+}
+
+#endif
+
 /*! @} */
 
 }
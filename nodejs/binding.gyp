@@ -0,0 +1,11 @@
+{
+    "targets": [
+        {
+            "target_name": "texcaller",
+            "sources": ["texcaller_node.c"],
+            "defines": ["_GNU_SOURCE"],
+            "cflags": ["-pthread"],
+            "ldflags": ["-pthread"]
+        }
+    ]
+}
@@ -0,0 +1,20 @@
+'use strict';
+
+const texcaller = require('texcaller');
+
+const latex = String.raw`\documentclass{article}
+\begin{document}
+Hello world!
+\end{document}`;
+
+texcaller.convert(latex, 'LaTeX', 'PDF', 5).then(({ result: pdf, info }) => {
+    console.log('PDF size:     %s KB', (pdf.length / 1024).toFixed(1));
+    console.log('PDF content:  %s ... %s', pdf.subarray(0, 5), pdf.subarray(-6));
+}, (error) => {
+    console.log('Error: %s', error.message);
+});
+
+const s = 'Téxt → "with" $peciäl <characters>';
+
+console.log('Original:  %j', s);
+console.log('Escaped:   %j', texcaller.escapeLatex(s));
@@ -0,0 +1,372 @@
+/* See doc/index.html for copyright information and documentation. */
+
+/*! \defgroup nodejs Texcaller Node.js interface
+ *
+ *  \par Synopsis
+ *
+ *  \code
+const texcaller = require('texcaller');
+texcaller.convert(source, sourceFormat, resultFormat, maxRuns)  // returns a promise of {result, info}
+texcaller.convertToPath(path, source, sourceFormat, resultFormat, maxRuns)  // returns a promise of info
+texcaller.convertToFd(fd, source, sourceFormat, resultFormat, maxRuns)  // returns a promise of info
+texcaller.escapeLatex(s)
+ *  \endcode
+ *
+ *  \par Description
+ *
+ *  These
+ *  <a href="https://nodejs.org/">Node.js</a>
+ *  functions are simple wrappers
+ *  around the \ref c library functions,
+ *  making
+ *  <a href="http://www.tug.org/">TeX</a>
+ *  typesetting
+ *  easily accessible from Node.js
+ *  without spawning the \ref shell for each document.
+ *
+ *  Conversions run in the thread pool of libuv,
+ *  so they never block the event loop.
+ *  Each running conversion occupies a thread of that pool,
+ *  so \c UV_THREADPOOL_SIZE limits the number of parallel conversions.
+ *  The source may be a string or a \c Buffer.
+ *  The generated document is a \c Buffer
+ *  over the memory allocated by the C library, so it is never copied.
+ *  \c convertToPath() and \c convertToFd() write the generated document
+ *  directly to a file, pipe or socket instead,
+ *  see texcaller_convert_to_path() and texcaller_convert_to_fd().
+ *  Invalid TeX documents reject the promise
+ *  with an \c Error whose message is the info message.
+ *
+ *  \par Example
+ *
+ *  \include example.js
+ */
+
+#include <node_api.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../c/texcaller.h"
+
+/*! A conversion run in the thread pool of libuv.
+ */
+struct node_conversion {
+    /*! the work queued to the thread pool */
+    napi_async_work work;
+    /*! the promise returned by convert() */
+    napi_deferred deferred;
+    /*! a copy of the source,
+     *  as JavaScript may modify a \c Buffer during the conversion */
+    char *source;
+    /*! size of \c source */
+    size_t source_size;
+    /*! see texcaller_convert() */
+    char *source_format;
+    /*! see texcaller_convert() */
+    char *result_format;
+    /*! see texcaller_convert() */
+    int max_runs;
+    /*! see texcaller_convert_to_path(),
+     *  or \c NULL if not converting to a path */
+    char *path;
+    /*! see texcaller_convert_to_fd(),
+     *  or -1 if not converting to a file descriptor */
+    int fd;
+    /*! return value of texcaller_convert_to_path() or texcaller_convert_to_fd() */
+    int status;
+    /*! see texcaller_convert() */
+    char *result;
+    /*! see texcaller_convert() */
+    size_t result_size;
+    /*! see texcaller_convert() */
+    char *info;
+};
+
+/*! Copy a JavaScript string to a newly allocated UTF-8 string.
+ *
+ *  \return
+ *      \c napi_ok on success,
+ *      \c napi_string_expected if \c value isn't a string,
+ *      or \c napi_generic_failure when out of memory
+ *
+ *  \param s
+ *      will contain the string, which must be freed by the caller
+ *
+ *  \param size
+ *      will contain the size of \c s, or may be \c NULL
+ */
+static napi_status node_get_string(napi_env env, napi_value value, char **s, size_t *size)
+{
+    size_t length;
+    napi_status status;
+    *s = NULL;
+    status = napi_get_value_string_utf8(env, value, NULL, 0, &length);
+    if (status != napi_ok) {
+        return status;
+    }
+    *s = (char *)malloc(length + 1);
+    if (*s == NULL) {
+        return napi_generic_failure;
+    }
+    status = napi_get_value_string_utf8(env, value, *s, length + 1, &length);
+    if (status != napi_ok) {
+        free(*s);
+        *s = NULL;
+        return status;
+    }
+    if (size != NULL) {
+        *size = length;
+    }
+    return napi_ok;
+}
+
+/*! Free a conversion.
+ */
+static void node_free_conversion(napi_env env, struct node_conversion *conversion)
+{
+    if (conversion->work != NULL) {
+        napi_delete_async_work(env, conversion->work);
+    }
+    free(conversion->source);
+    free(conversion->source_format);
+    free(conversion->result_format);
+    free(conversion->path);
+    free(conversion->result);
+    free(conversion->info);
+    free(conversion);
+}
+
+/*! Run a conversion, in a thread of the thread pool of libuv.
+ */
+static void node_execute(napi_env env, void *data)
+{
+    struct node_conversion *conversion = (struct node_conversion *)data;
+    (void)env;
+    if (conversion->path != NULL) {
+        conversion->status = texcaller_convert_to_path(&conversion->info, conversion->path,
+                                                       conversion->source, conversion->source_size,
+                                                       conversion->source_format, conversion->result_format,
+                                                       conversion->max_runs, NULL);
+    } else if (conversion->fd != -1) {
+        conversion->status = texcaller_convert_to_fd(&conversion->info, conversion->fd,
+                                                     conversion->source, conversion->source_size,
+                                                     conversion->source_format, conversion->result_format,
+                                                     conversion->max_runs, NULL);
+    } else {
+        texcaller_convert(&conversion->result, &conversion->result_size, &conversion->info,
+                          conversion->source, conversion->source_size,
+                          conversion->source_format, conversion->result_format, conversion->max_runs);
+        conversion->status = conversion->result == NULL ? -1 : 0;
+    }
+}
+
+/*! Free a generated document once its \c Buffer is garbage collected.
+ */
+static void node_free_result(napi_env env, void *data, void *hint)
+{
+    (void)env;
+    (void)hint;
+    free(data);
+}
+
+/*! Settle the promise of a finished conversion, in the main thread.
+ */
+static void node_complete(napi_env env, napi_status status, void *data)
+{
+    struct node_conversion *conversion = (struct node_conversion *)data;
+    const char *message = NULL;
+    napi_value value;
+    if (status != napi_ok) {
+        message = "Conversion was cancelled.";
+    } else if (conversion->info == NULL) {
+        message = "Out of memory.";
+    } else if (conversion->status != 0) {
+        message = conversion->info;
+    }
+    if (message != NULL) {
+        napi_value error_message;
+        napi_create_string_utf8(env, message, NAPI_AUTO_LENGTH, &error_message);
+        napi_create_error(env, NULL, error_message, &value);
+        napi_reject_deferred(env, conversion->deferred, value);
+    } else if (conversion->path != NULL || conversion->fd != -1) {
+        napi_create_string_utf8(env, conversion->info, NAPI_AUTO_LENGTH, &value);
+        napi_resolve_deferred(env, conversion->deferred, value);
+    } else {
+        napi_value result;
+        napi_value info;
+        /* hand the result over to the Buffer, unless external buffers are disallowed */
+        if (napi_create_external_buffer(env, conversion->result_size, conversion->result,
+                                        node_free_result, NULL, &result) == napi_ok) {
+            conversion->result = NULL;
+        } else {
+            napi_create_buffer_copy(env, conversion->result_size, conversion->result, NULL, &result);
+        }
+        napi_create_string_utf8(env, conversion->info, NAPI_AUTO_LENGTH, &info);
+        napi_create_object(env, &value);
+        napi_set_named_property(env, value, "result", result);
+        napi_set_named_property(env, value, "info", info);
+        napi_resolve_deferred(env, conversion->deferred, value);
+    }
+    node_free_conversion(env, conversion);
+}
+
+/*! Queue a conversion to the thread pool of libuv.
+ *
+ *  \return
+ *      the promise of the conversion,
+ *      or \c NULL if an exception is pending
+ *
+ *  \param target
+ *      what the first argument is:
+ *      - \c "path" for convertToPath()
+ *      - \c "fd" for convertToFd()
+ *      - \c NULL for convert(), which has no such argument
+ */
+static napi_value node_queue(napi_env env, napi_callback_info callback_info, const char *target)
+{
+    const size_t offset = target != NULL ? 1 : 0;
+    size_t argc = 5;
+    napi_value argv[5];
+    napi_value promise;
+    napi_value name;
+    struct node_conversion *conversion;
+    bool is_buffer;
+    napi_status status = napi_ok;
+    napi_get_cb_info(env, callback_info, &argc, argv, NULL, NULL);
+    if (argc < offset + 4) {
+        napi_throw_type_error(env, NULL, offset > 0 ? "Expected 5 arguments." : "Expected 4 arguments.");
+        return NULL;
+    }
+    conversion = (struct node_conversion *)calloc(1, sizeof(struct node_conversion));
+    if (conversion == NULL) {
+        napi_throw_error(env, NULL, "Out of memory.");
+        return NULL;
+    }
+    conversion->fd = -1;
+    /* load arguments */
+    if (target != NULL && strcmp(target, "path") == 0) {
+        status = node_get_string(env, argv[0], &conversion->path, NULL);
+    } else if (target != NULL) {
+        status = napi_get_value_int32(env, argv[0], &conversion->fd);
+        if (status == napi_ok && conversion->fd < 0) {
+            status = napi_invalid_arg;
+        }
+    }
+    if (status == napi_ok) {
+        napi_is_buffer(env, argv[offset], &is_buffer);
+        if (is_buffer) {
+            void *source;
+            napi_get_buffer_info(env, argv[offset], &source, &conversion->source_size);
+            conversion->source = (char *)malloc(conversion->source_size + 1);
+            if (conversion->source == NULL) {
+                status = napi_generic_failure;
+            } else {
+                memcpy(conversion->source, source, conversion->source_size);
+            }
+        } else {
+            status = node_get_string(env, argv[offset], &conversion->source, &conversion->source_size);
+        }
+    }
+    if (status == napi_ok) {
+        status = node_get_string(env, argv[offset + 1], &conversion->source_format, NULL);
+    }
+    if (status == napi_ok) {
+        status = node_get_string(env, argv[offset + 2], &conversion->result_format, NULL);
+    }
+    if (status == napi_ok) {
+        status = napi_get_value_int32(env, argv[offset + 3], &conversion->max_runs);
+    }
+    if (status != napi_ok) {
+        node_free_conversion(env, conversion);
+        if (status == napi_generic_failure) {
+            napi_throw_error(env, NULL, "Out of memory.");
+        } else if (target == NULL) {
+            napi_throw_type_error(env, NULL, "Expected a string or Buffer, two strings and a number.");
+        } else if (strcmp(target, "path") == 0) {
+            napi_throw_type_error(env, NULL, "Expected a string, a string or Buffer, two strings and a number.");
+        } else {
+            napi_throw_type_error(env, NULL, "Expected a file descriptor, a string or Buffer, two strings and a number.");
+        }
+        return NULL;
+    }
+    /* run the conversion in the thread pool */
+    napi_create_promise(env, &conversion->deferred, &promise);
+    napi_create_string_utf8(env, "texcaller.convert", NAPI_AUTO_LENGTH, &name);
+    napi_create_async_work(env, NULL, name, node_execute, node_complete, conversion, &conversion->work);
+    napi_queue_async_work(env, conversion->work);
+    return promise;
+}
+
+/*! JavaScript function \c convert().
+ */
+static napi_value node_convert(napi_env env, napi_callback_info callback_info)
+{
+    return node_queue(env, callback_info, NULL);
+}
+
+/*! JavaScript function \c convertToPath().
+ */
+static napi_value node_convert_to_path(napi_env env, napi_callback_info callback_info)
+{
+    return node_queue(env, callback_info, "path");
+}
+
+/*! JavaScript function \c convertToFd().
+ */
+static napi_value node_convert_to_fd(napi_env env, napi_callback_info callback_info)
+{
+    return node_queue(env, callback_info, "fd");
+}
+
+/*! JavaScript function \c escapeLatex().
+ */
+static napi_value node_escape_latex(napi_env env, napi_callback_info callback_info)
+{
+    size_t argc = 1;
+    napi_value argv[1];
+    napi_value result;
+    char *s;
+    char *native_result;
+    napi_status status;
+    napi_get_cb_info(env, callback_info, &argc, argv, NULL, NULL);
+    if (argc < 1) {
+        napi_throw_type_error(env, NULL, "Expected 1 argument.");
+        return NULL;
+    }
+    /* load arguments */
+    status = node_get_string(env, argv[0], &s, NULL);
+    if (status != napi_ok) {
+        if (status == napi_generic_failure) {
+            napi_throw_error(env, NULL, "Out of memory.");
+        } else {
+            napi_throw_type_error(env, NULL, "Expected a string.");
+        }
+        return NULL;
+    }
+    /* call function */
+    native_result = texcaller_escape_latex(s);
+    /* free arguments */
+    free(s);
+    /* return result */
+    if (native_result == NULL) {
+        napi_throw_error(env, NULL, "Out of memory.");
+        return NULL;
+    }
+    napi_create_string_utf8(env, native_result, NAPI_AUTO_LENGTH, &result);
+    free(native_result);
+    return result;
+}
+
+NAPI_MODULE_INIT()
+{
+    napi_property_descriptor properties[] = {
+        { "convert", NULL, node_convert, NULL, NULL, NULL, napi_enumerable, NULL },
+        { "convertToPath", NULL, node_convert_to_path, NULL, NULL, NULL, napi_enumerable, NULL },
+        { "convertToFd", NULL, node_convert_to_fd, NULL, NULL, NULL, napi_enumerable, NULL },
+        { "escapeLatex", NULL, node_escape_latex, NULL, NULL, NULL, napi_enumerable, NULL }
+    };
+    napi_define_properties(env, exports, sizeof(properties) / sizeof(properties[0]), properties);
+    return exports;
+}
+
+#include "../c/texcaller.c"
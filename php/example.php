@@ -15,3 +15,14 @@ $s = 'Téxt → "with" $peciäl <characters>';
 
 echo 'Original:  '.$s."\n";
 echo 'Escaped:   '.texcaller_escape_latex($s)."\n";
+
+$strings = array('50% off', '', 'a & b', $s);
+$escaped = texcaller_escape_latex_batch($strings);
+if ($escaped !== array_map('texcaller_escape_latex', $strings)) {
+    throw new Exception('batch differs');
+}
+if (texcaller_escape_latex_batch(array()) !== array()) {
+    throw new Exception('empty batch differs');
+}
+
+echo 'Batch:     '.implode(' | ', $escaped)."\n";
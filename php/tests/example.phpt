@@ -9,3 +9,4 @@ PDF content:  %PDF- ... %%EOF
 
 Original:  Téxt → "with" $peciäl <characters>
 Escaped:   Téxt → {''}with{''} \$peciäl \textless{}characters\textgreater{}
+Batch:     50\% off |  | a \& b | Téxt → {''}with{''} \$peciäl \textless{}characters\textgreater{}
@@ -30,3 +30,7 @@ select
         || '\end{document}',
         'LaTeX', 'PDF', 5
     );
+
+-- escape many values at once, such as the cells of a table
+select
+    texcaller_escape_latex(array['50%', 'R&D', null, '$100'] :: text[]);
@@ -7,3 +7,7 @@ language c as '$libdir/texcaller', 'postgresql_texcaller_convert';
 create function
 texcaller_escape_latex(s text) returns text immutable strict
 language c as '$libdir/texcaller', 'postgresql_texcaller_escape_latex';
+
+create function
+texcaller_escape_latex(strings text[]) returns text[] immutable strict
+language c as '$libdir/texcaller', 'postgresql_texcaller_escape_latex_array';
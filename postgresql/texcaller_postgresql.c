@@ -7,6 +7,7 @@
  *  \dontinclude texcaller.sql
  *  \skipline (
  *  \skipline (
+ *  \skipline (
  *
  *  \par Description
  *
@@ -32,7 +33,9 @@
  */
 
 #include <postgres.h>
+#include <catalog/pg_type.h>
 #include <executor/executor.h>
+#include <utils/array.h>
 #include <utils/builtins.h>
 
 #include "../c/texcaller.h"
@@ -41,6 +44,7 @@ PG_MODULE_MAGIC;
 
 Datum postgresql_texcaller_convert(PG_FUNCTION_ARGS);
 Datum postgresql_texcaller_escape_latex(PG_FUNCTION_ARGS);
+Datum postgresql_texcaller_escape_latex_array(PG_FUNCTION_ARGS);
 
 PG_FUNCTION_INFO_V1(postgresql_texcaller_convert);
 Datum postgresql_texcaller_convert(PG_FUNCTION_ARGS)
@@ -110,4 +114,53 @@ Datum postgresql_texcaller_escape_latex(PG_FUNCTION_ARGS)
     PG_RETURN_TEXT_P(result);
 }
 
+PG_FUNCTION_INFO_V1(postgresql_texcaller_escape_latex_array);
+Datum postgresql_texcaller_escape_latex_array(PG_FUNCTION_ARGS)
+{
+    ArrayType *array;
+    Datum *elements;
+    bool *nulls;
+    int count;
+    size_t *offsets;
+    char *strings;
+    char *native_result;
+    size_t *native_offsets;
+    int i;
+    /* load arguments */
+    array = PG_GETARG_ARRAYTYPE_P(0);
+    deconstruct_array(array, TEXTOID, -1, false, 'i', &elements, &nulls, &count);
+    offsets = palloc((count + 1) * sizeof(size_t));
+    offsets[0] = 0;
+    for (i = 0; i < count; i++) {
+        offsets[i + 1] = offsets[i] + (nulls[i] ? 0 : VARSIZE_ANY_EXHDR(DatumGetPointer(elements[i])));
+    }
+    strings = palloc(offsets[count] + 1);
+    for (i = 0; i < count; i++) {
+        if (!nulls[i]) {
+            memcpy(strings + offsets[i], VARDATA_ANY(DatumGetPointer(elements[i])), offsets[i + 1] - offsets[i]);
+        }
+    }
+    /* call function */
+    if (texcaller_escape_latex_batch(&native_result, &native_offsets, strings, offsets, count) != 0) {
+        ereport(ERROR,
+                (errcode(ERRCODE_OUT_OF_MEMORY),
+                 errmsg("Out of memory.")));
+        PG_RETURN_NULL();
+    }
+    /* free arguments */
+    pfree(strings);
+    pfree(offsets);
+    /* return result, keeping NULL elements and the dimensions */
+    for (i = 0; i < count; i++) {
+        if (!nulls[i]) {
+            elements[i] = PointerGetDatum(cstring_to_text_with_len(native_result + native_offsets[i],
+                                                                   native_offsets[i + 1] - native_offsets[i]));
+        }
+    }
+    free(native_result);
+    free(native_offsets);
+    PG_RETURN_ARRAYTYPE_P(construct_md_array(elements, nulls, ARR_NDIM(array), ARR_DIMS(array), ARR_LBOUND(array),
+                                             TEXTOID, -1, false, 'i'));
+}
+
 #include "../c/texcaller.c"
@@ -2,6 +2,8 @@
 
 from __future__ import print_function, unicode_literals
 
+from array import array
+
 import texcaller
 
 latex = r'''\documentclass{article}
@@ -17,3 +19,19 @@ s = 'Téxt → "with" $peciäl <characters>'
 
 print('Original:  %r' % s)
 print('Escaped:   %r' % texcaller.escape_latex(s))
+
+strings = ['50% off', '', 'a & b', s]
+escaped = texcaller.escape_latex_batch(strings)
+assert escaped == tuple(texcaller.escape_latex(t) for t in strings)
+assert texcaller.escape_latex_batch([]) == ()
+
+print('Batch:     %r' % (escaped,))
+
+table, info = texcaller.render_table([
+    {'type': 'text', 'strings': ['a & b', '50%']},
+    {'type': 'number', 'numbers': array('d', [1.5, -2.25]), 'precision': 2},
+    {'type': 'integer', 'integers': array('l', [1, 2]), 'nulls': b'\x00\x01'},
+], 2)
+assert table == 'a \\& b & 1.50 & 1 \\\\\n50\\% & -2.25 &  \\\\\n'
+
+print('Table:     %r' % table)
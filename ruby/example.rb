@@ -18,3 +18,10 @@ s = 'Téxt → "with" $peciäl <characters>'
 
 puts "Original:  #{s}"
 puts "Escaped:   #{Texcaller.escape_latex(s)}"
+
+strings = ['50% off', '', 'a & b', s]
+escaped = Texcaller.escape_latex_batch(strings)
+raise 'batch differs' unless escaped == strings.map { |t| Texcaller.escape_latex(t) }
+raise 'empty batch differs' unless Texcaller.escape_latex_batch([]) == []
+
+puts "Batch:     #{escaped.join(' | ')}"
@@ -6,6 +6,7 @@
  *
  *  \code
 texcaller SRC_FORMAT DEST_FORMAT MAX_RUNS <SRC >DEST
+texcaller --warmup
  *  \endcode
  *
  *  \par Example
@@ -15,17 +16,24 @@ texcaller SRC_FORMAT DEST_FORMAT MAX_RUNS <SRC >DEST
  *  \par Description
  *
  *  The \c texcaller binary is a simple command line tool
- *  around the texcaller_convert() library function.
+ *  around the texcaller_convert_to_fd() library function.
  *
  *  It is an alternative, simpler command line interface for
  *  <a href="http://www.tug.org/">TeX</a>
  *  to be used in shell scripts.
  *
  *  It reads the source document from standard input
- *  and writes the result document to standard output.
+ *  and writes the result document to standard output,
+ *  which is copied within the kernel rather than read into memory.
  *  No temporary files are left behind.
  *  Information and error messages are reported to standard error.
  *  The exit code is 0 on success and 1 on failure.
+ *
+ *  With \c --warmup,
+ *  the \c texcaller binary calls texcaller_warmup()
+ *  instead of converting a document.
+ *  This is meant to be run on fresh machines
+ *  before they get their first real conversion.
  */
 
 #include "texcaller.h"
@@ -33,6 +41,7 @@ texcaller SRC_FORMAT DEST_FORMAT MAX_RUNS <SRC >DEST
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 int main(int argc, char *argv[])
 {
@@ -45,13 +54,19 @@ int main(int argc, char *argv[])
     size_t read_size;
     const size_t source_size_increment = 4096;
 
-    char *result;
-    size_t result_size;
+    int status;
     char *info;
 
     /* command line arguments */
+    if (argc == 2 && strcmp(argv[1], "--warmup") == 0) {
+        int status = texcaller_warmup(&info, 0, 1);
+        fprintf(stderr, "%s\n", info == NULL ? "Out of memory." : info);
+        free(info);
+        return status == 0 ? 0 : 1;
+    }
     if (argc != 4) {
         fprintf(stderr, "Usage: texcaller SRC_FORMAT DEST_FORMAT MAX_RUNS <SRC >DEST\n");
+        fprintf(stderr, "       texcaller --warmup\n");
         return 1;
     }
     source_format = argv[1];
@@ -78,9 +93,10 @@ int main(int argc, char *argv[])
         return 1;
     }
 
-    /* run tex */
-    texcaller_convert(&result, &result_size, &info,
-                      source, source_size, source_format, result_format, max_runs);
+    /* run tex, result -> stdout */
+    status = texcaller_convert_to_fd(&info, STDOUT_FILENO,
+                                     source, source_size, source_format, result_format, max_runs,
+                                     NULL);
 
     /* cleanup */
     free(source);
@@ -88,17 +104,5 @@ int main(int argc, char *argv[])
     /* info -> stderr */
     fprintf(stderr, "%s\n", info == NULL ? "Out of memory." : info);
     free(info);
-
-    /* output -> stdout */
-    if (result == NULL) {
-        return 1;
-    }
-    if (fwrite(result, 1, result_size, stdout) != result_size) {
-        fprintf(stderr, "Unable to output %lu bytes: %s.\n",
-                (unsigned long)result_size, strerror(errno));
-        free(result);
-        return 1;
-    }
-    free(result);
-    return 0;
+    return status == 0 ? 0 : 1;
 }
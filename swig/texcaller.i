@@ -7,7 +7,11 @@
  *  \code
 import texcaller
 texcaller.convert(source, source_format, result_format, max_runs)  # returns a pair (result, info)
+texcaller.convert_to_path(path, source, source_format, result_format, max_runs)  # returns info
+texcaller.convert_to_file(f, source, source_format, result_format, max_runs)  # returns info
 texcaller.escape_latex(s)
+texcaller.escape_latex_batch(strings)  # returns a tuple of escaped strings
+texcaller.render_table(columns, rows)  # returns a pair (table, info)
  *  \endcode
  *
  *  \par Description
@@ -21,6 +25,23 @@ texcaller.escape_latex(s)
  *  typesetting
  *  easily accessible from Python.
  *
+ *  The \c convert_to_path() and \c convert_to_file() functions
+ *  write the generated document directly to a file,
+ *  without creating a Python string of it.
+ *  \c convert_to_file() takes a file object,
+ *  writing at its current position
+ *  via the file descriptor returned by its \c fileno() method.
+ *
+ *  The \c render_table() function takes a list of dicts
+ *  with the members of \ref texcaller_column.
+ *  Values are taken from objects supporting the buffer protocol,
+ *  such as \c bytes, \c array.array or NumPy arrays,
+ *  in native byte order:
+ *  \c size_t offsets, \c long integers,
+ *  \c double numbers and one byte per row for \c nulls.
+ *  Without \c offsets,
+ *  the \c strings of a \c "text" column may also be a list of strings.
+ *
  *  \par Example
  *
  *  \include example.py
@@ -60,6 +81,41 @@ texcaller.escape_latex(s)
         val = (result, info.decode('UTF-8'))
 %}
 
+%pythonprepend convert_to_path %{
+    if str is bytes:
+        path = path.encode('UTF-8')
+        source = source.encode('UTF-8')
+        source_format = source_format.encode('UTF-8')
+        result_format = result_format.encode('UTF-8')
+%}
+%pythonappend convert_to_path %{
+    if str is bytes:
+        val = val.decode('UTF-8')
+%}
+
+%pythonprepend convert_to_fd %{
+    if str is bytes:
+        source = source.encode('UTF-8')
+        source_format = source_format.encode('UTF-8')
+        result_format = result_format.encode('UTF-8')
+%}
+%pythonappend convert_to_fd %{
+    if str is bytes:
+        val = val.decode('UTF-8')
+%}
+
+%pythoncode %{
+def convert_to_file(f, source, source_format, result_format, max_runs):
+    f.flush()
+    info = convert_to_fd(f.fileno(), source, source_format, result_format, max_runs)
+    try:
+        # take over the position advanced via the file descriptor
+        f.seek(0, 1)
+    except (IOError, OSError):
+        pass
+    return info
+%}
+
 %pythonprepend escape_latex %{
     if str is bytes:
         s = s.encode('UTF-8')
@@ -69,6 +125,38 @@ texcaller.escape_latex(s)
         val = val.decode('UTF-8')
 %}
 
+%pythonprepend escape_latex_batch %{
+    if str is bytes:
+        strings = [s.encode('UTF-8') for s in strings]
+%}
+%pythonappend escape_latex_batch %{
+    if str is bytes:
+        val = tuple(s.decode('UTF-8') for s in val)
+%}
+
+%pythoncode %{
+def render_table(columns, rows):
+    table = Table(rows)
+    for column in columns:
+        column_type = column['type']
+        strings = column.get('strings')
+        is_list = column_type == 'text' and column.get('offsets') is None and isinstance(strings, (list, tuple))
+        if str is bytes:
+            column_type = column_type.encode('UTF-8')
+        if is_list:
+            if str is bytes:
+                strings = [s.encode('UTF-8') for s in strings]
+            table.add_text_column(strings, column.get('nulls'))
+        else:
+            table.add_column(column_type, strings, column.get('offsets'),
+                             column.get('integers', column.get('numbers')),
+                             column.get('precision', -1), column.get('nulls'))
+    (result, info) = table.render()
+    if str is bytes:
+        (result, info) = (result.decode('UTF-8'), info.decode('UTF-8'))
+    return (result, info)
+%}
+
 #endif
 /*! \endcond */
 
@@ -79,7 +167,10 @@ texcaller.escape_latex(s)
  *  \code
 require 'texcaller'
 Texcaller.convert(source, source_format, result_format, max_runs)  # returns a pair [result, info]
+Texcaller.convert_to_path(path, source, source_format, result_format, max_runs)  # returns info
+Texcaller.convert_to_fd(io, source, source_format, result_format, max_runs)  # returns info
 Texcaller.escape_latex(s)
+Texcaller.escape_latex_batch(strings)  # returns an array of escaped strings
  *  \endcode
  *
  *  \par Description
@@ -93,6 +184,11 @@ Texcaller.escape_latex(s)
  *  typesetting
  *  easily accessible from Ruby.
  *
+ *  The \c convert_to_path() and \c convert_to_fd() functions
+ *  write the generated document directly to a file,
+ *  without creating a Ruby string of it.
+ *  \c convert_to_fd() takes an \c IO object or a file descriptor.
+ *
  *  \par Example
  *
  *  \include example.rb
@@ -100,6 +196,16 @@ Texcaller.escape_latex(s)
 
 /*! \cond */
 #ifdef SWIGRUBY
+
+%typemap(in) int fd {
+    if (rb_respond_to($input, rb_intern("fileno"))) {
+        rb_funcall($input, rb_intern("flush"), 0);
+        $1 = NUM2INT(rb_funcall($input, rb_intern("fileno"), 0));
+    } else {
+        $1 = NUM2INT($input);
+    }
+}
+
 #endif
 /*! \endcond */
 
@@ -109,7 +215,10 @@ Texcaller.escape_latex(s)
  *
  *  \code
 texcaller_convert(&$result, &$info, $source, $source_format, $result_format, $max_runs)
+texcaller_convert_to_path(&$info, $path, $source, $source_format, $result_format, $max_runs)
+texcaller_convert_to_fd(&$info, $fd, $source, $source_format, $result_format, $max_runs)
 texcaller_escape_latex($s)
+texcaller_escape_latex_batch($strings)  // returns an array of escaped strings
  *  \endcode
  *
  *  \par Description
@@ -123,6 +232,10 @@ texcaller_escape_latex($s)
  *  typesetting
  *  easily accessible from PHP.
  *
+ *  The \c texcaller_convert_to_path() and \c texcaller_convert_to_fd() functions
+ *  write the generated document directly to a file,
+ *  without creating a PHP string of it.
+ *
  *  \par Example
  *
  *  \include example.php
@@ -132,7 +245,10 @@ texcaller_escape_latex($s)
 #ifdef SWIGPHP
 
 %rename(texcaller_convert) texcaller::convert;
+%rename(texcaller_convert_to_path) texcaller::convert_to_path;
+%rename(texcaller_convert_to_fd) texcaller::convert_to_fd;
 %rename(texcaller_escape_latex) texcaller::escape_latex;
+%rename(texcaller_escape_latex_batch) texcaller::escape_latex_batch;
 
 #endif
 /*! \endcond */
@@ -150,12 +266,215 @@ texcaller_escape_latex($s)
 
 %module texcaller
 
+#ifdef SWIGPHP
+
+/* map string vectors to plain PHP arrays */
+%typemap(in) const std::vector<std::string> & (std::vector<std::string> temp) {
+    zval *item;
+    if (Z_TYPE($input) != IS_ARRAY) {
+        SWIG_PHP_Error(E_ERROR, "Expected an array of strings");
+    }
+    ZEND_HASH_FOREACH_VAL(Z_ARRVAL($input), item) {
+        zend_string *s = zval_get_string(item);
+        temp.push_back(std::string(ZSTR_VAL(s), ZSTR_LEN(s)));
+        zend_string_release(s);
+    } ZEND_HASH_FOREACH_END();
+    $1 = &temp;
+}
+%typemap(out) std::vector<std::string> {
+    array_init($result);
+    for (size_t i = 0; i < $1.size(); i++) {
+        add_next_index_stringl($result, $1[i].data(), $1[i].size());
+    }
+}
+
+#else
+
+%template(StringVector) std::vector<std::string>;
+
+#endif
+
 namespace texcaller {
 
 void convert(std::string &OUTPUT, std::string &OUTPUT, const std::string &source, const std::string &source_format, const std::string &result_format, int max_runs) throw(std::domain_error, std::runtime_error);
+void convert_to_path(std::string &OUTPUT, const std::string &path, const std::string &source, const std::string &source_format, const std::string &result_format, int max_runs) throw(std::domain_error, std::runtime_error);
+void convert_to_fd(std::string &OUTPUT, int fd, const std::string &source, const std::string &source_format, const std::string &result_format, int max_runs) throw(std::domain_error, std::runtime_error);
 std::string escape_latex(const std::string &s) throw(std::runtime_error);
+std::vector<std::string> escape_latex_batch(const std::vector<std::string> &strings) throw(std::runtime_error);
+
+}
 
+#ifdef SWIGPYTHON
+
+/* take any object supporting the buffer protocol, or None */
+%typemap(in) (const char *BUFFER, size_t SIZE) (Py_buffer view, int have_view = 0) {
+    if ($input == Py_None) {
+        $1 = NULL;
+        $2 = 0;
+    } else {
+        if (PyObject_GetBuffer($input, &view, PyBUF_CONTIG_RO) != 0) {
+            SWIG_fail;
+        }
+        have_view = 1;
+        $1 = (char *)view.buf;
+        $2 = (size_t)view.len;
+    }
 }
+%typemap(freearg) (const char *BUFFER, size_t SIZE) {
+    if (have_view$argnum) {
+        PyBuffer_Release(&view$argnum);
+    }
+}
+%apply (const char *BUFFER, size_t SIZE) {
+    (const char *strings, size_t strings_size),
+    (const char *offsets, size_t offsets_size),
+    (const char *values, size_t values_size),
+    (const char *nulls, size_t nulls_size)
+};
+%apply std::string &OUTPUT { std::string &result, std::string &info };
+
+%catches(std::invalid_argument) texcaller::Table::add_column;
+%catches(std::invalid_argument) texcaller::Table::add_text_column;
+%catches(std::domain_error, std::runtime_error) texcaller::Table::render;
+
+%inline %{
+namespace texcaller {
+
+/* Columns of a table for render_table(), copied from Python buffers */
+class Table
+{
+public:
+    explicit Table(size_t rows) : rows(rows)
+    {
+    }
+
+    void add_column(const char *type, const char *strings, size_t strings_size, const char *offsets, size_t offsets_size, const char *values, size_t values_size, int precision, const char *nulls, size_t nulls_size)
+    {
+        column c;
+        c.type = type == NULL ? "" : type;
+        c.has_type = type != NULL;
+        c.precision = precision;
+        if (c.type == "text" && strings != NULL && offsets != NULL) {
+            const size_t *o = (const size_t *)offsets;
+            size_t row;
+            if (offsets_size != (rows + 1) * sizeof(size_t)) {
+                throw std::invalid_argument("Offsets need rows + 1 values of type size_t.");
+            }
+            for (row = 0; row < rows; row++) {
+                if (o[row] > o[row + 1]) {
+                    throw std::invalid_argument("Offsets are not ascending.");
+                }
+            }
+            if (o[rows] > strings_size) {
+                throw std::invalid_argument("Offsets point beyond the strings.");
+            }
+        } else if (c.type == "integer" && values != NULL && values_size != rows * sizeof(long)) {
+            throw std::invalid_argument("Integers need one value of type long per row.");
+        } else if (c.type == "number" && values != NULL && values_size != rows * sizeof(double)) {
+            throw std::invalid_argument("Numbers need one value of type double per row.");
+        }
+        copy_buffer(c.strings, strings, strings_size);
+        copy_buffer(c.offsets, offsets, offsets_size);
+        copy_buffer(c.values, values, values_size);
+        set_nulls(c, nulls, nulls_size);
+        columns.push_back(c);
+    }
+
+    void add_text_column(const std::vector<std::string> &strings, const char *nulls, size_t nulls_size)
+    {
+        column c;
+        std::string data;
+        std::vector<size_t> o(1, 0);
+        if (strings.size() != rows) {
+            throw std::invalid_argument("Text columns need one string per row.");
+        }
+        for (std::vector<std::string>::const_iterator s = strings.begin(); s != strings.end(); ++s) {
+            data += *s;
+            o.push_back(data.size());
+        }
+        c.type = "text";
+        c.has_type = true;
+        c.precision = -1;
+        copy_buffer(c.strings, data.data(), data.size());
+        copy_buffer(c.offsets, (const char *)&o[0], o.size() * sizeof(size_t));
+        set_nulls(c, nulls, nulls_size);
+        columns.push_back(c);
+    }
+
+    void render(std::string &result, std::string &info) const
+    {
+        std::vector<texcaller_column> c_columns(columns.size() + 1);
+        char *c_result;
+        size_t c_result_size;
+        char *c_info;
+        size_t i;
+        for (i = 0; i < columns.size(); i++) {
+            const column &c = columns[i];
+            texcaller_column &c_column = c_columns[i];
+            c_column.type = c.has_type ? c.type.c_str() : NULL;
+            c_column.strings = buffer(c.strings);
+            c_column.offsets = (const size_t *)buffer(c.offsets);
+            c_column.integers = (const long *)buffer(c.values);
+            c_column.numbers = (const double *)buffer(c.values);
+            c_column.precision = c.precision;
+            c_column.nulls = (const unsigned char *)buffer(c.nulls);
+        }
+        ::texcaller_render_table(&c_result, &c_result_size, &c_info, &c_columns[0], columns.size(), rows);
+        if (c_info == NULL) {
+            throw std::runtime_error("Out of memory.");
+        }
+        if (c_result == NULL) {
+            const std::string error_info(c_info);
+            free(c_info);
+            throw std::domain_error(error_info);
+        }
+        info.assign(c_info);
+        free(c_info);
+        result.assign(c_result, c_result_size);
+        free(c_result);
+    }
+
+private:
+    struct column {
+        std::string type;
+        bool has_type;
+        std::vector<char> strings;
+        std::vector<char> offsets;
+        std::vector<char> values;
+        int precision;
+        std::vector<char> nulls;
+    };
+
+    /* a trailing null byte keeps copies of empty buffers apart from missing ones */
+    static void copy_buffer(std::vector<char> &copy, const char *data, size_t size)
+    {
+        if (data != NULL) {
+            copy.assign(data, data + size);
+            copy.push_back('\0');
+        }
+    }
+
+    static const char *buffer(const std::vector<char> &copy)
+    {
+        return copy.empty() ? NULL : &copy[0];
+    }
+
+    void set_nulls(column &c, const char *nulls, size_t nulls_size)
+    {
+        if (nulls != NULL && nulls_size != rows) {
+            throw std::invalid_argument("Nulls need one byte per row.");
+        }
+        copy_buffer(c.nulls, nulls, nulls_size);
+    }
+
+    size_t rows;
+    std::vector<column> columns;
+};
+
+}
+%}
+
+#endif
 
 %{
 #include "../c/texcaller.c"